@@ -11,6 +11,10 @@
     'cflags': ['-Wall', '-Wextra', '-Wno-unused-parameter',
                '-fPIC', '-fno-strict-aliasing', '-fno-exceptions',
                '-pedantic'],
+    'link_settings': {
+      # Parallel scavenge
+      'libraries': ['-lpthread']
+    },
     'sources': [
       'src/zone.cc',
       'src/api.cc',
@@ -24,6 +28,9 @@
       'src/root.cc',
       'src/visitor.cc',
       'src/source-map.cc',
+      'src/stack-map.cc',
+      'src/ic.cc',
+      'src/numbers.cc',
       'src/hir.cc',
       'src/hir-instructions.cc',
       'src/lir.cc',
@@ -67,5 +74,21 @@
     'sources': [
       'src/can.cc'
     ]
+  }, {
+    'target_name': 'bench',
+    'type': 'executable',
+
+    'dependencies': ['candor'],
+
+    'include_dirs': [
+      'include',
+      'src'
+    ],
+    'cflags': ['-Wall', '-Wextra', '-Wno-unused-parameter',
+               '-fPIC', '-fno-strict-aliasing', '-fno-exceptions',
+               '-pedantic'],
+    'sources': [
+      'src/bench.cc'
+    ]
   }]
 }
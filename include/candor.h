@@ -26,6 +26,8 @@ class Object;
 class Array;
 class CData;
 struct Error;
+struct HeapStatistics;
+struct ICStatistics;
 
 class Isolate {
  public:
@@ -40,6 +42,18 @@ class Isolate {
 
   Array* StackTrace();
 
+  void GetHeapStatistics(HeapStatistics* stats);
+  void GetICStatistics(ICStatistics* stats);
+
+  // Old space GC is marking heap incrementally, with pauses of at most
+  // `max_pause` microseconds between mutator's execution (roughly,
+  // final pause may be longer). Zero disables incremental marking.
+  void SetMaxGCPause(uint32_t max_pause);
+
+  // New space GC is copying live objects using `threads` threads
+  // (one by default).
+  void SetGCThreads(uint32_t threads);
+
  protected:
 
   void SetError(Error* err);
@@ -64,6 +78,41 @@ class Isolate {
   friend class CWrapper;
 };
 
+struct HeapStatistics {
+  // Bytes allocated by the program (GC copies are not included)
+  uint64_t allocated;
+  // Bytes moved from new space to old space by GC
+  uint64_t promoted;
+
+  // Size of pages in each space
+  uint64_t new_space_size;
+  uint64_t old_space_size;
+  uint64_t large_space_size;
+
+  // Number of garbage collections
+  uint32_t new_space_gcs;
+  uint32_t old_space_gcs;
+
+  // Number of incremental marking steps
+  uint32_t incremental_steps;
+
+  // Total time spent in GC and the longest GC pause (in microseconds)
+  uint64_t gc_time;
+  uint64_t gc_longest_pause;
+};
+
+struct ICStatistics {
+  // Number of property access sites with inline cache in each state
+  uint32_t uninitialized;
+  uint32_t monomorphic;
+  uint32_t polymorphic;
+  uint32_t megamorphic;
+
+  // Accesses that were served by cached entries and ones that weren't
+  uint64_t hits;
+  uint64_t misses;
+};
+
 struct Error {
   const char* message;
   int line;
@@ -173,12 +222,23 @@ class Number : public Value {
 
 class String : public Value {
  public:
+  typedef void (*ReleaseCallback)(const char* value, uint32_t len);
+
   static String* New(const char* value);
   static String* New(const char* value, uint32_t len);
 
+  // Doesn't copy `value`, it should stay valid until `callback` is called
+  // (after string was garbage collected)
+  static String* NewExternal(const char* value,
+                             uint32_t len,
+                             ReleaseCallback callback);
+
   const char* Value();
   uint32_t Length();
 
+  // Bytes in [start, end) range (shares them with this string)
+  String* Slice(uint32_t start, uint32_t end);
+
   static const ValueType tag = kString;
 };
 
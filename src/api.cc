@@ -7,7 +7,7 @@
 
 #include <stdio.h> // fprintf
 #include <stdint.h> // uint32_t
-#include <string.h> // strlen
+#include <string.h> // strlen, memset
 #include <stdlib.h> // NULL
 
 namespace candor {
@@ -104,6 +104,57 @@ Array* Isolate::StackTrace() {
 }
 
 
+void Isolate::GetHeapStatistics(HeapStatistics* stats) {
+  Space* new_space = heap->new_space();
+  Space* old_space = heap->old_space();
+  Space* large_space = heap->large_space();
+  GC* gc = heap->gc();
+
+  stats->promoted = gc->promoted();
+  stats->allocated = new_space->allocated() +
+                     old_space->allocated() +
+                     large_space->allocated() -
+                     stats->promoted;
+  stats->new_space_size = new_space->size();
+  stats->old_space_size = old_space->size();
+  stats->large_space_size = large_space->size();
+  stats->new_space_gcs = gc->new_space_runs();
+  stats->old_space_gcs = gc->old_space_runs();
+  stats->incremental_steps = gc->incremental_steps();
+  stats->gc_time = gc->time();
+  stats->gc_longest_pause = gc->longest_pause();
+}
+
+
+void Isolate::GetICStatistics(ICStatistics* stats) {
+  memset(stats, 0, sizeof(*stats));
+
+  PropertyICList::Item* item = heap->ics()->head();
+  for (; item != NULL; item = item->next()) {
+    PropertyIC* ic = item->value();
+
+    switch (ic->state()) {
+     case PropertyIC::kUninitialized: stats->uninitialized++; break;
+     case PropertyIC::kMonomorphic: stats->monomorphic++; break;
+     case PropertyIC::kPolymorphic: stats->polymorphic++; break;
+     case PropertyIC::kMegamorphic: stats->megamorphic++; break;
+    }
+    stats->hits += ic->hits();
+    stats->misses += ic->misses();
+  }
+}
+
+
+void Isolate::SetMaxGCPause(uint32_t max_pause) {
+  heap->gc()->max_pause(max_pause);
+}
+
+
+void Isolate::SetGCThreads(uint32_t threads) {
+  heap->gc()->scavenge_threads(threads);
+}
+
+
 template <class T>
 Handle<T>::Handle() : value(NULL), ref_count(0), ref(NULL) {
   Ref();
@@ -400,6 +451,14 @@ String* String::New(const char* value) {
 }
 
 
+String* String::NewExternal(const char* value,
+                            uint32_t len,
+                            ReleaseCallback callback) {
+  return Cast<String>(HString::NewExternal(
+        ISOLATE->heap, value, len, callback));
+}
+
+
 const char* String::Value() {
   return HString::Value(ISOLATE->heap, addr());
 }
@@ -410,6 +469,16 @@ uint32_t String::Length() {
 }
 
 
+String* String::Slice(uint32_t start, uint32_t end) {
+  uint32_t length = Length();
+  if (end > length) end = length;
+  if (start > end) start = end;
+
+  return Cast<String>(HString::NewSlice(
+        ISOLATE->heap, addr(), start, end - start));
+}
+
+
 Object* Object::New() {
   return Cast<Object>(HObject::NewEmpty(ISOLATE->heap));
 }
@@ -421,6 +490,7 @@ void Object::Set(Value* key, Value* value) {
                                         key->addr(),
                                         1);
   *slot = value->addr();
+  ISOLATE->heap->RecordWrite(HObject::Map(addr()), slot);
 }
 
 
@@ -438,17 +508,24 @@ void Object::Delete(Value* key) {
 
 
 void Object::Set(const char* key, Value* value) {
-  return Set(String::New(key), value);
+  // Keys from C++ share interned strings with property names in the code
+  String* str = Cast<String>(
+      HString::NewInterned(ISOLATE->heap, key, strlen(key)));
+  return Set(str, value);
 }
 
 
 Value* Object::Get(const char* key) {
-  return Get(String::New(key));
+  String* str = Cast<String>(
+      HString::NewInterned(ISOLATE->heap, key, strlen(key)));
+  return Get(str);
 }
 
 
 void Object::Delete(const char* key) {
-  return Delete(String::New(key));
+  String* str = Cast<String>(
+      HString::NewInterned(ISOLATE->heap, key, strlen(key)));
+  return Delete(str);
 }
 
 
@@ -474,6 +551,7 @@ void Array::Set(int64_t key, Value* value) {
                                         HNumber::ToPointer(key),
                                         1);
   *slot = value->addr();
+  ISOLATE->heap->RecordWrite(HObject::Map(addr()), slot);
 }
 
 
@@ -0,0 +1,251 @@
+#include "candor.h"
+#include "utils.h" // GetTimeUs
+
+#include <stdio.h> // fprintf
+#include <stdlib.h> // abort, atoi
+#include <unistd.h> // open, lseek
+#include <fcntl.h> // O_RDONLY, ...
+#include <sys/types.h> // off_t
+#include <string.h> // memcpy, strcmp
+
+//
+// Benchmark runner:
+//
+//   bench [-n runs] [-p max_pause] [-t threads] script.can [script.can ...]
+//
+// Runs every script `runs` times, each time in a fresh isolate, and prints
+// results to stdout as JSON (all times are in milliseconds).
+// `max_pause` is a pause target of incremental marking in microseconds
+// (0 disables it), `threads` is a number of new space GC threads.
+//
+
+using candor::internal::GetTimeUs;
+
+const char* ReadContents(const char* filename, off_t* size) {
+  int fd = open(filename, O_RDONLY, S_IRUSR | S_IRGRP);
+  if (fd == -1) {
+    fprintf(stderr, "bench: failed to open file %s\n", filename);
+    exit(1);
+  }
+
+  off_t s = lseek(fd, 0, SEEK_END);
+  if (s == -1) {
+    fprintf(stderr, "bench: failed to get filesize of %s\n", filename);
+    exit(1);
+  }
+
+  char* contents = new char[s];
+  if (pread(fd, contents, s, 0) != s) {
+    fprintf(stderr, "bench: failed to get contents of %s\n", filename);
+    delete[] contents;
+    exit(1);
+  }
+
+  close(fd);
+
+  *size = s;
+  return contents;
+}
+
+
+candor::Value* APIAssert(uint32_t argc, candor::Value* argv[]) {
+  if (argc < 1) {
+    fprintf(stderr, "assert(): at least one argument is required\n");
+    abort();
+  }
+
+  if (argv[0]->ToBoolean()->IsFalse()) {
+    fprintf(stderr, "assert(): assertion failed\n");
+    abort();
+  }
+
+  return candor::Boolean::True();
+}
+
+
+candor::Value* APIPrint(uint32_t argc, candor::Value* argv[]) {
+  // Keep stdout clean for the results
+  for (uint32_t i = 0; i < argc; i++) {
+    candor::String* value = argv[i]->ToString();
+    fprintf(stderr,
+            i != (argc - 1) ? "%.*s " : "%.*s\n",
+            static_cast<int>(value->Length()),
+            value->Value());
+  }
+
+  return candor::Nil::New();
+}
+
+
+candor::Value* APIToString(uint32_t argc, candor::Value* argv[]) {
+  if (argc < 1) return candor::Nil::New();
+
+  argv[0]->ToString()->Value();
+
+  return candor::Nil::New();
+}
+
+
+candor::Object* CreateGlobal() {
+  candor::Object* obj = candor::Object::New();
+
+  obj->Set("assert", candor::Function::New(APIAssert));
+  obj->Set("print", candor::Function::New(APIPrint));
+  obj->Set("getValue", candor::Function::New(APIToString));
+
+  return obj;
+}
+
+
+// Accumulates min/mean/max of the samples
+class Sample {
+ public:
+  Sample() : min_(0), max_(0), total_(0), count_(0) {
+  }
+
+  void Add(double value) {
+    if (count_ == 0 || value < min_) min_ = value;
+    if (count_ == 0 || value > max_) max_ = value;
+    total_ += value;
+    count_++;
+  }
+
+  void Print(const char* name, bool last) {
+    fprintf(stdout,
+            "      \"%s\": "
+            "{ \"min\": %.3f, \"mean\": %.3f, \"max\": %.3f }%s\n",
+            name,
+            min_,
+            count_ == 0 ? 0 : total_ / count_,
+            max_,
+            last ? "" : ",");
+  }
+
+ private:
+  double min_;
+  double max_;
+  double total_;
+  uint32_t count_;
+};
+
+
+void RunBenchmark(const char* filename,
+                  int runs,
+                  int max_pause,
+                  int threads,
+                  bool last) {
+  off_t size = 0;
+  const char* script = ReadContents(filename, &size);
+
+  Sample wall;
+  Sample compile;
+  Sample execute;
+  Sample allocated;
+  Sample promoted;
+  Sample new_space_gcs;
+  Sample old_space_gcs;
+  Sample incremental_steps;
+  Sample gc_time;
+  Sample gc_longest_pause;
+  Sample ic_hits;
+  Sample ic_misses;
+
+  for (int i = 0; i < runs; i++) {
+    candor::Isolate* isolate = new candor::Isolate();
+    if (max_pause >= 0) isolate->SetMaxGCPause(max_pause);
+    if (threads > 0) isolate->SetGCThreads(threads);
+    uint64_t start = GetTimeUs();
+
+    candor::Function* code = candor::Function::New(filename, script, size);
+    if (isolate->HasError()) {
+      isolate->PrintError();
+      exit(1);
+    }
+    uint64_t compiled = GetTimeUs();
+
+    code->SetContext(CreateGlobal());
+
+    candor::Value* args[1];
+    code->Call(0, args);
+    uint64_t executed = GetTimeUs();
+
+    candor::HeapStatistics stats;
+    isolate->GetHeapStatistics(&stats);
+
+    candor::ICStatistics ic_stats;
+    isolate->GetICStatistics(&ic_stats);
+
+    delete isolate;
+
+    wall.Add((executed - start) / 1000.0);
+    compile.Add((compiled - start) / 1000.0);
+    execute.Add((executed - compiled) / 1000.0);
+    allocated.Add(stats.allocated);
+    promoted.Add(stats.promoted);
+    new_space_gcs.Add(stats.new_space_gcs);
+    old_space_gcs.Add(stats.old_space_gcs);
+    incremental_steps.Add(stats.incremental_steps);
+    gc_time.Add(stats.gc_time / 1000.0);
+    gc_longest_pause.Add(stats.gc_longest_pause / 1000.0);
+    ic_hits.Add(ic_stats.hits);
+    ic_misses.Add(ic_stats.misses);
+  }
+
+  delete[] script;
+
+  fprintf(stdout, "    {\n");
+  fprintf(stdout, "      \"name\": \"%s\",\n", filename);
+  wall.Print("wall", false);
+  compile.Print("compile", false);
+  execute.Print("execute", false);
+  allocated.Print("allocated_bytes", false);
+  promoted.Print("promoted_bytes", false);
+  new_space_gcs.Print("new_space_gcs", false);
+  old_space_gcs.Print("old_space_gcs", false);
+  incremental_steps.Print("incremental_steps", false);
+  gc_time.Print("gc_time", false);
+  gc_longest_pause.Print("gc_longest_pause", false);
+  ic_hits.Print("ic_hits", false);
+  ic_misses.Print("ic_misses", true);
+  fprintf(stdout, "    }%s\n", last ? "" : ",");
+  fflush(stdout);
+}
+
+
+int main(int argc, char** argv) {
+  int runs = 5;
+  int max_pause = -1;
+  int threads = 0;
+  int first = 1;
+
+  while (first + 1 < argc) {
+    if (strcmp(argv[first], "-n") == 0) {
+      runs = atoi(argv[first + 1]);
+    } else if (strcmp(argv[first], "-p") == 0) {
+      max_pause = atoi(argv[first + 1]);
+    } else if (strcmp(argv[first], "-t") == 0) {
+      threads = atoi(argv[first + 1]);
+    } else {
+      break;
+    }
+    first += 2;
+  }
+
+  if (first >= argc || runs <= 0) {
+    fprintf(stderr,
+            "Usage: %s [-n runs] [-p max_pause] [-t threads] script.can ...\n",
+            argv[0]);
+    return 1;
+  }
+
+  fprintf(stdout, "{\n");
+  fprintf(stdout, "  \"runs\": %d,\n", runs);
+  fprintf(stdout, "  \"benchmarks\": [\n");
+  for (int i = first; i < argc; i++) {
+    RunBenchmark(argv[i], runs, max_pause, threads, i == argc - 1);
+  }
+  fprintf(stdout, "  ]\n");
+  fprintf(stdout, "}\n");
+
+  return 0;
+}
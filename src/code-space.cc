@@ -28,6 +28,7 @@ CodeSpace::CodeSpace(Heap* heap) : heap_(heap) {
 
 CodeSpace::~CodeSpace() {
   delete stubs_;
+  while (pages_.length() != 0) delete pages_.Shift();
 }
 
 
@@ -94,6 +95,7 @@ char* CodeSpace::Compile(const char* filename,
 
   // Generate low-level representation
   Masm masm(this);
+  masm.stack_map(heap()->stack_map());
 
   // For each root in reverse order generate lir
   // (Generate children first, parents later)
@@ -109,8 +111,9 @@ char* CodeSpace::Compile(const char* filename,
   // Put code into code space
   char* addr = Put(&masm);
 
-  // Relocate source map
+  // Relocate source and stack maps
   heap()->source_map()->Commit(filename, source, length, addr);
+  heap()->stack_map()->Commit(addr);
 
   return addr;
 }
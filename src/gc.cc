@@ -1,11 +1,15 @@
 #include "gc.h"
 #include "heap.h"
 #include "heap-inl.h"
+#include "ic.h" // PropertyIC, GlobalCell
+#include "stack-map.h" // StackMap
 
 #include <stdlib.h> // NULL
 #include <stdint.h> // int32_t and others
 #include <unistd.h> // intptr_t
 #include <assert.h> // assert
+#include <string.h> // memcpy
+#include <pthread.h> // pthread_create, pthread_join
 
 namespace candor {
 namespace internal {
@@ -19,8 +23,11 @@ void GC::GCValue::Relocate(char* address) {
 
 
 void GC::CollectGarbage(char* stack_top) {
-  assert(grey_items()->length() == 0);
-  assert(black_items()->length() == 0);
+  assert(grey_items()->IsEmpty());
+  assert(black_items()->IsEmpty());
+
+  uint64_t start = GetTimeUs();
+  uint64_t old_allocated = heap()->old_space()->allocated();
 
   // __$gc() isn't setting needs_gc() attribute
   if (heap()->needs_gc() == Heap::kGCNone) {
@@ -35,39 +42,121 @@ void GC::CollectGarbage(char* stack_top) {
     break;
   }
 
+  // Old space should be swept before it is marked or evacuated again
+  if (gc_type() == kOldSpace) heap()->old_space()->FinishSweeping();
+
+  // Conservative stack slots and remembered slots are looked up in the
+  // snapshot of page index, which doesn't need locking
+  heap()->sweeper()->Freeze();
+
   // Select space to GC
   Space* space = gc_type() == kNewSpace ?
       heap()->new_space()
       :
       heap()->old_space();
 
-  // Temporary space which will contain copies of all visited objects
-  tmp_space(new Space(heap(), space->page_size()));
+  // Old space is marked and swept in place, unless it's too fragmented.
+  // In that case (and for new space) all live objects are copied into
+  // the temporary space.
+  in_place_ = gc_type() == kOldSpace && !needs_compaction_;
+
+  // Incremental marking is always done in place
+  assert(!is_marking() || gc_type() == kNewSpace || in_place());
+
+  if (!in_place()) tmp_space(new Space(heap(), space->page_size()));
+
+  // Incremental marking barrier isn't thread-safe
+  if (gc_type() == kNewSpace && scavenge_threads() > 1 && !is_marking()) {
+    scavenge_ = new ScavengeState(this, scavenge_threads());
+  }
+
+  // Marking starts here, so scavenger could grey all old space objects
+  // reachable from roots and new space
+  if (gc_type() == kNewSpace && marking_requested_ && !is_marking()) {
+    StartIncrementalMarking();
+  }
+
+  // Store buffer is refilled during GC with slots of old space objects
+  // that are still pointing to the new space.
+  // NOTE: Old space GC refills it from scratch by visiting all live objects,
+  // except ones that were marked by incremental marking
+  uint32_t remembered_length;
+  char*** remembered = TakeRememberedSet(&remembered_length);
 
   // Add referenced in C++ land values to the grey list
   ColourPersistentHandles();
 
+  if (gc_type() == kNewSpace) {
+    // Old space objects referencing new space
+    ColourRememberedSet(remembered, remembered_length);
+
+    // Writes into young large objects aren't recorded
+    ColourYoungLargeObjects();
+  }
+
   // Colour on-stack registers
   ColourFrames(stack_top);
 
+  // Roots were only collected, copy everything reachable from them
+  if (is_parallel()) Scavenge();
+
+  if (gc_type() == kOldSpace && is_marking()) {
+    FinishIncrementalMarking(remembered, remembered_length);
+  }
+  delete[] remembered;
+
   // Reset marks for items from external space
-  while (black_items()->length() != 0) {
-    GCValue* value = black_items()->Shift();
-    assert(value->value()->IsSoftGCMarked());
-    value->value()->ResetSoftGCMark();
+  while (!black_items()->IsEmpty()) {
+    HValue* value = black_items()->Pop();
+    assert(value->IsSoftGCMarked());
+    value->ResetSoftGCMark();
   }
 
   RelocateWeakHandles();
 
   // Visit all weak references and call callbacks if some of them are dead
   HandleWeakReferences();
+  if (gc_type() == kOldSpace) HandleStringTable();
 
-  space->Swap(tmp_space());
-  delete tmp_space();
+  // Cached global objects and maps might have been moved or collected
+  HandleGlobalCells();
+  HandleNumberStringCache();
+  if (gc_type() == kOldSpace && !in_place()) RelocateICs();
+
+  // Large objects are never moved, release dead ones
+  if (gc_type() == kOldSpace) heap()->large_space()->Sweep();
+
+  if (in_place()) {
+    // Sweeping is finished in background (see Space::FinishSweeping())
+    space->Sweep();
+  } else {
+    space->Swap(tmp_space());
+    delete tmp_space();
+
+    if (gc_type() == kOldSpace) needs_compaction_ = false;
+  }
+
+  if (gc_type() == kNewSpace) {
+    new_space_runs_++;
+    promoted_ += heap()->old_space()->allocated() - old_allocated;
+  } else {
+    old_space_runs_++;
+    marking_ = 0;
+    marking_requested_ = false;
+  }
+
+  heap()->sweeper()->Unfreeze();
+
+  uint64_t pause = GetTimeUs() - start;
+  time_ += pause;
+  if (pause > longest_pause_) longest_pause_ = pause;
 
   if (gc_type() != kNewSpace || heap()->needs_gc() == Heap::kGCNewSpace) {
     // Reset GC flag
     heap()->needs_gc(Heap::kGCNone);
+
+    // Scavenge is a part of allocation slow path too
+    if (gc_type() == kNewSpace) IncrementalMarkingStep();
   } else {
     // Or call gc for old_space space
     CollectGarbage(stack_top);
@@ -80,8 +169,12 @@ void GC::ColourPersistentHandles() {
   while (item != NULL) {
     HValueReference* ref = item->value();
     if (ref->is_persistent()) {
-      push_grey(ref->value(), reinterpret_cast<char**>(ref->reference()));
-      push_grey(ref->value(), reinterpret_cast<char**>(ref->valueptr()));
+      push_grey(ref->value(),
+                reinterpret_cast<char**>(ref->reference()),
+                false);
+      push_grey(ref->value(),
+                reinterpret_cast<char**>(ref->valueptr()),
+                false);
       ProcessGrey();
     }
 
@@ -90,33 +183,197 @@ void GC::ColourPersistentHandles() {
 }
 
 
+void GC::ColourRememberedSet(char*** slots, uint32_t length) {
+  for (uint32_t i = 0; i < length; i++) {
+    push_grey(HValue::Cast(*slots[i]), slots[i], true);
+    ProcessGrey();
+  }
+}
+
+
+void GC::ColourYoungLargeObjects() {
+  List<Space::Page*, EmptyClass>* pages = heap()->large_space()->young_pages();
+
+  while (pages->length() != 0) {
+    HValue* value = HValue::Cast(LargeSpace::Object(pages->Shift()));
+
+    // Slots referencing new space will be remembered
+    value->SetGeneration(Heap::kMinOldSpaceGeneration);
+    VisitValue(value);
+    ProcessGrey();
+  }
+}
+
+
+char*** GC::TakeRememberedSet(uint32_t* length) {
+  StoreBuffer* buffer = heap()->store_buffer();
+
+  // Every slot should be relocated only once
+  buffer->Compact();
+
+  *length = buffer->length();
+  char*** slots = new char**[*length];
+  memcpy(slots, buffer->start(), *length * sizeof(*slots));
+  buffer->Clear();
+
+  return slots;
+}
+
+
+void GC::RequestIncrementalMarking() {
+  marking_requested_ = true;
+}
+
+
+void GC::StartIncrementalMarking() {
+  assert(marking_stack_.IsEmpty());
+
+  heap()->old_space()->FinishSweeping();
+  marking_ = 1;
+}
+
+
+void GC::IncrementalMarkingStep() {
+  if (!is_marking()) return;
+
+  uint64_t start = GetTimeUs();
+  uint64_t deadline = start + max_pause_;
+  uint32_t count = 0;
+
+  while (!marking_stack_.IsEmpty()) {
+    // Visit children of grey object, new space ones will be visited
+    // by the final pause
+    VisitValue(marking_stack_.Pop());
+
+    while (!grey_items()->IsEmpty()) {
+      HValue* value = grey_items()->Pop().value();
+      if (value == HValue::Cast(HNil::New()) ||
+          value == HValue::Cast(HMap::Tombstone()) ||
+          HValue::IsUnboxed(value->addr())) {
+        continue;
+      }
+
+      // New space values are skipped
+      MarkingBarrier(value);
+    }
+
+    // Checking time is expensive, do it once in a while
+    if ((++count & (kStepCheckInterval - 1)) == 0 &&
+        GetTimeUs() >= deadline) {
+      break;
+    }
+  }
+
+  // Everything is marked - finish GC at the next safe point
+  if (marking_stack_.IsEmpty()) heap()->needs_gc(Heap::kGCOldSpace);
+
+  incremental_steps_++;
+  uint64_t pause = GetTimeUs() - start;
+  time_ += pause;
+  if (pause > longest_pause_) longest_pause_ = pause;
+}
+
+
+void GC::FinishIncrementalMarking(char*** slots, uint32_t length) {
+  // Visit objects that were greyed, but not scanned yet
+  while (!marking_stack_.IsEmpty()) {
+    VisitValue(marking_stack_.Pop());
+    ProcessGrey();
+  }
+
+  // Writes into young large objects aren't recorded, marked ones may have
+  // been written to after they were scanned
+  LargeSpace* large_space = heap()->large_space();
+  List<Space::Page*, EmptyClass>::Item* item;
+  for (item = large_space->young_pages()->head();
+       item != NULL;
+       item = item->next()) {
+    HValue* value = HValue::Cast(LargeSpace::Object(item->value()));
+    if (!large_space->IsMarked(value)) continue;
+
+    VisitValue(value);
+    ProcessGrey();
+  }
+
+  // Objects that were scanned by marking steps may reference new space
+  // objects (which may reference white objects), visit them.
+  // Each visit may mark more slot owners, so repeat until nothing changes
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (uint32_t i = 0; i < length; i++) {
+      if (slots[i] == NULL) continue;
+      if (!heap()->old_space()->IsMarkedSlot(slots[i]) &&
+          !large_space->IsMarkedSlot(slots[i])) {
+        continue;
+      }
+
+      push_grey(HValue::Cast(*slots[i]), slots[i], true);
+      ProcessGrey();
+
+      slots[i] = NULL;
+      changed = true;
+    }
+  }
+}
+
+
 void GC::RelocateWeakHandles() {
   HValueRefList::Item* item = heap()->references()->head();
   while (item != NULL) {
     HValueReference* ref = item->value();
+    HValueRefList::Item* next = item->next();
+
     if (ref->is_weak()) {
-      GCValue* v;
-      if (ref->value()->IsGCMarked()) {
-        v = new GCValue(ref->value(),
-                        reinterpret_cast<char**>(ref->reference()));
-        v->Relocate(v->value()->GetGCMark());
-        v = new GCValue(ref->value(),
-                        reinterpret_cast<char**>(ref->valueptr()));
-        v->Relocate(v->value()->GetGCMark());
+      if (heap()->large_space()->Contains(ref->value())) {
+        // Large objects aren't moving, they're dead only if old space GC
+        // hasn't marked them
+        if (gc_type() == kOldSpace &&
+            !heap()->large_space()->IsMarked(ref->value())) {
+          heap()->references()->Remove(item);
+        }
+      } else if (in_place()) {
+        // Objects aren't moving, just remove dead ones
+        if (IsInCurrentSpace(ref->value()) &&
+            !heap()->old_space()->IsMarked(ref->value())) {
+          heap()->references()->Remove(item);
+        }
+      } else if (ref->value()->IsGCMarked()) {
+        char* address = ref->value()->GetGCMark();
+        GCValue(ref->value(),
+                reinterpret_cast<char**>(ref->reference()),
+                false).Relocate(address);
+        GCValue(ref->value(),
+                reinterpret_cast<char**>(ref->valueptr()),
+                false).Relocate(address);
       } else {
         // Value was garbage collected - remove reference from the list
         heap()->references()->Remove(item);
       }
     }
 
-    item = item->next();
+    item = next;
   }
 }
 
 
 void GC::ColourFrames(char* stack_top) {
-  // Go through the frames
+  StackMap* map = heap()->stack_map();
   char** frame = reinterpret_cast<char**>(stack_top);
+
+  // Registers saved by CollectGarbageStub are right below its frame pointer,
+  // if it was called from generated code - safepoint tells which of them
+  // are holding tagged values
+  SafePoint* point = map->Get(*(frame + 1));
+  for (int i = 0; i < StackMap::kSavedRegisters; i++) {
+    if (point == NULL) {
+      ColourConservativeSlot(frame - i - 1);
+    } else if (point->IsTaggedRegister(i)) {
+      ColourSlot(frame - i - 1);
+    }
+  }
+
+  // Go through the frames
   while (frame != NULL) {
     // Skip C++ frames
     while (frame != NULL &&
@@ -126,94 +383,463 @@ void GC::ColourFrames(char* stack_top) {
     }
     if (frame == NULL) break;
 
-    char* value = *frame;
-    // Skip nil, non-pointer values and rbp pushes
-    if (value != HNil::New() && !HValue::IsUnboxed(value)) {
-      push_grey(HValue::Cast(value), frame);
-      ProcessGrey();
+    // Return address into generated code - visit caller's frame precisely
+    point = map->Get(*frame);
+    if (point != NULL) {
+      frame = ColourFrame(frame, point);
+      continue;
     }
 
+    // Stub frames are scanned conservatively
+    ColourConservativeSlot(frame);
     frame++;
   }
 }
 
 
+char** GC::ColourFrame(char** ret, SafePoint* point) {
+  // Callee's prologue has pushed caller's frame pointer below return address
+  char** fp = reinterpret_cast<char**>(*(ret - 1));
+  assert(fp > ret);
+
+  // Spill slots with live values
+  char** spills = fp - StackMap::kSpillStart;
+  for (uint32_t i = 0; i < point->slot_count(); i++) {
+    if (point->IsTaggedSlot(i)) ColourSlot(spills - i);
+  }
+
+  // Masm spills active at the call
+  char** masm_spills = spills - point->slot_count();
+  for (uint32_t i = 0; i < point->masm_slot_count(); i++) {
+    if (point->IsTaggedMasmSlot(i)) ColourSlot(masm_spills - i);
+  }
+
+  // Pushed temporaries and outgoing arguments, stale masm spills and padding
+  // above them are skipped
+  char** end = fp - point->frame_size();
+  assert(point->frame_size() != 0 && ret < end);
+  for (char** slot = ret + 1; slot < end; slot++) {
+    ColourConservativeSlot(slot);
+  }
+
+  // Continue with caller's caller
+  return fp;
+}
+
+
+void GC::HandleStringTable() {
+  StringTable* table = heap()->string_table();
+
+  // Interned strings are allocated in old space (or large space if they're
+  // big), so only old space GC could collect or move them
+  for (uint32_t i = 0; i < table->size(); i++) {
+    if (table->IsEmpty(i)) continue;
+
+    char** slot = table->GetSlotAddress(i);
+    HValue* value = HValue::Cast(*slot);
+    if (heap()->large_space()->Contains(value)) {
+      if (!heap()->large_space()->IsMarked(value)) table->Remove(i);
+    } else if (in_place()) {
+      if (!heap()->old_space()->IsMarked(value)) table->Remove(i);
+    } else if (value->IsGCMarked()) {
+      *slot = value->GetGCMark();
+    } else {
+      table->Remove(i);
+    }
+  }
+}
+
+
+HValue* GC::WeakValue(HValue* value) {
+  if (heap()->large_space()->Contains(value)) {
+    // Large objects aren't moving, they're dead only if old space GC
+    // hasn't marked them
+    if (gc_type() == kOldSpace && !heap()->large_space()->IsMarked(value)) {
+      return NULL;
+    }
+  } else if (in_place()) {
+    // Objects aren't moving, only dead ones should be handled
+    if (IsInCurrentSpace(value) && !heap()->old_space()->IsMarked(value)) {
+      return NULL;
+    }
+  } else if (value->IsGCMarked()) {
+    // Value wasn't GCed, but was moved
+    return HValue::Cast(value->GetGCMark());
+  } else if (IsInCurrentSpace(value)) {
+    // Value is in GC space and wasn't marked
+    return NULL;
+  }
+
+  return value;
+}
+
+
+void GC::RelocateICs() {
+  PropertyICList::Item* item = heap()->ics()->head();
+  for (; item != NULL; item = item->next()) {
+    PropertyIC* ic = item->value();
+    for (int i = 0; i < ic->entry_count(); i++) {
+      char** slots[] = { ic->shape_slot(i), ic->transition_slot(i) };
+      for (int j = 0; j < 2; j++) {
+        if (*slots[j] == NULL) continue;
+
+        // Shapes are never collected
+        HValue* shape = WeakValue(HValue::Cast(*slots[j]));
+        assert(shape != NULL);
+        *slots[j] = shape->addr();
+      }
+    }
+  }
+}
+
+
+void GC::HandleNumberStringCache() {
+  for (uint32_t i = 0; i < Heap::kNumberStringCacheSize; i++) {
+    char** slot = heap()->number_string_slot(i);
+    if (*slot == NULL) continue;
+
+    HValue* value = WeakValue(HValue::Cast(*slot));
+    *slot = value == NULL ? NULL : value->addr();
+  }
+}
+
+
 void GC::HandleWeakReferences() {
   HValueWeakRefList::Item* item = heap()->weak_references()->head();
   while (item != NULL) {
     HValueWeakRef* ref = item->value();
-    if (!ref->value()->IsGCMarked()) {
-      if (IsInCurrentSpace(ref->value())) {
-        // Value is in GC space and wasn't marked
-        // call callback as it was GCed
-        ref->callback()(ref->value());
-        HValueWeakRefList::Item* current = item;
-        item = item->next();
-        heap()->weak_references()->Remove(current);
-        continue;
-      }
-    } else {
-      // Value wasn't GCed, but was moved
-      ref->value(reinterpret_cast<HValue*>(ref->value()->GetGCMark()));
+    HValue* value = WeakValue(ref->value());
+    if (value == NULL) {
+      // Call callback as value was GCed
+      ref->callback()(ref->value());
+      HValueWeakRefList::Item* current = item;
+      item = item->next();
+      heap()->weak_references()->Remove(current);
+      continue;
     }
 
+    ref->value(value);
     item = item->next();
   }
 }
 
 
+void GC::HandleGlobalCells() {
+  GlobalCellList::Item* item = heap()->global_cells()->head();
+  for (; item != NULL; item = item->next()) {
+    GlobalCell* cell = item->value();
+    if (cell->object() == NULL) continue;
+
+    HValue* object = WeakValue(HValue::Cast(cell->object()));
+    HValue* map = WeakValue(HValue::Cast(cell->map()));
+
+    // Address of dead object or map might be taken by a new one
+    if (object == NULL || map == NULL) {
+      cell->Reset();
+    } else {
+      cell->Update(object->addr(), map->addr(), cell->offset());
+    }
+  }
+}
+
+
 void GC::ProcessGrey() {
-  while (grey_items()->length() != 0) {
-    GCValue* value = grey_items()->Shift();
+  // Roots are processed by Scavenge()
+  if (is_parallel()) return;
+
+  while (!grey_items()->IsEmpty()) {
+    GCValue value = grey_items()->Pop();
+    HValue* hvalue = value.value();
 
-    // Skip unboxed address
-    if (value->value() == HValue::Cast(HNil::New()) ||
-        HValue::IsUnboxed(value->value()->addr())) {
+    // Skip unboxed address and deleted key (slot might be remembered)
+    if (hvalue == HValue::Cast(HNil::New()) ||
+        hvalue == HValue::Cast(HMap::Tombstone()) ||
+        HValue::IsUnboxed(hvalue->addr())) {
       continue;
     }
 
-    if (!value->value()->IsGCMarked()) {
-      // Object is in not in current space, don't move it
-      if (!IsInCurrentSpace(value->value())) {
-        if (!value->value()->IsSoftGCMarked()) {
-          // Set soft mark and add item to black list to reset mark later
-          value->value()->SetSoftGCMark();
-          black_items()->Push(value);
-
-          GC::VisitValue(value->value());
-        }
-        continue;
+    if (hvalue->IsGCMarked()) {
+      // Object was already moved
+      hvalue = HValue::Cast(hvalue->GetGCMark());
+      value.Relocate(hvalue->addr());
+    } else if (!IsInCurrentSpace(hvalue)) {
+      // New space GC reaches old space objects only through store buffer,
+      // old space GC should visit all live new space objects and mark
+      // large ones
+      if (gc_type() == kNewSpace) {
+        if (is_marking()) MarkingBarrier(hvalue);
+      } else if (heap()->large_space()->Contains(hvalue)) {
+        if (heap()->large_space()->Mark(hvalue)) GC::VisitValue(hvalue);
+      } else if (!hvalue->IsSoftGCMarked()) {
+        // Set soft mark and add item to black list to reset mark later
+        hvalue->SetSoftGCMark();
+        black_items()->Push(hvalue);
+
+        GC::VisitValue(hvalue);
       }
-      assert(!value->value()->IsSoftGCMarked());
-
-      HValue* hvalue;
+    } else if (in_place()) {
+      // Mark object and visit it's children only once
+      if (heap()->old_space()->Mark(hvalue)) {
+        GC::VisitValue(hvalue);
+      }
+    } else {
+      assert(!hvalue->IsSoftGCMarked());
 
       if (gc_type() == kNewSpace) {
         // New space GC
-        hvalue = value->value()->CopyTo(heap()->old_space(), tmp_space());
+        hvalue = hvalue->CopyTo(heap()->old_space(), tmp_space());
+
+        // Promoted objects may be referenced only by black ones
+        if (is_marking() &&
+            hvalue->Generation() >= Heap::kMinOldSpaceGeneration) {
+          MarkingBarrier(hvalue);
+        }
       } else {
         // Old space GC
-        hvalue = value->value()->CopyTo(tmp_space(), heap()->new_space());
+        hvalue = hvalue->CopyTo(tmp_space(), heap()->new_space());
       }
 
-      value->Relocate(hvalue->addr());
+      value.Relocate(hvalue->addr());
       GC::VisitValue(hvalue);
-    } else {
-      value->Relocate(value->value()->GetGCMark());
+    }
+
+    // Old space object is referencing new space object
+    if (value.remember() && IsYoung(hvalue)) {
+      heap()->store_buffer()->Record(value.slot());
     }
   }
 }
 
 
+GC::ScavengeState::ScavengeState(GC* gc, uint32_t threads) : gc(gc),
+                                                              threads(threads),
+                                                              idle(0) {
+  workers = new GC*[threads];
+  for (uint32_t i = 0; i < threads; i++) {
+    workers[i] = new GC(gc->heap());
+    workers[i]->gc_type(kNewSpace);
+    workers[i]->tmp_space(gc->tmp_space());
+    workers[i]->scavenge_ = this;
+  }
+
+  pthread_mutex_init(&lock, NULL);
+  pthread_cond_init(&cond, NULL);
+}
+
+
+GC::ScavengeState::~ScavengeState() {
+  for (uint32_t i = 0; i < threads; i++) delete workers[i];
+  delete[] workers;
+
+  pthread_mutex_destroy(&lock);
+  pthread_cond_destroy(&cond);
+}
+
+
+void GC::Scavenge() {
+  ScavengeState* state = scavenge_;
+
+  // Split roots between workers
+  uint32_t i = 0;
+  while (!grey_items()->IsEmpty()) {
+    state->workers[i]->grey_items()->Push(grey_items()->Pop());
+    i = (i + 1) % state->threads;
+  }
+
+  // Current thread is a worker too
+  pthread_t* threads = new pthread_t[state->threads];
+  for (i = 1; i < state->threads; i++) {
+    if (pthread_create(&threads[i], NULL, ScavengeThread, state->workers[i])) {
+      abort();
+    }
+  }
+  ScavengeThread(state->workers[0]);
+  for (i = 1; i < state->threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  delete[] threads;
+
+  for (i = 0; i < state->threads; i++) {
+    GC* worker = state->workers[i];
+    assert(worker->grey_items()->IsEmpty());
+
+    worker->ReleaseLocal(&worker->new_buffer_, tmp_space());
+    worker->ReleaseLocal(&worker->old_buffer_, heap()->old_space());
+
+    // Old space objects referencing new space
+    while (!worker->remembered_.IsEmpty()) {
+      heap()->store_buffer()->Record(worker->remembered_.Pop());
+    }
+  }
+
+  delete state;
+  scavenge_ = NULL;
+}
+
+
+void* GC::ScavengeThread(void* worker) {
+  reinterpret_cast<GC*>(worker)->ProcessGreyParallel();
+  return NULL;
+}
+
+
+void GC::ProcessGreyParallel() {
+  do {
+    while (!grey_items()->IsEmpty()) {
+      if (grey_items()->length() > kShareThreshold) ShareGrey();
+
+      GCValue value = grey_items()->Pop();
+      HValue* hvalue = value.value();
+
+      // Skip unboxed address and deleted key
+      if (hvalue == HValue::Cast(HNil::New()) ||
+          hvalue == HValue::Cast(HMap::Tombstone()) ||
+          HValue::IsUnboxed(hvalue->addr())) {
+        continue;
+      }
+
+      // Old space objects are reached only through remembered set
+      if (IsInCurrentSpace(hvalue)) {
+        hvalue = HValue::Cast(Evacuate(hvalue));
+        if (value.slot() != NULL) *value.slot() = hvalue->addr();
+      }
+
+      // Old space object is referencing new space object
+      if (value.remember() && IsYoung(hvalue)) {
+        remembered_.Push(value.slot());
+      }
+    }
+  } while (TakeGrey());
+}
+
+
+void GC::ShareGrey() {
+  ScavengeState* state = scavenge_;
+
+  // Nobody is waiting for work
+  if (__atomic_load_n(&state->idle, __ATOMIC_RELAXED) == 0) return;
+
+  pthread_mutex_lock(&state->lock);
+  if (state->pool.IsEmpty()) {
+    grey_items()->MoveTo(&state->pool, grey_items()->length() >> 1);
+    pthread_cond_broadcast(&state->cond);
+  }
+  pthread_mutex_unlock(&state->lock);
+}
+
+
+bool GC::TakeGrey() {
+  ScavengeState* state = scavenge_;
+  bool found = false;
+
+  pthread_mutex_lock(&state->lock);
+  // Read by ShareGrey() without lock
+  __atomic_add_fetch(&state->idle, 1, __ATOMIC_RELAXED);
+
+  // Work is over when every worker is idle
+  while (state->pool.IsEmpty() && state->idle < state->threads) {
+    pthread_cond_wait(&state->cond, &state->lock);
+  }
+
+  if (!state->pool.IsEmpty()) {
+    __atomic_sub_fetch(&state->idle, 1, __ATOMIC_RELAXED);
+    state->pool.MoveTo(grey_items(), (state->pool.length() + 1) >> 1);
+    found = true;
+  } else {
+    pthread_cond_broadcast(&state->cond);
+  }
+  pthread_mutex_unlock(&state->lock);
+
+  return found;
+}
+
+
+char* GC::Evacuate(HValue* value) {
+  // Object was already copied by this or other worker
+  if (!value->ClaimGCMark()) return value->GetGCMark();
+
+  // Tiny slices are copied out of their parent
+  bool detach = HString::IsDetachable(value->addr());
+  uint32_t size = detach ? HString::DetachedSize(value->addr()) : value->Size();
+  char* result;
+  if (value->Generation() + 1 >= Heap::kMinOldSpaceGeneration) {
+    result = AllocateLocal(&old_buffer_, heap()->old_space(), size);
+  } else {
+    result = AllocateLocal(&new_buffer_, tmp_space(), size);
+  }
+
+  if (detach) {
+    HString::Detach(value->addr(), result);
+  } else {
+    memcpy(result + HValue::interior_offset(0),
+           value->addr() + HValue::interior_offset(0),
+           size);
+  }
+
+  HValue* copy = HValue::Cast(result);
+  copy->IncrementGeneration();
+  value->PublishGCMark(result);
+
+  GC::VisitValue(copy);
+
+  return result;
+}
+
+
+char* GC::AllocateLocal(LocalBuffer* buffer, Space* space, uint32_t bytes) {
+  uint32_t aligned_bytes = RoundUp(bytes, HValue::kPointerSize);
+
+  if (buffer->top == NULL || buffer->top + aligned_bytes > buffer->limit) {
+    pthread_mutex_lock(&scavenge_->lock);
+
+    // Large objects are allocated directly in space
+    if (aligned_bytes > kLocalBufferSize >> 2) {
+      char* result = space->Allocate(aligned_bytes);
+      pthread_mutex_unlock(&scavenge_->lock);
+      return result;
+    }
+
+    ReleaseLocal(buffer, space);
+    buffer->top = space->Allocate(kLocalBufferSize);
+    buffer->limit = buffer->top + kLocalBufferSize;
+    pthread_mutex_unlock(&scavenge_->lock);
+  }
+
+  char* result = buffer->top;
+  buffer->top += aligned_bytes;
+
+  return result;
+}
+
+
+void GC::ReleaseLocal(LocalBuffer* buffer, Space* space) {
+  // Unused tail should be walkable by old space sweeper
+  if (buffer->top != NULL && buffer->top < buffer->limit) {
+    space->AddFreeChunk(buffer->top, buffer->limit - buffer->top);
+  }
+
+  buffer->top = NULL;
+  buffer->limit = NULL;
+}
+
+
 bool GC::IsInCurrentSpace(HValue* value) {
-  return (gc_type() == kOldSpace &&
-         value->Generation() >= Heap::kMinOldSpaceGeneration) ||
-         (gc_type() == kNewSpace &&
-         value->Generation() < Heap::kMinOldSpaceGeneration);
+  if (gc_type() == kNewSpace) return heap()->new_space()->Contains(value);
+
+  return heap()->old_space()->Contains(value);
+}
+
+
+bool GC::IsYoung(HValue* value) {
+  // Young large objects have zero generation, but they aren't moving
+  return value->Generation() < Heap::kMinOldSpaceGeneration &&
+         !heap()->large_space()->Contains(value);
 }
 
 
 void GC::VisitValue(HValue* value) {
+  remember_ = value->Generation() >= Heap::kMinOldSpaceGeneration;
+
   switch (value->tag()) {
    case Heap::kTagContext:
     return VisitContext(value->As<HContext>());
@@ -225,13 +851,18 @@ void GC::VisitValue(HValue* value) {
     return VisitArray(value->As<HArray>());
    case Heap::kTagMap:
     return VisitMap(value->As<HMap>());
+   case Heap::kTagShape:
+    return VisitShape(value->As<HShape>());
 
-   // non-cons strings and numbers ain't referencing anyone
+   // normal and external strings and numbers ain't referencing anyone
    case Heap::kTagString:
     switch (HValue::GetRepresentation<HString::Representation>(value->addr())) {
      case HString::kNormal:
+     case HString::kExternal:
       break;
      case HString::kCons:
+     case HString::kBuilder:
+     case HString::kSliced:
       return VisitString(value);
     }
    case Heap::kTagNumber:
@@ -270,6 +901,7 @@ void GC::VisitFunction(HFunction* fn) {
 
 void GC::VisitObject(HObject* obj) {
   push_grey(HValue::Cast(obj->map()), obj->map_slot());
+  push_grey(HValue::Cast(obj->shape()), obj->shape_slot());
 }
 
 
@@ -279,6 +911,9 @@ void GC::VisitArray(HArray* arr) {
 
 
 void GC::VisitMap(HMap* map) {
+  // Map has no pointers in it
+  if (HMap::HasOnlyUnboxed(map->addr())) return;
+
   uint32_t size = map->size() << 1;
   for (uint32_t i = 0; i < size; i++) {
     if (map->IsEmptySlot(i)) continue;
@@ -288,11 +923,30 @@ void GC::VisitMap(HMap* map) {
 }
 
 
+void GC::VisitShape(HShape* shape) {
+  push_grey(HValue::Cast(shape->keys()), shape->keys_slot());
+  push_grey(HValue::Cast(shape->transitions()), shape->transitions_slot());
+  push_grey(HValue::Cast(shape->enum_cache()), shape->enum_cache_slot());
+}
+
+
 void GC::VisitString(HValue* value) {
-  push_grey(HValue::Cast(HString::LeftCons(value->addr())),
-            HString::LeftConsSlot(value->addr()));
-  push_grey(HValue::Cast(HString::RightCons(value->addr())),
-            HString::RightConsSlot(value->addr()));
+  char* addr = value->addr();
+
+  switch (HValue::GetRepresentation<HString::Representation>(addr)) {
+   case HString::kBuilder:
+    push_grey(HValue::Cast(HString::Buffer(addr)), HString::BufferSlot(addr));
+    break;
+   case HString::kSliced:
+    push_grey(HValue::Cast(HString::Parent(addr)), HString::ParentSlot(addr));
+    break;
+   default:
+    push_grey(HValue::Cast(HString::LeftCons(addr)),
+              HString::LeftConsSlot(addr));
+    push_grey(HValue::Cast(HString::RightCons(addr)),
+              HString::RightConsSlot(addr));
+    break;
+  }
 }
 
 } // namespace internal
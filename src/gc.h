@@ -1,9 +1,13 @@
 #ifndef _SRC_GC_H_
 #define _SRC_GC_H_
 
-#include "zone.h" // ZoneObject
 #include "utils.h" // List
 
+#include <stdlib.h> // NULL
+#include <stdint.h> // uint32_t
+#include <string.h> // memcpy
+#include <pthread.h> // pthread_mutex_t, pthread_cond_t
+
 namespace candor {
 namespace internal {
 
@@ -16,21 +20,33 @@ class HFunction;
 class HObject;
 class HArray;
 class HMap;
+class HShape;
+class SafePoint;
 
 class GC {
  public:
-  class GCValue : public ZoneObject {
+  class GCValue {
    public:
-    GCValue(HValue* value, char** slot) : value_(value), slot_(slot) {
+    GCValue() : value_(NULL), slot_(NULL), remember_(false) {
+    }
+    GCValue(HValue* value, char** slot, bool remember) : value_(value),
+                                                         slot_(slot),
+                                                         remember_(remember) {
     }
 
     void Relocate(char* address);
 
     inline HValue* value() { return value_; }
+    inline char** slot() { return slot_; }
+
+    // True if slot belongs to old space object and should be put into
+    // store buffer if it'll point to the new space after GC
+    inline bool remember() { return remember_; }
 
    protected:
     HValue* value_;
     char** slot_;
+    bool remember_;
   };
 
   enum GCType {
@@ -39,19 +55,208 @@ class GC {
     kNewSpace
   };
 
-  typedef ZoneList<GCValue*> GCList;
+  // Contiguous growable stack, used for all GC worklists so traversal
+  // doesn't allocate anything per visited edge.
+  // Storage is kept between collections and grows only when needed.
+  template <class T>
+  class GCStack {
+   public:
+    GCStack() : size_(kInitialSize), length_(0) {
+      items_ = new T[size_];
+    }
+    ~GCStack() {
+      delete[] items_;
+    }
+
+    inline void Push(T value) {
+      if (length_ == size_) Grow();
+      items_[length_++] = value;
+    }
+
+    inline T Pop() { return items_[--length_]; }
+    inline bool IsEmpty() { return length_ == 0; }
+    inline uint32_t length() { return length_; }
+
+    // Move `count` items from the bottom of stack to the `to`
+    inline void MoveTo(GCStack<T>* to, uint32_t count) {
+      for (uint32_t i = 0; i < count; i++) to->Push(items_[i]);
+
+      length_ -= count;
+      memmove(items_, items_ + count, length_ * sizeof(*items_));
+    }
+
+    static const uint32_t kInitialSize = 1024;
+
+   protected:
+    void Grow() {
+      T* items = new T[size_ << 1];
+      memcpy(items, items_, length_ * sizeof(*items));
+      delete[] items_;
+
+      items_ = items;
+      size_ <<= 1;
+    }
+
+    T* items_;
+    uint32_t size_;
+    uint32_t length_;
+  };
+
+  // Slots waiting to be visited
+  typedef GCStack<GCValue> GCList;
 
-  GC(Heap* heap) : heap_(heap), gc_type_(kNone) {
+  // Old space objects that were marked by incremental marking, but whose
+  // children weren't visited yet (grey objects), or new space objects
+  // soft-marked by old space GC
+  typedef GCStack<HValue*> GCValueList;
+
+  // State shared by threads of parallel scavenge
+  class ScavengeState {
+   public:
+    ScavengeState(GC* gc, uint32_t threads);
+    ~ScavengeState();
+
+    GC* gc;
+    GC** workers;
+    uint32_t threads;
+
+    // Protects everything below and allocation in spaces
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    // Work published by busy workers for the idle ones
+    GCList pool;
+    uint32_t idle;
+  };
+
+  // Thread-local allocation buffer
+  class LocalBuffer {
+   public:
+    LocalBuffer() : top(NULL), limit(NULL) {}
+
+    char* top;
+    char* limit;
+  };
+
+  GC(Heap* heap) : heap_(heap),
+                   gc_type_(kNone),
+                   in_place_(false),
+                   remember_(false),
+                   needs_compaction_(false),
+                   marking_(0),
+                   marking_requested_(false),
+                   max_pause_(kDefaultMaxPause),
+                   scavenge_threads_(1),
+                   scavenge_(NULL),
+                   new_space_runs_(0),
+                   old_space_runs_(0),
+                   incremental_steps_(0),
+                   promoted_(0),
+                   time_(0),
+                   longest_pause_(0) {
   }
 
   void CollectGarbage(char* stack_top);
 
   void ColourPersistentHandles();
+  void ColourRememberedSet(char*** slots, uint32_t length);
+
+  // Used by new space GC, large objects allocated since the previous one are
+  // roots (they were filled without write barrier), visiting them makes
+  // them old
+  void ColourYoungLargeObjects();
   void RelocateWeakHandles();
 
+  // Incremental marking of old space:
+  //
+  // Old space GC may be split into a number of steps, each bounded by
+  // max_pause() microseconds. Marking is started by the new space GC (which
+  // greys all old space objects reachable from roots and new space), is
+  // continued by the allocation slow path and is finished by the old space
+  // GC, which revisits roots, marks the rest of the heap and sweeps it.
+  //
+  // Tri-colour invariant is maintained by write barrier: old space value
+  // stored into old space object is greyed while marking is in progress
+  // (see Heap::RecordWrite and RecordWriteStub).
+  void RequestIncrementalMarking();
+  void StartIncrementalMarking();
+  void IncrementalMarkingStep();
+  void FinishIncrementalMarking(char*** slots, uint32_t length);
+  inline void MarkingBarrier(HValue* value);
+
+  // Called by Space::FinishSweeping()
+  inline void needs_compaction(bool value) { needs_compaction_ = value; }
+
+  // Marking makes sense only for mark-sweep of old space, zero max_pause()
+  // disables it
+  inline bool IsIncrementalMarkingEnabled() {
+    return max_pause_ != 0 && !needs_compaction_;
+  }
+
+  // Parallel scavenging:
+  //
+  // New space GC may copy objects using scavenge_threads() threads. Roots
+  // are collected as usual (but not processed) and split between workers,
+  // each of them is a GC instance with its own grey stack, allocation
+  // buffers in tmp and old spaces and list of remembered slots. Objects are
+  // claimed by CAS on the GC mark byte before copying, so every object is
+  // copied only once. Workers with too much work publish half of it for the
+  // idle ones.
+  //
+  // Incremental marking isn't thread-safe, new space GC falls back to the
+  // single thread while it is in progress.
+  void Scavenge();
+  static void* ScavengeThread(void* worker);
+  void ProcessGreyParallel();
+  void ShareGrey();
+  bool TakeGrey();
+  char* Evacuate(HValue* value);
+  char* AllocateLocal(LocalBuffer* buffer, Space* space, uint32_t bytes);
+  void ReleaseLocal(LocalBuffer* buffer, Space* space);
+
+  inline bool is_parallel() { return scavenge_ != NULL; }
+
+  // Number of threads used by new space GC
+  inline uint32_t scavenge_threads() { return scavenge_threads_; }
+  inline void scavenge_threads(uint32_t value) {
+    scavenge_threads_ = value == 0 ? 1 : value;
+  }
+
+  // Size of thread-local allocation buffers
+  static const uint32_t kLocalBufferSize = 32 * 1024;
+
+  // Grey stack's length at which worker starts sharing its work
+  static const uint32_t kShareThreshold = 64;
+
+  // Copy of store buffer's contents (store buffer is cleared)
+  char*** TakeRememberedSet(uint32_t* length);
+
+  // `stack_top` is a frame pointer of CollectGarbageStub
   void ColourFrames(char* stack_top);
+  char** ColourFrame(char** ret, SafePoint* point);
+  inline void ColourSlot(char** slot);
+
+  // Slot that may hold a non-pointer value (e.g. return address), which is
+  // skipped if it doesn't point into the heap
+  inline void ColourConservativeSlot(char** slot);
+
+  // Returns new address of weakly referenced value or NULL if it's dead
+  HValue* WeakValue(HValue* value);
   void HandleWeakReferences();
 
+  // Global cells are weak, cached object and map are relocated (or cell is
+  // cleared if any of them is dead)
+  void HandleGlobalCells();
+
+  // Cached shapes are relocated by compacting old space GC
+  void RelocateICs();
+
+  // Cached number strings are weak too
+  void HandleNumberStringCache();
+
+  // Interned strings referenced only by the string table are removed from it
+  void HandleStringTable();
+
   void ProcessGrey();
 
   void VisitValue(HValue* value);
@@ -60,16 +265,25 @@ class GC {
   void VisitObject(HObject* obj);
   void VisitArray(HArray* arr);
   void VisitMap(HMap* map);
+  void VisitShape(HShape* shape);
   void VisitString(HValue* value);
 
   bool IsInCurrentSpace(HValue* value);
 
+  // True if value is in new space or was copied from it by this GC
+  bool IsYoung(HValue* value);
+
+  inline void push_grey(HValue* value, char** reference, bool remember) {
+    grey_items()->Push(GCValue(value, reference, remember));
+  }
+
+  // Used by Visit* methods (children of old space objects are remembered)
   inline void push_grey(HValue* value, char** reference) {
-    grey_items()->Push(new GCValue(value, reference));
+    push_grey(value, reference, remember_);
   }
 
   inline GCList* grey_items() { return &grey_items_; }
-  inline GCList* black_items() { return &black_items_; }
+  inline GCValueList* black_items() { return &black_items_; }
   inline Heap* heap() { return heap_; }
   inline void tmp_space(Space* space) { tmp_space_ = space; }
   inline Space* tmp_space() { return tmp_space_; }
@@ -77,13 +291,73 @@ class GC {
   inline GCType gc_type() { return gc_type_; }
   inline void gc_type(GCType value) { gc_type_ = value; }
 
+  // True if objects are marked in place (mark-sweep of old space),
+  // rather than copied to the temporary space
+  inline bool in_place() { return in_place_; }
+
+  // Nonzero while incremental marking is in progress
+  // (address is used by write barrier in generated code)
+  inline bool is_marking() { return marking_ != 0; }
+  inline intptr_t* marking_addr() { return &marking_; }
+
+  // Pause target of incremental marking steps (in microseconds)
+  inline uint32_t max_pause() { return max_pause_; }
+  inline void max_pause(uint32_t value) { max_pause_ = value; }
+
+  static const uint32_t kDefaultMaxPause = 1000;
+
+  // Number of objects visited by marking step between deadline checks
+  static const uint32_t kStepCheckInterval = 64;
+
+  // Statistics
+  inline uint32_t new_space_runs() { return new_space_runs_; }
+  inline uint32_t old_space_runs() { return old_space_runs_; }
+  inline uint32_t incremental_steps() { return incremental_steps_; }
+  inline uint64_t promoted() { return promoted_; }
+  inline uint64_t time() { return time_; }
+  inline uint64_t longest_pause() { return longest_pause_; }
+
  protected:
   GCList grey_items_;
-  GCList black_items_;
+  GCValueList black_items_;
   Heap* heap_;
   Space* tmp_space_;
 
   GCType gc_type_;
+
+  bool in_place_;
+
+  // True while visiting old space object
+  bool remember_;
+
+  // Set by sweeper if old space became too fragmented, next old space GC
+  // will evacuate all live objects into the new pages
+  bool needs_compaction_;
+
+  intptr_t marking_;
+  bool marking_requested_;
+  GCValueList marking_stack_;
+  uint32_t max_pause_;
+
+  uint32_t scavenge_threads_;
+  ScavengeState* scavenge_;
+
+  // Parallel scavenge worker's state
+  LocalBuffer new_buffer_;
+  LocalBuffer old_buffer_;
+  GCStack<char**> remembered_;
+
+  uint32_t new_space_runs_;
+  uint32_t old_space_runs_;
+  uint32_t incremental_steps_;
+
+  // Bytes moved from new space to old space
+  uint64_t promoted_;
+
+  // Total time spent in CollectGarbage() and marking steps
+  // (in microseconds)
+  uint64_t time_;
+  uint64_t longest_pause_;
 };
 
 } // namespace internal
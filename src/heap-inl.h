@@ -6,6 +6,87 @@
 namespace candor {
 namespace internal {
 
+inline bool Space::Page::Mark(char* addr) {
+  uint32_t index = (addr - data_ - 1) / HValue::kPointerSize;
+  uint8_t bit = 1 << (index & 7);
+  uint8_t* slot = &bitmap_[index >> 3];
+
+  if ((*slot & bit) != 0) return false;
+  *slot |= bit;
+
+  return true;
+}
+
+
+inline bool Space::Page::IsMarked(char* addr) {
+  uint32_t index = (addr - data_ - 1) / HValue::kPointerSize;
+
+  return (bitmap_[index >> 3] & (1 << (index & 7))) != 0;
+}
+
+
+inline bool Space::Contains(HValue* value) {
+  return Page::FromAddress(value->addr())->owner() == this;
+}
+
+
+inline void Heap::RecordWrite(char* obj, char** slot) {
+  char* value = *slot;
+
+  if (value == HNil::New() || HValue::IsUnboxed(value)) return;
+  if (HValue::Cast(obj)->Generation() < kMinOldSpaceGeneration) return;
+  if (!new_space()->Contains(HValue::Cast(value))) {
+    // Old object may be already black, grey the value
+    if (gc()->is_marking()) gc()->MarkingBarrier(HValue::Cast(value));
+    return;
+  }
+
+  store_buffer()->Record(slot);
+}
+
+
+inline char* Heap::GetNumberString(int64_t number) {
+  NumberStringEntry* entry =
+      &number_strings_[number & (kNumberStringCacheSize - 1)];
+  if (entry->string == NULL || entry->number != number) return NULL;
+
+  return entry->string;
+}
+
+
+inline void Heap::SetNumberString(int64_t number, char* string) {
+  NumberStringEntry* entry =
+      &number_strings_[number & (kNumberStringCacheSize - 1)];
+  entry->number = number;
+  entry->string = string;
+}
+
+
+inline void GC::ColourSlot(char** slot) {
+  // Skip nil, non-pointer values and frame pointers
+  if (*slot == HNil::New() || HValue::IsUnboxed(*slot)) return;
+
+  push_grey(HValue::Cast(*slot), slot, false);
+  ProcessGrey();
+}
+
+
+inline void GC::ColourConservativeSlot(char** slot) {
+  if (*slot == HNil::New() || HValue::IsUnboxed(*slot)) return;
+  if (heap()->sweeper()->FindPage(*slot) == NULL) return;
+
+  ColourSlot(slot);
+}
+
+
+inline void GC::MarkingBarrier(HValue* value) {
+  if (heap()->old_space()->Mark(value) ||
+      heap()->large_space()->Mark(value)) {
+    marking_stack_.Push(value);
+  }
+}
+
+
 inline Heap::HeapTag HValue::GetTag(char* addr) {
   if (addr == HNil::New()) return Heap::kTagNil;
 
@@ -42,6 +123,34 @@ inline void HValue::SetGCMark(char* new_addr) {
 }
 
 
+inline bool HValue::ClaimGCMark() {
+  uint8_t* mark = reinterpret_cast<uint8_t*>(addr() + kGCMarkOffset);
+
+  while (true) {
+    uint8_t bits = __atomic_load_n(mark, __ATOMIC_ACQUIRE);
+
+    // Already copied
+    if ((bits & 0x80) != 0) return false;
+
+    // Other thread is copying it, wait for forwarding address
+    if ((bits & 0x20) != 0) continue;
+
+    if (__sync_bool_compare_and_swap(mark, bits, bits | 0x20)) return true;
+  }
+}
+
+
+inline void HValue::PublishGCMark(char* new_addr) {
+  uint8_t* mark = reinterpret_cast<uint8_t*>(addr() + kGCMarkOffset);
+
+  // Copy has inherited claim bit
+  *reinterpret_cast<uint8_t*>(new_addr + kGCMarkOffset) &= ~0x20;
+
+  *reinterpret_cast<char**>(addr() + kGCForwardOffset) = new_addr;
+  __atomic_store_n(mark, (*mark & ~0x20) | 0x80, __ATOMIC_RELEASE);
+}
+
+
 inline bool HValue::IsSoftGCMarked() {
   if (IsUnboxed(addr())) return false;
   return (*reinterpret_cast<uint8_t*>(addr() + kGCMarkOffset) & 0x40) != 0;
@@ -69,6 +178,11 @@ inline void HValue::IncrementGeneration() {
 }
 
 
+inline void HValue::SetGeneration(uint8_t generation) {
+  *reinterpret_cast<uint8_t*>(addr() + kGenerationOffset) = generation;
+}
+
+
 inline uint8_t HValue::Generation() {
   return *reinterpret_cast<uint8_t*>(addr() + kGenerationOffset);
 }
@@ -133,18 +247,92 @@ inline bool HNumber::IsIntegral(char* addr) {
 }
 
 
+inline uint32_t HString::Depth(char* addr) {
+  if (GetRepresentation<Representation>(addr) != kCons) return 0;
+  return *reinterpret_cast<uint32_t*>(addr + kConsDepthOffset);
+}
+
+
+inline char* HString::FlatValue(char* addr) {
+  switch (GetRepresentation<Representation>(addr)) {
+   case kBuilder:
+    return Buffer(addr) + kBufferValueOffset;
+   case kSliced:
+    return FlatValue(Parent(addr)) + SliceOffset(addr);
+   case kExternal:
+    return ExternalValue(addr);
+   default:
+    assert(GetRepresentation<Representation>(addr) == kNormal);
+    return addr + kValueOffset;
+  }
+}
+
+
+inline bool HString::IsDetachable(char* addr) {
+  if (GetTag(addr) != Heap::kTagString ||
+      GetRepresentation<Representation>(addr) != kSliced) {
+    return false;
+  }
+
+  // NOTE: Parent might be already moved, but its length and bytes are intact
+  return static_cast<uint64_t>(Length(addr)) * kSliceDetachRatio <=
+         Length(Parent(addr));
+}
+
+
+inline uint32_t HString::DetachedSize(char* addr) {
+  // tag + hash + length + bytes (see HValue::Size())
+  return 3 * kPointerSize + Length(addr);
+}
+
+
+inline bool HObject::IsShaped(char* addr) {
+  return GetTag(addr) == Heap::kTagObject && Shape(addr) != HNil::New();
+}
+
+
 inline void HArray::SetLength(char* obj, int64_t length) {
   *reinterpret_cast<int64_t*>(obj + kLengthOffset) = length;
 }
 
 
 inline bool HArray::IsDense(char* obj) {
-  return Length(obj, false) <= kDenseLengthMax;
+  return GetRepresentation<Representation>(obj) == kDense;
+}
+
+
+inline uint32_t HArray::Capacity(char* obj) {
+  return Mask(obj) / kPointerSize + 1;
+}
+
+
+inline bool HArray::IsDenseIndex(char* obj, int64_t index) {
+  if (index >= kMaxDenseCapacity) return false;
+
+  // Doubling the store is amortised even if it creates many holes
+  return index < (static_cast<int64_t>(Capacity(obj)) << 1) ||
+         index - Length(obj, false) < kMaxDenseGap;
+}
+
+
+inline bool HMap::HasOnlyUnboxed(char* addr) {
+  return GetRepresentation<Representation>(addr) != kGeneric;
+}
+
+
+inline bool HMap::HasDoubles(char* addr) {
+  return GetRepresentation<Representation>(addr) == kDouble;
+}
+
+
+inline bool HMap::IsRawDouble(double value) {
+  return *reinterpret_cast<char**>(&value) != HNil::New();
 }
 
 
 inline bool HMap::IsEmptySlot(uint32_t index) {
-  return *GetSlotAddress(index) == HNil::New();
+  char* value = *GetSlotAddress(index);
+  return value == HNil::New() || value == Tombstone();
 }
 
 
@@ -158,6 +346,15 @@ inline char** HMap::GetSlotAddress(uint32_t index) {
 }
 
 
+inline int64_t HShape::KeyIndex(char* addr, HMap* keys, uint32_t i) {
+  if (keys->IsEmptySlot(i)) return -1;
+
+  int64_t index = HNumber::IntegralValue(*keys->GetSlotAddress(i +
+                                                               keys->size()));
+  return index < Length(addr) ? index : -1;
+}
+
+
 inline char* HFunction::GetContext(char* addr) {
   HContext* hroot = HValue::As<HContext>(HFunction::Root(addr));
 
@@ -171,6 +368,7 @@ inline void HFunction::SetContext(char* addr, char* context) {
 
   char** root_slot = hroot->GetSlotAddress(Heap::kRootGlobalIndex);
   *root_slot = context;
+  Heap::Current()->RecordWrite(hroot->addr(), root_slot);
 }
 
 } // namespace internal
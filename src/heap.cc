@@ -7,17 +7,73 @@
 #include <string.h> // memcpy
 #include <zone.h> // Zone::Allocate
 #include <assert.h> // assert
+#include <sys/mman.h> // mmap, madvise
+#include <pthread.h> // pthread_create, pthread_join
+#include <new> // placement new
 
 namespace candor {
 namespace internal {
 
 Heap* Heap::current_ = NULL;
 
+const uint32_t Space::Page::kBitmapGranularity = HValue::kPointerSize * 8;
+
+Space::Page* Space::Page::New(uint32_t size) {
+  // Map more than needed and cut unaligned parts out
+  intptr_t mask = kPageAlignment - 1;
+  char* mapping = reinterpret_cast<char*>(mmap(0,
+                                               size + kPageAlignment,
+                                               PROT_READ | PROT_WRITE,
+                                               MAP_ANON | MAP_PRIVATE,
+                                               -1,
+                                               0));
+  if (mapping == MAP_FAILED) abort();
+
+  char* start = reinterpret_cast<char*>(
+      (reinterpret_cast<intptr_t>(mapping) + mask) & ~mask);
+  if (start != mapping) munmap(mapping, start - mapping);
+  munmap(start + size, mapping + kPageAlignment - start);
+
+  return new (start) Page(size);
+}
+
+
+void Space::Page::Delete(Page* page) {
+  munmap(page->start(), page->size_);
+}
+
+
+uint32_t Space::Page::BitmapSize(uint32_t size) {
+  return RoundUp(size, kBitmapGranularity) / kBitmapGranularity;
+}
+
+
+uint32_t Space::Page::HeaderSize(uint32_t size) {
+  return RoundUp(sizeof(Page) + BitmapSize(size), 16);
+}
+
+
+Space::Page::Page(uint32_t size) : owner_(NULL), size_(size) {
+  bitmap_size_ = BitmapSize(size);
+  bitmap_ = reinterpret_cast<uint8_t*>(start() + sizeof(*this));
+  data_ = start() + HeaderSize(size);
+
+  Reset();
+}
+
+
 Space::Space(Heap* heap, uint32_t page_size) : heap_(heap),
                                                page_size_(page_size),
-                                               size_(0) {
+                                               size_(0),
+                                               allocated_(0),
+                                               live_size_(0),
+                                               free_size_(0),
+                                               sweeping_(false) {
+  ClearFreeLists();
+
   // Create the first page
-  pages_.Push(new Page(page_size));
+  pages_.Push(heap->sweeper()->AllocatePage(page_size));
+  pages_.head()->value()->owner(this);
 
   select(pages_.head()->value());
 
@@ -25,6 +81,25 @@ Space::Space(Heap* heap, uint32_t page_size) : heap_(heap),
 }
 
 
+Space::Space(Heap* heap) : heap_(heap),
+                           top_(NULL),
+                           limit_(NULL),
+                           page_size_(0),
+                           size_(0),
+                           size_limit_(0),
+                           allocated_(0),
+                           live_size_(0),
+                           free_size_(0),
+                           sweeping_(false) {
+  ClearFreeLists();
+}
+
+
+Space::~Space() {
+  Clear();
+}
+
+
 void Space::select(Page* page) {
   top_ = &page->top_;
   limit_ = &page->limit_;
@@ -32,67 +107,733 @@ void Space::select(Page* page) {
 
 
 void Space::AddPage(uint32_t size) {
-  uint32_t real_size = RoundUp(size, page_size());
-  Page* page = new Page(real_size);
+  // Page header should fit too
+  uint32_t real_size = page_size();
+  while (Page::HeaderSize(real_size) + size > real_size) {
+    real_size += page_size();
+  }
+
+  Page* page = heap()->sweeper()->AllocatePage(real_size);
+  page->owner(this);
+  pages_.Push(page);
+  size_ += real_size;
+
+  // Nothing should be allocated after large object
+  if (real_size != page_size()) page->limit_ = page->data_ + size;
+
+  select(page);
+}
+
+
+char* Space::Allocate(uint32_t bytes) {
+  // Keep all objects pointer-aligned, so pages can be walked while sweeping
+  uint32_t aligned_bytes = RoundUp(bytes, HValue::kPointerSize);
+  bool place_in_current = *top_ + aligned_bytes <= *limit_;
+
+  if (!place_in_current) {
+    // Take results of background sweeping
+    if (is_sweeping() && heap()->sweeper()->IsDone(this)) FinishSweeping();
+
+    // Try reusing memory freed by sweeper first
+    char* result = AllocateFromFreeList(aligned_bytes);
+    if (result != NULL) {
+      allocated_ += aligned_bytes;
+      return result;
+    }
+
+    // Go through all pages to find gap
+    List<Page*, EmptyClass>::Item* item = pages_.head();
+    for (;*top_ + aligned_bytes > *limit_ && item != NULL; item = item->next()) {
+      select(item->value());
+    }
+
+    // No gap was found - allocate new page
+    if (item == NULL) {
+      // Limit is recomputed after sweeping
+      if (size() > size_limit() && !is_sweeping()) RequestGC();
+
+      // Including tagging byte offset
+      AddPage(aligned_bytes + 1);
+    }
+  }
+
+  char* result = *top_;
+  *top_ += aligned_bytes;
+  allocated_ += aligned_bytes;
+
+  return result;
+}
+
+
+void Space::RequestGC() {
+  if (this == heap()->new_space()) {
+    heap()->needs_gc(Heap::kGCNewSpace);
+  } else if (heap()->gc()->IsIncrementalMarkingEnabled() &&
+             size() <= size_limit() << 1) {
+    // Mark old space incrementally, but do a full GC if it keeps
+    // growing faster than marking proceeds
+    heap()->gc()->RequestIncrementalMarking();
+  } else {
+    heap()->needs_gc(Heap::kGCOldSpace);
+  }
+}
+
+
+void Space::Swap(Space* space) {
+  // Remove self pages
+  Clear();
+
+  while (space->pages_.length() != 0) {
+    Page* page = space->pages_.Shift();
+    page->owner(this);
+    pages_.Push(page);
+    size_ += page->size_;
+  }
+
+  select(pages_.head()->value());
+  compute_size_limit();
+}
+
+
+void Space::Clear() {
+  FinishSweeping();
+
+  size_ = 0;
+  ClearFreeLists();
+  while (pages_.length() != 0) {
+    heap()->sweeper()->Release(pages_.Shift());
+  }
+}
+
+
+bool Space::Mark(HValue* value) {
+  if (!Contains(value)) return false;
+
+  return Page::FromAddress(value->addr())->Mark(value->addr());
+}
+
+
+bool Space::IsMarked(HValue* value) {
+  if (!Contains(value)) return false;
+
+  return Page::FromAddress(value->addr())->IsMarked(value->addr());
+}
+
+
+bool Space::IsMarkedSlot(char** slot) {
+  char* addr = reinterpret_cast<char*>(slot);
+
+  // Slot of large object may be far from it's page header
+  Page* page = heap()->sweeper()->FindPage(addr);
+  if (page == NULL || page->owner() != this) return false;
+
+  // Find the closest marked object that starts before the slot
+  int32_t index = (addr - page->data_ - 1) / HValue::kPointerSize;
+  while (index >= 0) {
+    uint8_t bits = page->bitmap_[index >> 3] & (0xff >> (7 - (index & 7)));
+    if (bits == 0) {
+      index = (index & ~7) - 1;
+      continue;
+    }
+
+    index &= ~7;
+    while (bits > 1) {
+      bits >>= 1;
+      index++;
+    }
+
+    // Slot belongs to it only if it's inside of object's body
+    char* start = page->data_ + 1 + index * HValue::kPointerSize;
+    uint32_t size = RoundUp(HValue::Cast(start)->Size(),
+                            HValue::kPointerSize);
+    return addr < start - 1 + size;
+  }
+
+  return false;
+}
+
+
+void Space::Sweep() {
+  assert(!is_sweeping());
+
+  ClearFreeLists();
+
+  // All pages are swept in background, allocate in a fresh one meanwhile
+  while (pages_.length() != 0) swept_pages_.Push(pages_.Shift());
+  sweeping_ = true;
+  AddPage(0);
+
+  heap()->sweeper()->Sweep(this);
+}
+
+
+void Space::SweepPages() {
+  for (int i = 0; i < kFreeListCount; i++) {
+    swept_lists_[i] = NULL;
+  }
+  swept_live_size_ = 0;
+  swept_free_size_ = 0;
+  swept_released_size_ = 0;
+
+  for (int32_t i = swept_pages_.length(); i > 0; i--) {
+    Page* page = swept_pages_.Shift();
+
+    uint32_t live = 0;
+    char* free_start = NULL;
+    char* addr = page->data_ + 1;
+    while (addr < page->top_) {
+      HValue* value = HValue::Cast(addr);
+      uint32_t size = RoundUp(value->Size(), HValue::kPointerSize);
+
+      if (value->tag() != Heap::kTagFree && page->IsMarked(addr)) {
+        // Live object - put everything before it into free list
+        if (free_start != NULL) {
+          if (PushFreeChunk(swept_lists_, free_start, addr - free_start)) {
+            swept_free_size_ += addr - free_start;
+          }
+
+          // Chunk's header should stay in place
+          Sweeper::Discard(free_start - 1 + kMinFreeChunk, addr - 1);
+          free_start = NULL;
+        }
+        live += size;
+      } else if (free_start == NULL) {
+        free_start = addr;
+      }
+
+      addr += size;
+    }
+
+    // Trailing free space is returned back to the page
+    if (free_start != NULL) {
+      Sweeper::Discard(free_start - 1, page->top_ - 1);
+      page->top_ = free_start;
+    }
+    memset(page->bitmap_, 0, page->bitmap_size_);
+
+    // Release empty pages
+    if (live == 0) {
+      swept_released_size_ += page->size_;
+      heap()->sweeper()->Release(page);
+    } else {
+      swept_pages_.Push(page);
+    }
+
+    swept_live_size_ += live;
+  }
+}
+
+
+void Space::FinishSweeping() {
+  if (!is_sweeping()) return;
+
+  heap()->sweeper()->Wait(this);
+  sweeping_ = false;
+
+  while (swept_pages_.length() != 0) pages_.Push(swept_pages_.Shift());
+
+  // Append swept chunks to the ones that were freed meanwhile
+  for (int i = 0; i < kFreeListCount; i++) {
+    char** slot = &free_lists_[i];
+    while (*slot != NULL) slot = FreeChunkNext(*slot);
+    *slot = swept_lists_[i];
+  }
+  free_size_ += swept_free_size_;
+  live_size_ = swept_live_size_;
+  size_ -= swept_released_size_;
+
+  size_limit_ = live_size_ << 1;
+  if (size_limit_ < page_size_) size_limit_ = page_size_;
+
+  // Compact space on the next run if more than a half of it is wasted
+  heap()->gc()->needs_compaction(swept_free_size_ > live_size_);
+}
+
+
+void Space::CreateFreeChunk(char* addr, uint32_t size) {
+  assert(size >= static_cast<uint32_t>(HValue::kPointerSize));
+
+  *reinterpret_cast<uint8_t*>(addr + HValue::kTagOffset) = Heap::kTagFree;
+  *reinterpret_cast<uint32_t*>(addr + kFreeSizeOffset) = size;
+}
+
+
+int Space::FreeListIndex(uint32_t size) {
+  int index = -4;
+  while (size > 1 && index < kFreeListCount - 1) {
+    size >>= 1;
+    index++;
+  }
+
+  return index < 0 ? 0 : index;
+}
+
+
+void Space::AddFreeChunk(char* addr, uint32_t size) {
+  if (PushFreeChunk(free_lists_, addr, size)) free_size_ += size;
+}
+
+
+bool Space::PushFreeChunk(char** lists, char* addr, uint32_t size) {
+  CreateFreeChunk(addr, size);
+
+  // Too small chunks are just skipped (till the next sweep)
+  if (size < kMinFreeChunk) return false;
+
+  char** list = &lists[FreeListIndex(size)];
+  *FreeChunkNext(addr) = *list;
+  *list = addr;
+
+  return true;
+}
+
+
+char* Space::AllocateFromFreeList(uint32_t bytes) {
+  if (free_size_ == 0) return NULL;
+
+  for (int i = FreeListIndex(bytes); i < kFreeListCount; i++) {
+    // First fit
+    char** slot = &free_lists_[i];
+    while (*slot != NULL) {
+      char* chunk = *slot;
+      uint32_t size = FreeChunkSize(chunk);
+
+      if (size >= bytes) {
+        *slot = *FreeChunkNext(chunk);
+        free_size_ -= size;
+
+        // Put the rest back
+        if (size > bytes) AddFreeChunk(chunk + bytes, size - bytes);
+
+        return chunk;
+      }
+
+      slot = FreeChunkNext(chunk);
+    }
+  }
+
+  return NULL;
+}
+
+
+void Space::ClearFreeLists() {
+  free_size_ = 0;
+  for (int i = 0; i < kFreeListCount; i++) {
+    free_lists_[i] = NULL;
+  }
+}
+
+
+LargeSpace::LargeSpace(Heap* heap) : Space(heap) {
+  size_limit_ = kMinSizeLimit;
+}
+
+
+LargeSpace::~LargeSpace() {
+  // Pages are released by Space::Clear()
+  while (young_pages_.length() != 0) young_pages_.Shift();
+}
+
+
+char* LargeSpace::Allocate(uint32_t bytes) {
+  uint32_t aligned_bytes = RoundUp(bytes, HValue::kPointerSize);
+
+  if (size() > size_limit()) RequestGC();
+
+  // Including tagging byte offset and page header
+  uint32_t os_page_size = GetPageSize();
+  uint32_t real_size = RoundUp(aligned_bytes + 1, os_page_size);
+  while (Page::HeaderSize(real_size) + aligned_bytes + 1 > real_size) {
+    real_size += os_page_size;
+  }
+
+  Page* page = heap()->sweeper()->AllocatePage(real_size);
+  page->owner(this);
   pages_.Push(page);
   size_ += real_size;
 
-  select(page);
+  char* result = page->top_;
+  page->top_ += aligned_bytes;
+  page->limit_ = page->top_;
+  allocated_ += aligned_bytes;
+
+  // Visited by the next new space GC
+  young_pages_.Push(page);
+
+  return result;
+}
+
+
+void LargeSpace::Sweep() {
+  // Forget dead young objects
+  for (int32_t i = young_pages_.length(); i > 0; i--) {
+    Page* page = young_pages_.Shift();
+    if (page->IsMarked(Object(page))) young_pages_.Push(page);
+  }
+
+  for (int32_t i = pages_.length(); i > 0; i--) {
+    Page* page = pages_.Shift();
+
+    if (page->IsMarked(Object(page))) {
+      // Only object's mark bit is used
+      page->bitmap_[0] = 0;
+      pages_.Push(page);
+    } else {
+      size_ -= page->size_;
+      heap()->sweeper()->Release(page);
+    }
+  }
+
+  size_limit_ = size_ << 1;
+  if (size_limit_ < kMinSizeLimit) size_limit_ = kMinSizeLimit;
+}
+
+
+Sweeper::Sweeper(uint32_t page_size) : page_size_(page_size),
+                                      stop_(false),
+                                      space_(NULL),
+                                      index_length_(0),
+                                      index_size_(kInitialIndexSize),
+                                      frozen_(false),
+                                      frozen_length_(0),
+                                      frozen_size_(kInitialIndexSize) {
+  assert(page_size <= Space::Page::kPageAlignment);
+  index_ = new Space::Page*[index_size_];
+  frozen_index_ = new Space::Page*[frozen_size_];
+
+  pthread_mutex_init(&lock_, NULL);
+  pthread_cond_init(&cond_, NULL);
+
+  if (pthread_create(&thread_, NULL, ThreadMain, this)) abort();
+}
+
+
+Sweeper::~Sweeper() {
+  pthread_mutex_lock(&lock_);
+  stop_ = true;
+  pthread_cond_broadcast(&cond_);
+  pthread_mutex_unlock(&lock_);
+
+  pthread_join(thread_, NULL);
+
+  // All released pages were handled by thread
+  while (pool_.length() != 0) Space::Page::Delete(pool_.Shift());
+  delete[] index_;
+  delete[] frozen_index_;
+
+  pthread_mutex_destroy(&lock_);
+  pthread_cond_destroy(&cond_);
+}
+
+
+Space::Page* Sweeper::AllocatePage(uint32_t size) {
+  Space::Page* page = NULL;
+
+  pthread_mutex_lock(&lock_);
+  if (size == page_size_ && pool_.length() != 0) page = pool_.Shift();
+  pthread_mutex_unlock(&lock_);
+
+  if (page != NULL) {
+    page->Reset();
+    return page;
+  }
+
+  page = Space::Page::New(size);
+
+  pthread_mutex_lock(&lock_);
+  AddToIndex(page);
+  pthread_mutex_unlock(&lock_);
+
+  return page;
+}
+
+
+void Sweeper::Release(Space::Page* page) {
+  pthread_mutex_lock(&lock_);
+  page->owner(NULL);
+  released_.Push(page);
+  pthread_cond_broadcast(&cond_);
+  pthread_mutex_unlock(&lock_);
+}
+
+
+void Sweeper::Freeze() {
+  pthread_mutex_lock(&lock_);
+  assert(!frozen_);
+  frozen_ = true;
+
+  if (frozen_size_ < index_length_) {
+    delete[] frozen_index_;
+    while (frozen_size_ < index_length_) frozen_size_ <<= 1;
+    frozen_index_ = new Space::Page*[frozen_size_];
+  }
+
+  // Pooled and released pages aren't used by any space
+  frozen_length_ = 0;
+  for (uint32_t i = 0; i < index_length_; i++) {
+    if (index_[i]->owner() != NULL) frozen_index_[frozen_length_++] = index_[i];
+  }
+  pthread_mutex_unlock(&lock_);
+}
+
+
+void Sweeper::Unfreeze() {
+  pthread_mutex_lock(&lock_);
+  assert(frozen_);
+  frozen_ = false;
+  pthread_cond_broadcast(&cond_);
+  pthread_mutex_unlock(&lock_);
+}
+
+
+Space::Page* Sweeper::FindPage(char* addr) {
+  assert(frozen_);
+
+  // Binary search
+  int32_t low = 0;
+  int32_t high = frozen_length_ - 1;
+  while (low <= high) {
+    int32_t middle = (low + high) >> 1;
+    Space::Page* page = frozen_index_[middle];
+
+    if (page->Contains(addr)) return page;
+
+    if (addr < page->start()) {
+      high = middle - 1;
+    } else {
+      low = middle + 1;
+    }
+  }
+
+  return NULL;
+}
+
+
+void Sweeper::AddToIndex(Space::Page* page) {
+  // Grow index
+  if (index_length_ == index_size_) {
+    Space::Page** index = new Space::Page*[index_size_ << 1];
+    memcpy(index, index_, index_length_ * sizeof(*index_));
+    delete[] index_;
+
+    index_size_ = index_size_ << 1;
+    index_ = index;
+  }
+
+  // Keep index sorted
+  uint32_t i = index_length_++;
+  while (i > 0 && index_[i - 1] > page) {
+    index_[i] = index_[i - 1];
+    i--;
+  }
+  index_[i] = page;
+}
+
+
+void Sweeper::RemoveFromIndex(Space::Page* page) {
+  uint32_t i = 0;
+  while (index_[i] != page) i++;
+
+  index_length_--;
+  memmove(&index_[i], &index_[i + 1], (index_length_ - i) * sizeof(*index_));
+}
+
+
+void Sweeper::Sweep(Space* space) {
+  pthread_mutex_lock(&lock_);
+  assert(space_ == NULL);
+  space_ = space;
+  pthread_cond_broadcast(&cond_);
+  pthread_mutex_unlock(&lock_);
+}
+
+
+bool Sweeper::IsDone(Space* space) {
+  pthread_mutex_lock(&lock_);
+  bool done = space_ != space;
+  pthread_mutex_unlock(&lock_);
+
+  return done;
+}
+
+
+void Sweeper::Wait(Space* space) {
+  pthread_mutex_lock(&lock_);
+  while (space_ == space) pthread_cond_wait(&cond_, &lock_);
+  pthread_mutex_unlock(&lock_);
+}
+
+
+void Sweeper::Discard(char* start, char* end) {
+  intptr_t mask = GetPageSize() - 1;
+
+  intptr_t from = (reinterpret_cast<intptr_t>(start) + mask) & ~mask;
+  intptr_t to = reinterpret_cast<intptr_t>(end) & ~mask;
+  if (from >= to) return;
+
+  madvise(reinterpret_cast<void*>(from), to - from, MADV_DONTNEED);
+}
+
+
+void* Sweeper::ThreadMain(void* sweeper) {
+  reinterpret_cast<Sweeper*>(sweeper)->Loop();
+  return NULL;
+}
+
+
+void Sweeper::Loop() {
+  pthread_mutex_lock(&lock_);
+  while (true) {
+    if (released_.length() != 0 && !frozen_) {
+      Space::Page* page = released_.Shift();
+
+      // Pages are added to the pool only by this thread
+      bool pool = page->size_ == page_size_ && pool_.length() < kMaxPoolSize;
+      if (!pool) RemoveFromIndex(page);
+      pthread_mutex_unlock(&lock_);
+
+      if (pool) {
+        Discard(page->data_, page->top_);
+      } else {
+        Space::Page::Delete(page);
+      }
+
+      pthread_mutex_lock(&lock_);
+      if (pool) pool_.Push(page);
+    } else if (space_ != NULL) {
+      Space* space = space_;
+      pthread_mutex_unlock(&lock_);
+
+      space->SweepPages();
+
+      pthread_mutex_lock(&lock_);
+      space_ = NULL;
+      pthread_cond_broadcast(&cond_);
+    } else if (stop_) {
+      break;
+    } else {
+      pthread_cond_wait(&cond_, &lock_);
+    }
+  }
+  pthread_mutex_unlock(&lock_);
+}
+
+
+StoreBuffer::StoreBuffer() : size_(kInitialSize) {
+  start_ = new char**[size_];
+  top_ = start_;
+  limit_ = start_ + size_;
+}
+
+
+StoreBuffer::~StoreBuffer() {
+  delete[] start_;
+}
+
+
+static int CompareSlots(const void* a, const void* b) {
+  char** left = *reinterpret_cast<char** const*>(a);
+  char** right = *reinterpret_cast<char** const*>(b);
+
+  return left < right ? -1 : left > right ? 1 : 0;
+}
+
+
+void StoreBuffer::Compact() {
+  if (length() < 2) return;
+
+  qsort(start_, length(), sizeof(*start_), CompareSlots);
+
+  char*** last = start_;
+  for (char*** current = start_ + 1; current < top_; current++) {
+    if (*current != *last) *++last = *current;
+  }
+  top_ = last + 1;
+}
+
+
+void StoreBuffer::Overflow() {
+  Compact();
+  if (length() < (size_ >> 1)) return;
+
+  // Grow buffer
+  uint32_t length = this->length();
+  char*** start = new char**[size_ << 1];
+  memcpy(start, start_, length * sizeof(*start_));
+  delete[] start_;
+
+  size_ = size_ << 1;
+  start_ = start;
+  top_ = start_ + length;
+  limit_ = start_ + size_;
+}
+
+
+StringTable::StringTable() : size_(kInitialSize), count_(0), used_(0) {
+  entries_ = new char*[size_];
+  memset(entries_, 0, size_ * sizeof(*entries_));
 }
 
 
-char* Space::Allocate(uint32_t bytes) {
-  // If current page was exhausted - run GC
-  uint32_t even_bytes = bytes + (bytes & 0x01);
-  bool place_in_current = *top_ + even_bytes <= *limit_;
+StringTable::~StringTable() {
+  delete[] entries_;
+}
 
-  if (!place_in_current) {
-    // Go through all pages to find gap
-    List<Page*, EmptyClass>::Item* item = pages_.head();
-    for (;*top_ + even_bytes > *limit_ && item != NULL; item = item->next()) {
-      select(item->value());
-    }
 
-    // No gap was found - allocate new page
-    if (item == NULL) {
-      if (size() > size_limit()) {
-        heap()->needs_gc(this == heap()->new_space() ?
-            Heap::kGCNewSpace
-            :
-            Heap::kGCOldSpace);
-      }
+char* StringTable::Lookup(const char* value, uint32_t length, uint32_t hash) {
+  uint32_t mask = size_ - 1;
+  uint32_t index = hash & mask;
 
-      // Including tagging byte offset
-      AddPage(even_bytes + 1);
+  // Quadratic probing, table always has empty entries
+  for (uint32_t step = 1; entries_[index] != NULL; step++) {
+    char* str = entries_[index];
+    if (str != Tombstone() &&
+        HString::CachedHash(str) == hash &&
+        HString::Length(str) == length &&
+        memcmp(HString::FlatValue(str), value, length) == 0) {
+      return str;
     }
+    index = (index + step) & mask;
   }
 
-  char* result = *top_;
-  *top_ += even_bytes;
-
-  return result;
+  return NULL;
 }
 
 
-void Space::Swap(Space* space) {
-  // Remove self pages
-  Clear();
+void StringTable::Insert(char* str, uint32_t hash) {
+  // Keep load factor (with removed entries) below 3/4
+  if ((used_ + 1) > size_ - (size_ >> 2)) {
+    Rehash(count_ + 1 > (size_ >> 1) ? size_ << 1 : size_);
+  }
 
-  while (space->pages_.length() != 0) {
-    pages_.Push(space->pages_.Shift());
-    size_ += pages_.tail()->value()->size_;
+  uint32_t mask = size_ - 1;
+  uint32_t index = hash & mask;
+  for (uint32_t step = 1; !IsEmpty(index); step++) {
+    index = (index + step) & mask;
   }
 
-  select(pages_.head()->value());
-  compute_size_limit();
+  if (entries_[index] == NULL) used_++;
+  entries_[index] = str;
+  count_++;
 }
 
 
-void Space::Clear() {
-  size_ = 0;
-  while (pages_.length() != 0) {
-    delete pages_.Shift();
+void StringTable::Rehash(uint32_t size) {
+  char** entries = entries_;
+  uint32_t old_size = size_;
+
+  entries_ = new char*[size];
+  memset(entries_, 0, size * sizeof(*entries_));
+  size_ = size;
+  count_ = 0;
+  used_ = 0;
+
+  for (uint32_t i = 0; i < old_size; i++) {
+    if (entries[i] == NULL || entries[i] == Tombstone()) continue;
+    Insert(entries[i], HString::CachedHash(entries[i]));
   }
+
+  delete[] entries;
 }
 
 
@@ -113,9 +854,17 @@ const char* Heap::ErrorToString(Error err) {
 
 
 char* Heap::AllocateTagged(HeapTag tag, TenureType tenure, uint32_t bytes) {
-  char* result = space(tenure)->Allocate(bytes + 8);
+  // Tag, generation and GC mark take one word (see HValue::Size())
+  bytes += HValue::kPointerSize;
+
+  bool large = LargeSpace::IsLarge(bytes);
+  char* result = large ? large_space()->Allocate(bytes) :
+                         space(tenure)->Allocate(bytes);
   intptr_t qtag = tag;
-  if (tenure == kTenureOld) {
+
+  // Large objects are young until the next new space GC, just like ones
+  // allocated by generated code
+  if (tenure == kTenureOld && !large) {
     int bit_offset = (HValue::kGenerationOffset -
                       HValue::interior_offset(0)) << 3;
     qtag = qtag | (kMinOldSpaceGeneration << bit_offset);
@@ -126,6 +875,29 @@ char* Heap::AllocateTagged(HeapTag tag, TenureType tenure, uint32_t bytes) {
 }
 
 
+void Heap::CreateRootShape() {
+  root_shape_ = HShape::New(this, HObject::NewDictionary(this), 0);
+
+  // Shapes are never collected, GC should only relocate the root
+  Reference(kRefPersistent,
+            reinterpret_cast<HValue**>(&root_shape_),
+            HValue::Cast(root_shape_));
+}
+
+
+void Heap::InvalidateGlobalCells(char* obj) {
+  GlobalCellList::Item* item = global_cells()->head();
+  for (; item != NULL; item = item->next()) {
+    if (item->value()->object() == obj) item->value()->Reset();
+  }
+}
+
+
+void Heap::ResetNumberStringCache() {
+  memset(number_strings_, 0, sizeof(number_strings_));
+}
+
+
 HValueReference* Heap::Reference(ReferenceType type,
                                  HValue** reference,
                                  HValue* value) {
@@ -149,6 +921,17 @@ void Heap::Dereference(HValue** reference, HValue* value) {
 }
 
 
+Heap::~Heap() {
+  // Values are going away with the heap, let owners of weak values (e.g.
+  // external strings) release their resources
+  HValueWeakRef* ref;
+  while ((ref = weak_references()->Shift()) != NULL) {
+    ref->callback()(ref->value());
+    delete ref;
+  }
+}
+
+
 void Heap::AddWeak(HValue* value, WeakCallback callback) {
   weak_references()->Push(new HValueWeakRef(value, callback));
 }
@@ -157,14 +940,16 @@ void Heap::AddWeak(HValue* value, WeakCallback callback) {
 void Heap::RemoveWeak(HValue* value) {
   HValueWeakRefList::Item* tail = weak_references()->tail();
   while (tail != NULL) {
+    HValueWeakRefList::Item* prev = tail->prev();
     if (tail->value()->value() == value) {
       weak_references()->Remove(tail);
     }
+    tail = prev;
   }
 }
 
 
-HValue* HValue::CopyTo(Space* old_space, Space* new_space) {
+uint32_t HValue::Size() {
   assert(!IsUnboxed(addr()));
 
   uint32_t size = kPointerSize;
@@ -178,6 +963,9 @@ HValue* HValue::CopyTo(Space* old_space, Space* new_space) {
     size += 4 * kPointerSize;
     break;
    case Heap::kTagNumber:
+    // double value
+    size += sizeof(double);
+    break;
    case Heap::kTagBoolean:
     size += kPointerSize;
     break;
@@ -190,7 +978,19 @@ HValue* HValue::CopyTo(Space* old_space, Space* new_space) {
       size += As<HString>()->length();
       break;
      case HString::kCons:
-      // + lhs + rhs + scratch_slot (for traversing)
+      // + lhs + rhs + depth
+      size += 3 * kPointerSize;
+      break;
+     case HString::kBuilder:
+      // + buffer
+      size += kPointerSize;
+      break;
+     case HString::kSliced:
+      // + parent + offset
+      size += 2 * kPointerSize;
+      break;
+     case HString::kExternal:
+      // + value + callback
       size += 2 * kPointerSize;
       break;
      default:
@@ -199,25 +999,41 @@ HValue* HValue::CopyTo(Space* old_space, Space* new_space) {
     }
     break;
    case Heap::kTagObject:
-    // mask + map
-    size += 2 * kPointerSize;
+    // mask + map + shape
+    size += 3 * kPointerSize;
     break;
    case Heap::kTagArray:
     // mask + map + length
     size += 3 * kPointerSize;
     break;
    case Heap::kTagMap:
-    // size + space ( keys + values )
-    size += (1 + (As<HMap>()->size() << 1)) * kPointerSize;
+    // size + available + space ( keys + values )
+    size += (2 + (As<HMap>()->size() << 1)) * kPointerSize;
+    break;
+   case Heap::kTagShape:
+    // keys + transitions + length + transition count + enum cache
+    size += 5 * kPointerSize;
     break;
    case Heap::kTagCData:
     // size + data
     size += kPointerSize + As<HCData>()->size();
     break;
+   case Heap::kTagFree:
+    // Free chunk's header contains it's full size
+    size = Space::FreeChunkSize(addr());
+    break;
    default:
     UNEXPECTED
   }
 
+  return size;
+}
+
+
+HValue* HValue::CopyTo(Space* old_space, Space* new_space) {
+  bool detach = HString::IsDetachable(addr());
+  uint32_t size = detach ? HString::DetachedSize(addr()) : Size();
+
   IncrementGeneration();
   char* result;
   if (Generation() >= Heap::kMinOldSpaceGeneration) {
@@ -226,7 +1042,11 @@ HValue* HValue::CopyTo(Space* old_space, Space* new_space) {
     result = new_space->Allocate(size);
   }
 
-  memcpy(result + interior_offset(0), addr() + interior_offset(0), size);
+  if (detach) {
+    HString::Detach(addr(), result);
+  } else {
+    memcpy(result + interior_offset(0), addr() + interior_offset(0), size);
+  }
 
   return HValue::Cast(result);
 }
@@ -248,6 +1068,7 @@ char* HContext::New(Heap* heap,
   char** slot = reinterpret_cast<char**>(result + GetIndexDisp(0));
   while (values->length() != 0) {
     *slot = values->Shift();
+    heap->RecordWrite(result, slot);
     slot ++;
   }
 
@@ -280,7 +1101,7 @@ char* HString::New(Heap* heap,
                    uint32_t length) {
   char* result = heap->AllocateTagged(Heap::kTagString,
                                       tenure,
-                                      length + 3 * kPointerSize);
+                                      length + 2 * kPointerSize);
 
   // Zero hash
   *reinterpret_cast<intptr_t*>(result + kHashOffset) = 0;
@@ -304,12 +1125,54 @@ char* HString::New(Heap* heap,
 }
 
 
+char* HString::NewInterned(Heap* heap, const char* value, uint32_t length) {
+  StringTable* table = heap->string_table();
+  uint32_t hash = ComputeHash(value, length);
+
+  char* result = table->Lookup(value, length, hash);
+  if (result != NULL) return result;
+
+  // Interned strings are long-living, put them in old space right away
+  result = New(heap, Heap::kTenureOld, value, length);
+  *reinterpret_cast<uint32_t*>(result + kHashOffset) = hash;
+  table->Insert(result, hash);
+
+  return result;
+}
+
+
+char* HString::NewExternal(Heap* heap,
+                           const char* value,
+                           uint32_t length,
+                           ReleaseCallback callback) {
+  char* result = New(heap, Heap::kTenureNew, 2 * kPointerSize);
+
+  SetRepresentation<Representation>(result, kExternal);
+  *reinterpret_cast<uint32_t*>(result + kLengthOffset) = length;
+  *reinterpret_cast<const char**>(result + kExternalValueOffset) = value;
+  *reinterpret_cast<ReleaseCallback*>(result + kExternalCallbackOffset) =
+      callback;
+
+  heap->AddWeak(HValue::Cast(result), ReleaseExternal);
+
+  return result;
+}
+
+
+void HString::ReleaseExternal(HValue* value) {
+  ReleaseCallback callback = ExternalCallback(value->addr());
+  if (callback == NULL) return;
+
+  callback(ExternalValue(value->addr()), Length(value->addr()));
+}
+
+
 char* HString::NewCons(Heap* heap,
                        Heap::TenureType tenure,
                        uint32_t length,
                        char* left,
                        char* right) {
-  char* result = New(heap, tenure, 2 * kPointerSize);
+  char* result = New(heap, tenure, 3 * kPointerSize);
 
   // Set representation
   SetRepresentation<Representation>(result, kCons);
@@ -321,17 +1184,173 @@ char* HString::NewCons(Heap* heap,
   *LeftConsSlot(result) = left;
   *RightConsSlot(result) = right;
 
+  // Set depth
+  uint32_t depth = Depth(left);
+  if (Depth(right) > depth) depth = Depth(right);
+  *reinterpret_cast<intptr_t*>(result + kConsDepthOffset) = depth + 1;
+
+  return result;
+}
+
+
+char* HString::Append(Heap* heap, char* lhs, char* rhs) {
+  uint32_t lhs_length = Length(lhs);
+  uint32_t length = lhs_length + Length(rhs);
+  char* buffer;
+
+  if (GetRepresentation<Representation>(lhs) == kBuilder &&
+      *reinterpret_cast<intptr_t*>(Buffer(lhs) + kBufferUsedOffset) ==
+          lhs_length &&
+      Length(Buffer(lhs)) - kPointerSize >= length) {
+    // Nothing was appended to the buffer after `lhs` - use it
+    buffer = Buffer(lhs);
+  } else {
+    // Double capacity, so appending will be amortised
+    buffer = New(heap, Heap::kTenureNew, kPointerSize + (length << 1));
+    FlattenCons(lhs, buffer + kBufferValueOffset);
+  }
+
+  FlattenCons(rhs, buffer + kBufferValueOffset + lhs_length);
+  *reinterpret_cast<intptr_t*>(buffer + kBufferUsedOffset) = length;
+
+  char* result = New(heap, Heap::kTenureNew, kPointerSize);
+  SetRepresentation<Representation>(result, kBuilder);
+  *reinterpret_cast<uint32_t*>(result + kLengthOffset) = length;
+  *BufferSlot(result) = buffer;
+
+  return result;
+}
+
+
+// Concatenation of forest's trees, NULL is an empty string
+static char* ConcatForest(Heap* heap, char* left, char* right) {
+  if (left == NULL) return right;
+  if (right == NULL) return left;
+
+  return HString::NewCons(heap,
+                          Heap::kTenureNew,
+                          HString::Length(left) + HString::Length(right),
+                          left,
+                          right);
+}
+
+
+char* HString::Rebalance(Heap* heap, char* addr) {
+  // Boehm's rebalancing: forest[i] is either NULL or a balanced tree with
+  // length in [fib(i + 2), fib(i + 3)), leaves are added from the left
+  static const int kForestSize = 45;
+  uint32_t min_length[kForestSize + 1];
+  char* forest[kForestSize];
+
+  min_length[0] = 1;
+  min_length[1] = 2;
+  for (int i = 2; i <= kForestSize; i++) {
+    min_length[i] = min_length[i - 1] + min_length[i - 2];
+  }
+  for (int i = 0; i < kForestSize; i++) forest[i] = NULL;
+
+  Iterator it(addr);
+  char* leaf;
+  while ((leaf = it.NextLeaf()) != NULL) {
+    uint32_t length = Length(leaf);
+
+    // Concatenate all trees that are shorter than leaf
+    char* prefix = NULL;
+    int i;
+    for (i = 0; i < kForestSize - 1 && length >= min_length[i + 1]; i++) {
+      if (forest[i] == NULL) continue;
+      prefix = ConcatForest(heap, forest[i], prefix);
+      forest[i] = NULL;
+    }
+
+    // And put the result into the first slot that fits it
+    char* tree = ConcatForest(heap, prefix, leaf);
+    for (;; i++) {
+      if (forest[i] != NULL) {
+        tree = ConcatForest(heap, forest[i], tree);
+        forest[i] = NULL;
+      }
+      if (i == kForestSize - 1 || Length(tree) < min_length[i + 1]) {
+        forest[i] = tree;
+        break;
+      }
+    }
+  }
+
+  char* result = NULL;
+  for (int i = 0; i < kForestSize; i++) {
+    if (forest[i] != NULL) result = ConcatForest(heap, forest[i], result);
+  }
+
+  return result == NULL ? addr : result;
+}
+
+
+char* HString::NewSlice(Heap* heap,
+                       char* addr,
+                       uint32_t offset,
+                       uint32_t length) {
+  assert(offset + length <= Length(addr));
+  if (offset == 0 && length == Length(addr)) return addr;
+
+  // Find normal or external string containing the bytes
+  char* parent = addr;
+  while (GetRepresentation<Representation>(parent) != kNormal &&
+         GetRepresentation<Representation>(parent) != kExternal) {
+    switch (GetRepresentation<Representation>(parent)) {
+     case kCons:
+      // Flattened cons keeps its value in the left slot
+      Value(heap, parent);
+      parent = LeftCons(parent);
+      break;
+     case kBuilder:
+      offset += kBufferValueOffset - kValueOffset;
+      parent = Buffer(parent);
+      break;
+     case kSliced:
+      offset += SliceOffset(parent);
+      parent = Parent(parent);
+      break;
+     default:
+      UNEXPECTED
+      break;
+    }
+  }
+
+  if (length < kMinSliceLength) {
+    return New(heap, Heap::kTenureNew, FlatValue(parent) + offset, length);
+  }
+
+  char* result = New(heap, Heap::kTenureNew, 2 * kPointerSize);
+  SetRepresentation<Representation>(result, kSliced);
+  *reinterpret_cast<uint32_t*>(result + kLengthOffset) = length;
+  *ParentSlot(result) = parent;
+  *reinterpret_cast<intptr_t*>(result + kSliceOffsetOffset) = offset;
+
   return result;
 }
 
 
+void HString::Detach(char* addr, char* result) {
+  // Header is the same, bytes are taken from parent
+  memcpy(result + interior_offset(0),
+         addr + interior_offset(0),
+         kValueOffset - interior_offset(0));
+  SetRepresentation<Representation>(result, kNormal);
+  memcpy(result + kValueOffset, FlatValue(addr), Length(addr));
+}
+
+
 char* HString::FlattenCons(char* addr, char* buffer) {
   while (addr != NULL) {
     switch (GetRepresentation<Representation>(addr)) {
      case kNormal:
+     case kBuilder:
+     case kSliced:
+     case kExternal:
       {
         uint32_t len = HString::Length(addr);
-        memcpy(buffer, addr + kValueOffset, len);
+        memcpy(buffer, FlatValue(addr), len);
         return buffer + len;
       }
      case kCons:
@@ -347,7 +1366,8 @@ char* HString::FlattenCons(char* addr, char* buffer) {
             FlattenCons(right, buffer + HString::Length(left));
             addr = left;
           } else {
-            buffer = FlattenCons(left, buffer);
+            FlattenCons(left, buffer);
+            buffer += HString::Length(left);
             addr = right;
           }
         }
@@ -366,7 +1386,10 @@ char* HString::FlattenCons(char* addr, char* buffer) {
 char* HString::Value(Heap* heap, char* addr) {
   switch (GetRepresentation<Representation>(addr)) {
    case kNormal:
-    return addr + kValueOffset;
+   case kBuilder:
+   case kSliced:
+   case kExternal:
+    return FlatValue(addr);
    case kCons:
     if (RightCons(addr) == HNil::New()) {
       // Return cached left if right is null
@@ -383,6 +1406,7 @@ char* HString::Value(Heap* heap, char* addr) {
 
       *RightConsSlot(addr) = HNil::New();
       *LeftConsSlot(addr) = result;
+      heap->RecordWrite(addr, LeftConsSlot(addr));
 
       return value;
     }
@@ -396,26 +1420,146 @@ char* HString::Value(Heap* heap, char* addr) {
 uint32_t HString::Hash(Heap* heap, char* addr) {
   uint32_t* hash_addr = reinterpret_cast<uint32_t*>(addr + kHashOffset);
   uint32_t hash = *hash_addr;
-  if (hash == 0) {
-    hash = ComputeHash(Value(heap, addr), Length(addr));
-    *hash_addr = hash;
+  if (hash != 0) return hash;
+
+  if (GetRepresentation<Representation>(addr) != kCons) {
+    hash = ComputeHash(FlatValue(addr), Length(addr));
+  } else {
+    StringHasher hasher(Length(addr));
+    Iterator it(addr);
+
+    const char* chunk;
+    uint32_t length;
+    while (it.Next(&chunk, &length)) hasher.Update(chunk, length);
+
+    hash = hasher.Finish();
   }
+  *hash_addr = hash;
+
   return hash;
 }
 
 
+int HString::Compare(char* lhs, char* rhs) {
+  if (GetRepresentation<Representation>(lhs) != kCons &&
+      GetRepresentation<Representation>(rhs) != kCons) {
+    return memcmp(FlatValue(lhs), FlatValue(rhs), Length(lhs));
+  }
+
+  // Compare leaves of both strings chunk by chunk
+  Iterator lit(lhs);
+  Iterator rit(rhs);
+  const char* lchunk = NULL;
+  const char* rchunk = NULL;
+  uint32_t llength = 0;
+  uint32_t rlength = 0;
+
+  while (true) {
+    if (llength == 0 && !lit.Next(&lchunk, &llength)) return 0;
+    if (rlength == 0 && !rit.Next(&rchunk, &rlength)) return 0;
+
+    uint32_t length = llength < rlength ? llength : rlength;
+    int result = memcmp(lchunk, rchunk, length);
+    if (result != 0) return result;
+
+    lchunk += length;
+    rchunk += length;
+    llength -= length;
+    rlength -= length;
+  }
+}
+
+
+HString::Iterator::Iterator(char* addr) : stack_(inline_stack_),
+                                          depth_(0),
+                                          capacity_(kInlineDepth) {
+  Push(addr);
+}
+
+
+HString::Iterator::~Iterator() {
+  if (stack_ != inline_stack_) delete[] stack_;
+}
+
+
+void HString::Iterator::Push(char* addr) {
+  if (depth_ == capacity_) {
+    char** stack = new char*[capacity_ << 1];
+    memcpy(stack, stack_, capacity_ * sizeof(*stack));
+    if (stack_ != inline_stack_) delete[] stack_;
+
+    stack_ = stack;
+    capacity_ <<= 1;
+  }
+  stack_[depth_++] = addr;
+}
+
+
+char* HString::Iterator::NextLeaf() {
+  while (depth_ > 0) {
+    char* addr = stack_[--depth_];
+
+    switch (GetRepresentation<Representation>(addr)) {
+     case kNormal:
+     case kBuilder:
+     case kSliced:
+     case kExternal:
+      if (Length(addr) == 0) continue;
+      return addr;
+     case kCons:
+      // Right is nil if cons was already flattened into left
+      if (RightCons(addr) != HNil::New()) Push(RightCons(addr));
+      Push(LeftCons(addr));
+      break;
+     default:
+      UNEXPECTED
+    }
+  }
+
+  return NULL;
+}
+
+
+bool HString::Iterator::Next(const char** chunk, uint32_t* length) {
+  char* leaf = NextLeaf();
+  if (leaf == NULL) return false;
+
+  *chunk = FlatValue(leaf);
+  *length = Length(leaf);
+
+  return true;
+}
+
+
 char* HObject::NewEmpty(Heap* heap) {
+  static const uint32_t size = kMinShapedSize;
+
   char* obj = heap->AllocateTagged(Heap::kTagObject,
                                    Heap::kTenureNew,
-                                   2 * kPointerSize);
+                                   3 * kPointerSize);
+
+  // Map of shaped object contains only values
+  *reinterpret_cast<intptr_t*>(obj + kMaskOffset) = (size - 1) * kPointerSize;
+  *reinterpret_cast<char**>(obj + kMapOffset) = HMap::NewEmpty(heap, size >> 1);
+  *reinterpret_cast<char**>(obj + kShapeOffset) = heap->root_shape();
+
+  return obj;
+}
+
+
+char* HObject::NewDictionary(Heap* heap) {
+  char* obj = heap->AllocateTagged(Heap::kTagObject,
+                                   Heap::kTenureNew,
+                                   3 * kPointerSize);
   HObject::Init(heap, obj);
+  *reinterpret_cast<char**>(obj + kShapeOffset) = HNil::New();
 
   return obj;
 }
 
 
 void HObject::Init(Heap* heap, char* obj) {
-  static const uint32_t size = 16;
+  static const uint32_t size = kMinDictionarySize;
 
   // Set mask
   *reinterpret_cast<intptr_t*>(obj + kMaskOffset) = (size - 1) * kPointerSize;
@@ -424,9 +1568,62 @@ void HObject::Init(Heap* heap, char* obj) {
 }
 
 
+void HObject::Normalize(Heap* heap, char* obj) {
+  char* shape = Shape(obj);
+  HMap* values = HValue::As<HMap>(Map(obj));
+  HMap* keys = HValue::As<HMap>(Map(HShape::Keys(shape)));
+
+  // Leave enough free slots for lookups to terminate
+  uint32_t size = PowerOfTwo((HShape::Length(shape) + 1) << 1);
+  if (size < kMinDictionarySize) size = kMinDictionarySize;
+
+  *reinterpret_cast<intptr_t*>(obj + kMaskOffset) = (size - 1) * kPointerSize;
+  *MapSlot(obj) = HMap::NewEmpty(heap, size);
+  heap->RecordWrite(obj, MapSlot(obj));
+  *ShapeSlot(obj) = HNil::New();
+
+  // Insert properties into dictionary
+  uint32_t keys_size = keys->size();
+  for (uint32_t i = 0; i < keys_size; i++) {
+    int64_t index = HShape::KeyIndex(shape, keys, i);
+    if (index == -1) continue;
+
+    char* value = *values->GetSlotAddress(index);
+    if (value == HNil::New()) continue;
+
+    *LookupProperty(heap, obj, *keys->GetSlotAddress(i), 1) = value;
+  }
+}
+
+
 char** HObject::LookupProperty(Heap* heap, char* addr, char* key, int insert) {
   intptr_t offset = RuntimeLookupProperty(heap, addr, key, insert);
-  return reinterpret_cast<char**>(HObject::Map(addr) + offset);
+
+  // Any value might be stored into returned slot
+  if (insert) {
+    if (HMap::HasDoubles(Map(addr))) HArray::BoxElements(heap, addr);
+    SetRepresentation<HMap::Representation>(Map(addr), HMap::kGeneric);
+  }
+
+  // Missing property (offset is nil) is nil
+  if (offset == Heap::kTagNil) {
+    static char* nil_slot;
+    nil_slot = HNil::New();
+    return &nil_slot;
+  }
+
+  char** slot = reinterpret_cast<char**>(HObject::Map(addr) + offset);
+
+  // Raw double is boxed for reading
+  if (HMap::HasDoubles(Map(addr)) && *slot != HNil::New()) {
+    static char* number_slot;
+    number_slot = HNumber::New(heap,
+                               Heap::kTenureNew,
+                               *reinterpret_cast<double*>(slot));
+    return &number_slot;
+  }
+
+  return slot;
 }
 
 
@@ -435,7 +1632,10 @@ char* HArray::NewEmpty(Heap* heap) {
                                    Heap::kTenureNew,
                                    3 * kPointerSize);
 
-  HObject::Init(heap, obj);
+  // Dense array's map holds `kMinCapacity` values in both halves
+  *reinterpret_cast<intptr_t*>(obj + kMaskOffset) =
+      (kMinCapacity - 1) * kPointerSize;
+  *MapSlot(obj) = HMap::NewEmpty(heap, kMinCapacity >> 1);
 
   // Set length
   SetLength(obj, 0);
@@ -444,10 +1644,69 @@ char* HArray::NewEmpty(Heap* heap) {
 }
 
 
+void HArray::MakeSparse(Heap* heap, char* obj) {
+  if (HMap::HasDoubles(Map(obj))) BoxElements(heap, obj);
+
+  HMap* elements = HValue::As<HMap>(Map(obj));
+  uint32_t capacity = Capacity(obj);
+
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < capacity; i++) {
+    if (!elements->IsEmptySlot(i)) count++;
+  }
+
+  // Leave enough free slots for lookups to terminate
+  uint32_t size = PowerOfTwo((count + 1) << 1);
+  if (size < kMinDictionarySize) size = kMinDictionarySize;
+
+  *reinterpret_cast<intptr_t*>(obj + kMaskOffset) = (size - 1) * kPointerSize;
+  *MapSlot(obj) = HMap::NewEmpty(heap, size);
+  heap->RecordWrite(obj, MapSlot(obj));
+  SetRepresentation<Representation>(obj, kSparse);
+
+  // Insert elements into hashmap
+  for (uint32_t i = 0; i < capacity; i++) {
+    char* value = *elements->GetSlotAddress(i);
+    if (value == HNil::New()) continue;
+
+    *LookupProperty(heap, obj, HNumber::ToPointer(i), 1) = value;
+  }
+}
+
+
+void HArray::BoxElements(Heap* heap, char* obj) {
+  char* map = Map(obj);
+  HMap* elements = HValue::As<HMap>(map);
+  uint32_t capacity = Capacity(obj);
+
+  for (uint32_t i = 0; i < capacity; i++) {
+    char** slot = elements->GetSlotAddress(i);
+    if (*slot == HNil::New()) continue;
+
+    *slot = HNumber::New(heap,
+                         Heap::kTenureNew,
+                         *reinterpret_cast<double*>(slot));
+    heap->RecordWrite(map, slot);
+  }
+
+  SetRepresentation<HMap::Representation>(map, HMap::kGeneric);
+}
+
+
 int64_t HArray::Length(char* obj, bool shrink) {
   int64_t result = *reinterpret_cast<int64_t*>(obj + kLengthOffset);
 
-  if (shrink) {
+  // Dense elements are below length, trailing nils are checked in place
+  if (shrink && IsDense(obj)) {
+    char** space = reinterpret_cast<char**>(Map(obj) + HMap::kSpaceOffset);
+    int64_t shrinked = result;
+    while (shrinked > 0 && space[shrinked - 1] == HNil::New()) shrinked--;
+
+    if (shrinked != result) {
+      result = shrinked;
+      SetLength(obj, result);
+    }
+  } else if (shrink) {
     // Lookup property at [length - 1]
     // Shrink if it's nil
     //
@@ -477,10 +1736,11 @@ int64_t HArray::Length(char* obj, bool shrink) {
 char* HMap::NewEmpty(Heap* heap, uint32_t size) {
   char* map = heap->AllocateTagged(Heap::kTagMap,
                                    Heap::kTenureNew,
-                                   ((size << 1) + 1) * kPointerSize);
+                                   ((size << 1) + 2) * kPointerSize);
 
   // Set map's size
   *reinterpret_cast<intptr_t*>(map + kSizeOffset) = size;
+  *AvailableSlot(map) = MaxLoad(size);
 
   // Nullify all map's slots (both keys and values)
   size = (size << 1) * kPointerSize;
@@ -493,6 +1753,91 @@ char* HMap::NewEmpty(Heap* heap, uint32_t size) {
 }
 
 
+char* HShape::New(Heap* heap, char* keys, int64_t length) {
+  // Shapes are long-living
+  char* shape = heap->AllocateTagged(Heap::kTagShape,
+                                     Heap::kTenureOld,
+                                     5 * kPointerSize);
+
+  *KeysSlot(shape) = keys;
+  heap->RecordWrite(shape, KeysSlot(shape));
+  *TransitionsSlot(shape) = HNil::New();
+  *LengthSlot(shape) = length;
+  *TransitionCountSlot(shape) = 0;
+  *EnumCacheSlot(shape) = HNil::New();
+  heap->shape_count(heap->shape_count() + 1);
+
+  return shape;
+}
+
+
+char* HShape::Transition(Heap* heap, char* shape, char* key) {
+  // Only string keys are shared between objects
+  if (HValue::IsUnboxed(key) ||
+      key == HNil::New() ||
+      HValue::GetTag(key) != Heap::kTagString) {
+    return NULL;
+  }
+  if (Length(shape) >= kMaxLength) return NULL;
+
+  char* transitions = Transitions(shape);
+  if (transitions != HNil::New()) {
+    char* child = *HObject::LookupProperty(heap, transitions, key, 0);
+    if (child != HNil::New()) return child;
+  }
+
+  if (TransitionCount(shape) >= kMaxTransitions) return NULL;
+  if (heap->shape_count() >= kMaxShapes) return NULL;
+
+  if (transitions == HNil::New()) {
+    transitions = HObject::NewDictionary(heap);
+    *TransitionsSlot(shape) = transitions;
+    heap->RecordWrite(shape, TransitionsSlot(shape));
+  }
+
+  // Child has all parent's keys and the new one. Parent's keys are reused
+  // unless some other child has already appended to them (keys are never
+  // deleted, so number of them is a number of taken slots).
+  int64_t length = Length(shape);
+  char* keys = Keys(shape);
+  HMap* keys_map = HValue::As<HMap>(HObject::Map(keys));
+  int64_t count = HMap::MaxLoad(keys_map->size()) - *keys_map->available_slot();
+  if (count != length) {
+    char* own_keys = HObject::NewDictionary(heap);
+    for (uint32_t i = 0; i < keys_map->size(); i++) {
+      int64_t index = KeyIndex(shape, keys_map, i);
+      if (index == -1) continue;
+
+      char* own_key = *keys_map->GetSlotAddress(i);
+      *HObject::LookupProperty(heap, own_keys, own_key, 1) =
+          HNumber::ToPointer(index);
+    }
+    keys = own_keys;
+  }
+
+  *HObject::LookupProperty(heap, keys, key, 1) = HNumber::ToPointer(length);
+
+  char* child = New(heap, keys, length + 1);
+
+  char** slot = HObject::LookupProperty(heap, transitions, key, 1);
+  *slot = child;
+  heap->RecordWrite(HObject::Map(transitions), slot);
+  *TransitionCountSlot(shape) += 1;
+
+  return child;
+}
+
+
+int64_t HShape::IndexOf(Heap* heap, char* shape, char* key) {
+  char* index = *HObject::LookupProperty(heap, Keys(shape), key, 0);
+  if (index == HNil::New()) return -1;
+
+  // Key of descendant
+  int64_t result = HNumber::IntegralValue(index);
+  return result < Length(shape) ? result : -1;
+}
+
+
 char* HFunction::New(Heap* heap, char* parent, char* addr, char* root) {
   char* fn = heap->AllocateTagged(Heap::kTagFunction,
                                   Heap::kTenureOld,
@@ -510,6 +1855,9 @@ char* HFunction::New(Heap* heap, char* parent, char* addr, char* root) {
   // Set argc
   *reinterpret_cast<char**>(fn + kArgcOffset) = NULL;
 
+  heap->RecordWrite(fn, reinterpret_cast<char**>(fn + kParentOffset));
+  heap->RecordWrite(fn, reinterpret_cast<char**>(fn + kRootOffset));
+
   return fn;
 }
 
@@ -2,10 +2,11 @@
 #define _SRC_HEAP_H_
 
 //
-// Heap is split into two parts:
+// Heap is split into three parts:
 //
 //  * new space - all objects will be allocated here
 //  * old space - tenured objects will be placed here
+//  * large space - objects that are too big to be copied by GC
 //
 // Both spaces are lists of allocated buffers(pages) with a stack structure
 //
@@ -13,11 +14,14 @@
 #include "zone.h" // ZoneObject
 #include "gc.h" // GC
 #include "source-map.h" // SourceMap
+#include "stack-map.h" // StackMap
+#include "ic.h" // PropertyICList, GlobalCellList
 #include "utils.h"
 
 #include <stdint.h> // uint32_t
 #include <unistd.h> // intptr_t
 #include <sys/types.h> // size_t
+#include <pthread.h> // pthread_t, pthread_mutex_t, pthread_cond_t
 
 namespace candor {
 namespace internal {
@@ -29,27 +33,78 @@ class HValueWeakRef;
 
 class Space {
  public:
+  // Pages are mapped at kPageAlignment and start with the page object itself
+  // (followed by mark bitmap), so the page of any object and space it
+  // belongs to could be found by masking object's address
+  // (see FromAddress()). Objects that don't fit into the regular page are
+  // placed alone in large pages, to keep their address within the first
+  // kPageAlignment bytes of the mapping.
   class Page {
    public:
-    Page(uint32_t size) : size_(size) {
-      data_ = new char[size];
+    static Page* New(uint32_t size);
+    static void Delete(Page* page);
+
+    static inline Page* FromAddress(char* addr) {
+      intptr_t page = reinterpret_cast<intptr_t>(addr) & ~(kPageAlignment - 1);
+      return reinterpret_cast<Page*>(page);
+    }
+
+    // Make page empty (used when reusing pooled page)
+    inline void Reset() {
       // Make all offsets odd (pointers are tagged with 1 at last bit)
       top_ = data_ + 1;
-      limit_ = data_ + size;
+      limit_ = start() + size_;
+      memset(bitmap_, 0, bitmap_size_);
     }
-    ~Page() {
-      delete[] data_;
+
+    // Returns true if `addr` belongs to this page
+    inline bool Contains(char* addr) {
+      return addr > data_ && addr < limit_;
     }
 
+    // Set mark bit for object at `addr`, returns false if it was already set
+    inline bool Mark(char* addr);
+    inline bool IsMarked(char* addr);
+
+    // Mapping with the page object in it
+    inline char* start() { return reinterpret_cast<char*>(this); }
+
+    // One mark bit per every pointer-sized word
+    static uint32_t BitmapSize(uint32_t size);
+
+    // Page object and mark bitmap
+    static uint32_t HeaderSize(uint32_t size);
+
+    // NULL if page isn't used by any space
+    inline Space* owner() { return owner_; }
+    inline void owner(Space* owner) { owner_ = owner; }
+
+    // Granularity of mark bitmap (bytes per bit * bits per byte), bit index
+    // is computed in HValue::kPointerSize units (see Mark())
+    static const uint32_t kBitmapGranularity;
+
+    // Should be a power of two and not less than heap's page size
+    static const intptr_t kPageAlignment = 2 * 1024 * 1024;
+
+    Space* owner_;
+
     char* data_;
     char* top_;
     char* limit_;
     uint32_t size_;
+
+    uint8_t* bitmap_;
+    uint32_t bitmap_size_;
+
+   private:
+    Page(uint32_t size);
   };
 
   Space(Heap* heap, uint32_t page_size);
+  ~Space();
 
-  // Adds empty page of specific size
+  // Adds empty page with at least `size` free bytes in it (regular one, if
+  // `size` fits into it)
   void AddPage(uint32_t size);
 
   // Move to next page where are at least `bytes` free
@@ -62,6 +117,55 @@ class Space {
   // Remove all pages
   void Clear();
 
+  // Mark-sweep support (old space only):
+  //
+  // Mark() sets mark bit of object (returns false if it was already marked
+  // or if object doesn't belong to this space),
+  // Sweep() hands all pages to the heap's sweeper thread and continues
+  // allocation in a fresh page, SweepPages() (called by sweeper) turns all
+  // unmarked objects into free chunks and releases empty pages,
+  // FinishSweeping() waits for sweeper and takes swept pages and free chunks
+  // back (it's also called by Allocate() once sweeper is done).
+  bool Mark(HValue* value);
+  bool IsMarked(HValue* value);
+  void Sweep();
+  void SweepPages();
+  void FinishSweeping();
+
+  inline bool is_sweeping() { return sweeping_; }
+
+  // True if heap object `value` belongs to this space
+  inline bool Contains(HValue* value);
+
+  // True if `slot` belongs to a marked object
+  bool IsMarkedSlot(char** slot);
+
+  // Free chunks are formatted as:
+  //   [tag = kTagFree, uint32 size at kFreeSizeOffset] [next chunk]
+  // (the last field is present only in chunks of kMinFreeChunk bytes or more)
+  static void CreateFreeChunk(char* addr, uint32_t size);
+  static inline uint32_t FreeChunkSize(char* addr) {
+    return *reinterpret_cast<uint32_t*>(addr + kFreeSizeOffset);
+  }
+  static inline char** FreeChunkNext(char* addr) {
+    return reinterpret_cast<char**>(addr + kFreeNextOffset);
+  }
+
+  // Put chunk into free lists (used by sweeper and by GC to return unused
+  // tails of allocation buffers)
+  void AddFreeChunk(char* addr, uint32_t size);
+
+  // Returns false if chunk is too small to be put into the list
+  static bool PushFreeChunk(char** lists, char* addr, uint32_t size);
+
+  static const int kFreeSizeOffset = 3;
+  static const int kFreeNextOffset = 7;
+  static const uint32_t kMinFreeChunk = 16;
+
+  // Free lists are segregated by size: list `i` contains chunks of
+  // [2 ^ (i + 4), 2 ^ (i + 5)) bytes
+  static const int kFreeListCount = 16;
+
   inline Heap* heap() { return heap_; }
 
   // Both top and limit are always pointing to current page's
@@ -71,25 +175,240 @@ class Space {
 
   inline uint32_t page_size() { return page_size_; }
 
+  // Total number of bytes ever allocated in this space
+  // (incremented by both Allocate() and AllocateStub's fast path)
+  inline uint64_t allocated() { return allocated_; }
+  inline uint64_t* allocated_addr() { return &allocated_; }
+
   inline uint32_t size() { return size_; }
   inline uint32_t size_limit() { return size_limit_; }
   inline void compute_size_limit() {
     size_limit_ = size_ << 1;
   }
 
+  // Statistics of the last Sweep()
+  inline uint32_t live_size() { return live_size_; }
+  inline uint32_t free_size() { return free_size_; }
+
  protected:
   Heap* heap_;
 
   char** top_;
   char** limit_;
 
+  // Used by LargeSpace, space is created without pages
+  explicit Space(Heap* heap);
+
+  // Ask for GC of this space, because it has grown over the limit
+  void RequestGC();
+
   inline void select(Page* page);
 
+  char* AllocateFromFreeList(uint32_t bytes);
+  void ClearFreeLists();
+  static int FreeListIndex(uint32_t size);
+
   List<Page*, EmptyClass> pages_;
   uint32_t page_size_;
 
   uint32_t size_;
   uint32_t size_limit_;
+
+  uint64_t allocated_;
+
+  char* free_lists_[kFreeListCount];
+  uint32_t live_size_;
+  uint32_t free_size_;
+
+  // Pages and results of background sweeping
+  // (owned by sweeper thread while sweeping_ is true)
+  bool sweeping_;
+  List<Page*, EmptyClass> swept_pages_;
+  char* swept_lists_[kFreeListCount];
+  uint32_t swept_live_size_;
+  uint32_t swept_free_size_;
+  uint32_t swept_released_size_;
+};
+
+// Non-moving space for large objects, every one of them has it's own page.
+// Objects are never copied by GC: old space GC marks them in place and
+// releases pages of dead ones. Large objects are allocated young (with zero
+// generation, so they're filled without write barrier) and are visited as
+// roots only by the first new space GC, which makes them old. Writes into
+// old large objects are recorded by write barrier, just like ones into old
+// space objects.
+class LargeSpace : public Space {
+ public:
+  LargeSpace(Heap* heap);
+  ~LargeSpace();
+
+  char* Allocate(uint32_t bytes);
+
+  // Release pages of unmarked objects and reset marks of others
+  void Sweep();
+
+  // Pages of objects allocated since the last new space GC
+  inline List<Page*, EmptyClass>* young_pages() { return &young_pages_; }
+
+  // Objects bigger than threshold (including header) are allocated here
+  static inline bool IsLarge(uint32_t bytes) { return bytes > kThreshold; }
+
+  static inline char* Object(Page* page) { return page->data_ + 1; }
+  inline List<Page*, EmptyClass>* pages() { return &pages_; }
+
+  static const uint32_t kThreshold = 128 * 1024;
+  static const uint32_t kMinSizeLimit = 16 * 1024 * 1024;
+
+ protected:
+  List<Page*, EmptyClass> young_pages_;
+};
+
+// Background thread of the heap, it sweeps old space and releases memory
+// of dead pages. Released pages of regular size are returned to the OS with
+// madvise() and are kept in a small pool for reuse by spaces.
+// Sweeper also keeps index of all heap's pages.
+class Sweeper {
+ public:
+  Sweeper(uint32_t page_size);
+  ~Sweeper();
+
+  // Take page from the pool, or allocate new one
+  Space::Page* AllocatePage(uint32_t size);
+
+  // Page is pooled or deleted in background
+  void Release(Space::Page* page);
+
+  // Snapshot pages used by spaces for FindPage(). Until Unfreeze() released
+  // pages are neither deleted nor pooled, so snapshot stays valid while GC
+  // allocates pages and background sweeper releases them.
+  void Freeze();
+  void Unfreeze();
+
+  // Returns page from the snapshot that contains `addr` (which may point
+  // anywhere, unlike argument of Space::Page::FromAddress()) or NULL if
+  // there're no such page. Doesn't lock, should be called only while frozen.
+  Space::Page* FindPage(char* addr);
+
+  // Call space->SweepPages() in background
+  void Sweep(Space* space);
+  bool IsDone(Space* space);
+  void Wait(Space* space);
+
+  // Return page-aligned part of [start, end) to the OS
+  static void Discard(char* start, char* end);
+
+  static const int kMaxPoolSize = 4;
+  static const uint32_t kInitialIndexSize = 16;
+
+ protected:
+  static void* ThreadMain(void* sweeper);
+  void Loop();
+
+  // Should be called with lock held
+  void AddToIndex(Space::Page* page);
+  void RemoveFromIndex(Space::Page* page);
+
+  uint32_t page_size_;
+
+  pthread_t thread_;
+  pthread_mutex_t lock_;
+  pthread_cond_t cond_;
+  bool stop_;
+
+  // Space queued for sweeping (or being swept)
+  Space* space_;
+  List<Space::Page*, EmptyClass> released_;
+  List<Space::Page*, EmptyClass> pool_;
+
+  // All pages sorted by address
+  Space::Page** index_;
+  uint32_t index_length_;
+  uint32_t index_size_;
+
+  // Used pages at the time of Freeze(), sorted by address
+  bool frozen_;
+  Space::Page** frozen_index_;
+  uint32_t frozen_length_;
+  uint32_t frozen_size_;
+};
+
+// Remembered set: addresses of slots in old space objects that may contain
+// pointers to new space objects. Filled by write barrier and used by
+// new space GC as an additional set of roots.
+class StoreBuffer {
+ public:
+  StoreBuffer();
+  ~StoreBuffer();
+
+  inline void Record(char** slot) {
+    if (top_ >= limit_) Overflow();
+    *top_++ = slot;
+  }
+
+  // Sort entries and remove duplicates
+  void Compact();
+
+  inline void Clear() { top_ = start_; }
+
+  inline char*** start() { return start_; }
+  inline uint32_t length() { return top_ - start_; }
+
+  // Used by RecordWriteStub's fast path
+  inline char**** top() { return &top_; }
+  inline char**** limit() { return &limit_; }
+
+  static const uint32_t kInitialSize = 1024;
+
+ protected:
+  // Compact entries and grow buffer if it's still more than half full
+  void Overflow();
+
+  char*** start_;
+  char*** top_;
+  char*** limit_;
+  uint32_t size_;
+};
+
+// Interned strings (see HString::NewInterned), open-addressing hashtable
+// keyed by string contents. Entries are weak: old space GC removes dead
+// strings and updates moved ones (see GC::HandleStringTable()).
+class StringTable {
+ public:
+  StringTable();
+  ~StringTable();
+
+  // NULL if no string with such contents was interned
+  char* Lookup(const char* value, uint32_t length, uint32_t hash);
+  void Insert(char* str, uint32_t hash);
+
+  inline void Remove(uint32_t index) {
+    entries_[index] = Tombstone();
+    count_--;
+  }
+
+  // True for both empty and removed entries
+  inline bool IsEmpty(uint32_t index) {
+    return entries_[index] == NULL || entries_[index] == Tombstone();
+  }
+
+  inline char** GetSlotAddress(uint32_t index) { return &entries_[index]; }
+  inline uint32_t size() { return size_; }
+  inline uint32_t count() { return count_; }
+
+  static const uint32_t kInitialSize = 256;
+
+ protected:
+  static inline char* Tombstone() { return reinterpret_cast<char*>(1); }
+
+  // Rehash into the table of `size` entries, dropping tombstones
+  void Rehash(uint32_t size);
+
+  char** entries_;
+  uint32_t size_;
+
+  // Live entries, and live and removed ones
+  uint32_t count_;
+  uint32_t used_;
 };
 
 typedef List<HValueReference*, EmptyClass> HValueRefList;
@@ -110,7 +429,11 @@ class Heap {
     kTagFunction,
     kTagCData,
 
-    kTagMap
+    kTagMap,
+    kTagShape,
+
+    // Filler for freed memory in old space
+    kTagFree
   };
 
   enum TenureType {
@@ -157,15 +480,21 @@ class Heap {
   static const uint32_t kBindingContextTag = 0x0DEC0DEC;
   static const uint32_t kEnterFrameTag = 0xFEEDBEEE;
 
-  Heap(uint32_t page_size) : new_space_(this, page_size),
+  Heap(uint32_t page_size) : sweeper_(page_size),
+                             new_space_(this, page_size),
                              old_space_(this, page_size),
+                             large_space_(this),
                              last_stack_(NULL),
                              last_frame_(NULL),
                              pending_exception_(NULL),
+                             shape_count_(0),
                              needs_gc_(kGCNone),
                              gc_(this) {
     current_ = this;
+    CreateRootShape();
+    ResetNumberStringCache();
   }
+  ~Heap();
 
   // TODO: Use thread id
   static inline Heap* Current() { return current_; }
@@ -186,8 +515,25 @@ class Heap {
   void AddWeak(HValue* value, WeakCallback callback);
   void RemoveWeak(HValue* value);
 
+  // Write barrier: remember `slot` of `obj` if it is an old (old space or
+  // large) object referencing a new space value (or grey the old space or
+  // large value if incremental marking is in progress)
+  inline void RecordWrite(char* obj, char** slot);
+
   inline Space* new_space() { return &new_space_; }
   inline Space* old_space() { return &old_space_; }
+  inline LargeSpace* large_space() { return &large_space_; }
+
+  // Shape of empty objects, root of the shape transition tree
+  inline char* root_shape() { return root_shape_; }
+  inline char** root_shape_slot() { return &root_shape_; }
+
+  // Interned strings (see HString::NewInterned)
+  inline StringTable* string_table() { return &string_table_; }
+
+  // Number of created shapes (see HShape::kMaxShapes)
+  inline uint32_t shape_count() { return shape_count_; }
+  inline void shape_count(uint32_t value) { shape_count_ = value; }
 
   inline Space* space(TenureType type) {
     if (type == kTenureOld) {
@@ -211,17 +557,49 @@ class Heap {
   inline HValueWeakRefList* weak_references() { return &weak_references_; }
 
   inline GC* gc() { return &gc_; }
+  inline Sweeper* sweeper() { return &sweeper_; }
+  inline StoreBuffer* store_buffer() { return &store_buffer_; }
   inline SourceMap* source_map() { return &source_map_; }
+  inline StackMap* stack_map() { return &stack_map_; }
+  inline PropertyICList* ics() { return &ics_; }
+
+  inline GlobalCellList* global_cells() { return &global_cells_; }
+
+  // Forget cached global properties of `obj`
+  void InvalidateGlobalCells(char* obj);
+
+  // Strings of recently converted integral numbers (see RuntimeToString),
+  // NULL if number isn't in the cache
+  inline char* GetNumberString(int64_t number);
+  inline void SetNumberString(int64_t number, char* string);
+
+  void ResetNumberStringCache();
+
+  // Strings are weak, GC relocates or clears them
+  // (see GC::HandleNumberStringCache)
+  inline char** number_string_slot(uint32_t index) {
+    return &number_strings_[index].string;
+  }
+
+  static const uint32_t kNumberStringCacheSize = 1024;
 
  private:
+  void CreateRootShape();
+
+  // Should outlive spaces
+  Sweeper sweeper_;
+
   Space new_space_;
   Space old_space_;
+  LargeSpace large_space_;
 
   // Support reentering candor after invoking C++ side
   char* last_stack_;
   char* last_frame_;
 
   char* pending_exception_;
+  char* root_shape_;
+  uint32_t shape_count_;
 
   intptr_t needs_gc_;
 
@@ -230,7 +608,19 @@ class Heap {
   HValueWeakRefList weak_references_;
 
   GC gc_;
+  StoreBuffer store_buffer_;
+  StringTable string_table_;
   SourceMap source_map_;
+  StackMap stack_map_;
+  PropertyICList ics_;
+  GlobalCellList global_cells_;
+
+  struct NumberStringEntry {
+    int64_t number;
+    char* string;
+  };
+
+  NumberStringEntry number_strings_[kNumberStringCacheSize];
 
   static Heap* current_;
 };
@@ -260,15 +650,25 @@ class HValue {
 
   HValue* CopyTo(Space* old_space, Space* new_space);
 
+  // Size of object in bytes (including header)
+  uint32_t Size();
+
   inline bool IsGCMarked();
   inline char* GetGCMark();
   inline void SetGCMark(char* new_addr);
 
+  // Parallel scavenge: ClaimGCMark() returns true if calling thread should
+  // copy object (false if it was already copied by other thread),
+  // PublishGCMark() sets forwarding address after copying
+  inline bool ClaimGCMark();
+  inline void PublishGCMark(char* new_addr);
+
   inline bool IsSoftGCMarked();
   inline void SetSoftGCMark();
   inline void ResetSoftGCMark();
 
   inline void IncrementGeneration();
+  inline void SetGeneration(uint8_t generation);
   inline uint8_t Generation();
 
   template <typename Representation>
@@ -421,13 +821,30 @@ class HBoolean : public HValue {
 };
 
 
+// Strings are either:
+//
+//  * normal - bytes follow the header
+//  * cons - concatenation of two strings (flattened on demand into the left
+//    one), tracks depth of the tree and is rebalanced when it gets too deep
+//  * builder - prefix of growable buffer (flat string that starts with the
+//    number of bytes used in it), appending to the builder that ends at the
+//    end of used bytes writes into the buffer in place
+//  * sliced - substring of normal or external string (parent), slices that
+//    are much shorter than parent are copied out of it once they survive GC
+//  * external - bytes are owned by embedder, release callback is called
+//    (through heap's weak references) once string dies
 class HString : public HValue {
  public:
   enum Representation {
-    kNormal = 0x00,
-    kCons   = 0x01
+    kNormal   = 0x00,
+    kCons     = 0x01,
+    kBuilder  = 0x02,
+    kSliced   = 0x03,
+    kExternal = 0x04
   };
 
+  typedef void (*ReleaseCallback)(const char* value, uint32_t length);
+
   static char* New(Heap* heap,
                    Heap::TenureType tenure,
                    uint32_t length);
@@ -435,15 +852,73 @@ class HString : public HValue {
                    Heap::TenureType tenure,
                    const char* value,
                    uint32_t length);
+
+  // Returns the only old space copy of string with given contents (with
+  // precomputed hash), comparing such strings is a pointer comparison.
+  // Interned string is collected when nothing else references it.
+  static char* NewInterned(Heap* heap, const char* value, uint32_t length);
+
+  // Bytes aren't copied, they should stay valid until `callback` is called
+  static char* NewExternal(Heap* heap,
+                           const char* value,
+                           uint32_t length,
+                           ReleaseCallback callback);
+
   static char* NewCons(Heap* heap,
                        Heap::TenureType tenure,
                        uint32_t length,
                        char* left,
                        char* right);
 
+  // Returns builder with contents of both strings, `lhs` buffer is reused if
+  // it is a builder that has room for `rhs`
+  static char* Append(Heap* heap, char* lhs, char* rhs);
+
+  // Returns balanced cons tree with the same leaves
+  static char* Rebalance(Heap* heap, char* addr);
+
+  // Returns `length` bytes of string starting at `offset`, without copying
+  // them unless slice is short
+  static char* NewSlice(Heap* heap,
+                        char* addr,
+                        uint32_t offset,
+                        uint32_t length);
+
+  // GC copies detachable slices into a normal string (of DetachedSize())
+  static inline bool IsDetachable(char* addr);
+  static inline uint32_t DetachedSize(char* addr);
+  static void Detach(char* addr, char* result);
+
+  // Visits flat parts of (possibly cons) string from left to right, without
+  // flattening it.
+  class Iterator {
+   public:
+    Iterator(char* addr);
+    ~Iterator();
+
+    // Returns NULL when whole string was visited
+    char* NextLeaf();
+
+    // Returns false when whole string was visited
+    bool Next(const char** chunk, uint32_t* length);
+
+   private:
+    void Push(char* addr);
+
+    static const uint32_t kInlineDepth = 32;
+
+    char** stack_;
+    uint32_t depth_;
+    uint32_t capacity_;
+    char* inline_stack_[kInlineDepth];
+  };
+
   inline uint32_t length() { return Length(addr()); }
 
+  // Hash and comparison (of strings with equal length) walk cons strings
+  // without flattening them, Value() flattens string into a contiguous buffer
   static uint32_t Hash(Heap* heap, char* addr);
+  static int Compare(char* lhs, char* rhs);
   static char* Value(Heap* heap, char* addr);
   static char* FlattenCons(char* addr, char* buffer);
 
@@ -451,6 +926,11 @@ class HString : public HValue {
     return *reinterpret_cast<uint32_t*>(addr + kLengthOffset);
   }
 
+  // Zero if hash wasn't computed yet
+  static inline uint32_t CachedHash(char* addr) {
+    return *reinterpret_cast<uint32_t*>(addr + kHashOffset);
+  }
+
   static inline char* LeftCons(char* addr) { return *LeftConsSlot(addr); }
   static inline char* RightCons(char* addr) { return *RightConsSlot(addr); }
 
@@ -462,28 +942,103 @@ class HString : public HValue {
     return reinterpret_cast<char**>(addr + kRightConsOffset);
   }
 
+  // Zero for flat strings
+  static inline uint32_t Depth(char* addr);
+
+  static inline char* Buffer(char* addr) { return *BufferSlot(addr); }
+  static inline char** BufferSlot(char* addr) {
+    return reinterpret_cast<char**>(addr + kBufferOffset);
+  }
+
+  static inline char* Parent(char* addr) { return *ParentSlot(addr); }
+  static inline char** ParentSlot(char* addr) {
+    return reinterpret_cast<char**>(addr + kParentOffset);
+  }
+
+  static inline uint32_t SliceOffset(char* addr) {
+    return *reinterpret_cast<uint32_t*>(addr + kSliceOffsetOffset);
+  }
+
+  static inline char* ExternalValue(char* addr) {
+    return *reinterpret_cast<char**>(addr + kExternalValueOffset);
+  }
+
+  static inline ReleaseCallback ExternalCallback(char* addr) {
+    return *reinterpret_cast<ReleaseCallback*>(addr + kExternalCallbackOffset);
+  }
+
+  // Weak callback of external string
+  static void ReleaseExternal(HValue* value);
+
+  // Bytes of string that isn't cons
+  static inline char* FlatValue(char* addr);
+
   static const int kHashOffset = HINTERIOR_OFFSET(1);
   static const int kLengthOffset = HINTERIOR_OFFSET(2);
   static const int kValueOffset = HINTERIOR_OFFSET(3);
 
   static const int kLeftConsOffset = HINTERIOR_OFFSET(3);
   static const int kRightConsOffset = HINTERIOR_OFFSET(4);
+  static const int kConsDepthOffset = HINTERIOR_OFFSET(5);
+
+  static const int kBufferOffset = HINTERIOR_OFFSET(3);
+
+  static const int kParentOffset = HINTERIOR_OFFSET(3);
+  static const int kSliceOffsetOffset = HINTERIOR_OFFSET(4);
+
+  static const int kExternalValueOffset = HINTERIOR_OFFSET(3);
+  static const int kExternalCallbackOffset = HINTERIOR_OFFSET(4);
+
+  // Builder's buffer starts with number of used bytes
+  static const int kBufferUsedOffset = kValueOffset;
+  static const int kBufferValueOffset = kValueOffset + kPointerSize;
 
   static const int kMinConsLength = 24;
 
+  // Cons trees deeper than that are rebalanced
+  static const uint32_t kMaxConsDepth = 48;
+
+  // Appending to cons string that is that deep starts a builder
+  static const uint32_t kMinBuilderDepth = 8;
+
+  // Short strings prepended to cons are merged into its left leaf
+  static const uint32_t kMaxLeafLength = 256;
+
+  // Shorter substrings are copied
+  static const uint32_t kMinSliceLength = 24;
+
+  // Slices at least that many times shorter than parent are detached on GC
+  static const uint32_t kSliceDetachRatio = 8;
+
   static const Heap::HeapTag class_tag = Heap::kTagString;
 };
 
 
+// Objects are either shaped or in dictionary mode:
+//
+//  * shaped objects share key layout (HShape) with all objects that got the
+//    same properties in the same order, their map holds only values (at the
+//    indexes assigned by shape) and is doubled when shape outgrows it
+//  * dictionary objects (shape is nil) keep both keys and values in their own
+//    map (hashmap)
+//
+// Objects are moved to dictionary mode on property deletion, non-string keys
+// and when they're getting too many properties (see HShape::Transition()).
 class HObject : public HValue {
  public:
   static char* NewEmpty(Heap* heap);
+  static char* NewDictionary(Heap* heap);
   static void Init(Heap* heap, char* obj);
 
+  // Move shaped object to dictionary mode
+  static void Normalize(Heap* heap, char* obj);
+
   inline char* map() { return *map_slot(); }
   inline char** map_slot() { return MapSlot(addr()); }
   inline uint32_t mask() { return *mask_slot(); }
   inline uint32_t* mask_slot() { return MaskSlot(addr()); }
+  inline char* shape() { return *shape_slot(); }
+  inline char** shape_slot() { return ShapeSlot(addr()); }
 
   static inline char** MapSlot(char* addr) {
     return reinterpret_cast<char**>(addr + kMapOffset);
@@ -493,18 +1048,47 @@ class HObject : public HValue {
     return reinterpret_cast<uint32_t*>(addr + kMaskOffset);
   }
   static inline uint32_t Mask(char* addr) { return *MaskSlot(addr); }
+  static inline char** ShapeSlot(char* addr) {
+    return reinterpret_cast<char**>(addr + kShapeOffset);
+  }
+  static inline char* Shape(char* addr) { return *ShapeSlot(addr); }
+  static inline bool IsShaped(char* addr);
 
   static char** LookupProperty(Heap* heap, char* addr, char* key, int insert);
 
   static const int kMaskOffset = HINTERIOR_OFFSET(1);
   static const int kMapOffset = HINTERIOR_OFFSET(2);
 
+  // Objects only (arrays are storing length here)
+  static const int kShapeOffset = HINTERIOR_OFFSET(3);
+
+  // Values in the map of new empty shaped object
+  static const uint32_t kMinShapedSize = 2;
+
+  // Slots in the map of new dictionary object
+  static const uint32_t kMinDictionarySize = 16;
+
   static const Heap::HeapTag class_tag = Heap::kTagObject;
 };
 
 
+// Arrays are either dense or sparse:
+//
+//  * dense arrays keep elements contiguously in their map (element `i` is in
+//    slot `i`, both halves of the map are used, holes are nil), capacity of
+//    the store is doubled when index doesn't fit into it
+//  * sparse arrays are hashmaps keyed by unboxed index, just like dictionary
+//    objects
+//
+// Arrays are moved to sparse mode when element is written too far beyond
+// their length (see IsDenseIndex()) and never go back.
 class HArray : public HObject {
  public:
+  enum Representation {
+    kDense  = 0x00,
+    kSparse = 0x01
+  };
+
   static char* NewEmpty(Heap* heap);
 
   static int64_t Length(char* obj, bool shrink);
@@ -512,18 +1096,78 @@ class HArray : public HObject {
 
   static inline bool IsDense(char* obj);
 
+  // Number of elements that fit into dense array's map
+  static inline uint32_t Capacity(char* obj);
+
+  // True if storing at `index` should keep array dense
+  static inline bool IsDenseIndex(char* obj, int64_t index);
+
+  // Move dense array to sparse mode
+  static void MakeSparse(Heap* heap, char* obj);
+
+  // Box raw doubles of kDouble elements in place, making them kGeneric
+  static void BoxElements(Heap* heap, char* obj);
+
   static const int kVarArgLength = 16;
-  static const int kDenseLengthMax = 128;
+  static const uint32_t kMinCapacity = 2;
+
+  // Holes that could be created by a single store into dense array
+  static const int64_t kMaxDenseGap = 1024;
+
+  // Dense indexes (premultiplied by pointer size) should fit into the mask
+  static const int64_t kMaxDenseCapacity = 1 << 28;
+
   static const int kLengthOffset = HINTERIOR_OFFSET(3);
 
   static const Heap::HeapTag class_tag = Heap::kTagArray;
 };
 
 
+// Maps of dictionary objects and sparse arrays are open-addressing
+// hashtables: `size` keys are followed by `size` values, keys are probed
+// quadratically starting from `hash & mask`. Deleted keys are replaced with
+// a tombstone so probe sequences stay unbroken. `available` counts nil key
+// slots that could still be taken before the map should grow (keeping load
+// factor below 3/4), tombstones are reused by insertions and dropped on
+// rehash.
+//
+// Maps holding only unboxed numbers and nils are marked as kUnboxed and
+// aren't scanned by GC. Only dense arrays' elements are marked (on growth,
+// see RuntimeGrowElements()), any store of a heap pointer into map should
+// reset it to kGeneric (generated code does it in Masm::RecordMapWrite(),
+// C++ code in HObject::LookupProperty()).
+//
+// Dense arrays of numbers with at least one heap number are kDouble: their
+// elements are raw doubles (holes are still nil), boxed by loads and
+// unboxed by stores (see Masm::LoadProperty() and Masm::StoreProperty()).
+// Storing anything else makes them kGeneric again (see HArray::BoxElements()).
+// Raw double takes a whole slot, so only x64 uses this representation.
 class HMap : public HValue {
  public:
+  enum Representation {
+    kGeneric = 0x00,
+    kUnboxed = 0x01,
+    kDouble  = 0x02
+  };
+
   static char* NewEmpty(Heap* heap, uint32_t size);
 
+  // True if GC shouldn't scan map (kUnboxed and kDouble)
+  static inline bool HasOnlyUnboxed(char* addr);
+  static inline bool HasDoubles(char* addr);
+
+  // Double that could be stored raw in kDouble map (i.e. doesn't look like nil)
+  static inline bool IsRawDouble(double value);
+
+  // Key of deleted entry (neither a heap pointer, nor an unboxed value)
+  static inline char* Tombstone() {
+    return reinterpret_cast<char*>(kTombstone);
+  }
+
+  // Number of keys that `size` slots could hold
+  static inline uint32_t MaxLoad(uint32_t size) { return size - (size >> 2); }
+
+  // True for both nil and tombstone slots
   inline bool IsEmptySlot(uint32_t index);
   inline HValue* GetSlot(uint32_t index);
   inline char** GetSlotAddress(uint32_t index);
@@ -531,15 +1175,99 @@ class HMap : public HValue {
   inline uint32_t size() {
     return *reinterpret_cast<uint32_t*>(addr() + kSizeOffset);
   }
+  inline intptr_t* available_slot() { return AvailableSlot(addr()); }
   inline char* space() { return addr() + kSpaceOffset; }
 
+  static inline intptr_t* AvailableSlot(char* addr) {
+    return reinterpret_cast<intptr_t*>(addr + kAvailableOffset);
+  }
+
+  static const intptr_t kTombstone = 0x03;
+
   static const int kSizeOffset = HINTERIOR_OFFSET(1);
-  static const int kSpaceOffset = HINTERIOR_OFFSET(2);
+  static const int kAvailableOffset = HINTERIOR_OFFSET(2);
+  static const int kSpaceOffset = HINTERIOR_OFFSET(3);
 
   static const Heap::HeapTag class_tag = Heap::kTagMap;
 };
 
 
+// Shapes form a transition tree rooted at Heap::root_shape(): adding a new
+// property to a shaped object moves it to the child shape. Shape's keys
+// (dictionary object mapping key to the index of value) are shared with
+// the parent: the first child appends its key to them, others get a copy of
+// parent's keys. So keys may contain entries of descendants - the ones with
+// index not less than shape's length, which are ignored. Enumeration cache
+// is a dense array of keys in the order of their values, built by the first
+// `keysof` and copied by the following ones.
+//
+// Shapes are never collected, heap creates at most kMaxShapes of them
+// (objects that would need more are kept in dictionary mode).
+class HShape : public HValue {
+ public:
+  static char* New(Heap* heap, char* keys, int64_t length);
+
+  // Returns child shape with `key` added, or NULL if object should be moved
+  // to dictionary mode instead
+  static char* Transition(Heap* heap, char* shape, char* key);
+
+  // Returns index of `key`'s value or -1 if shape doesn't have it
+  static int64_t IndexOf(Heap* heap, char* shape, char* key);
+
+  // Returns index of key in `i` slot of keys' map, or -1 if slot is empty
+  // or belongs to the descendant
+  static inline int64_t KeyIndex(char* addr, HMap* keys, uint32_t i);
+
+  inline char* keys() { return *keys_slot(); }
+  inline char** keys_slot() { return KeysSlot(addr()); }
+  inline char* transitions() { return *transitions_slot(); }
+  inline char** transitions_slot() { return TransitionsSlot(addr()); }
+  inline char* enum_cache() { return *enum_cache_slot(); }
+  inline char** enum_cache_slot() { return EnumCacheSlot(addr()); }
+
+  static inline char** KeysSlot(char* addr) {
+    return reinterpret_cast<char**>(addr + kKeysOffset);
+  }
+  static inline char* Keys(char* addr) { return *KeysSlot(addr); }
+  static inline char** TransitionsSlot(char* addr) {
+    return reinterpret_cast<char**>(addr + kTransitionsOffset);
+  }
+  static inline char* Transitions(char* addr) { return *TransitionsSlot(addr); }
+  static inline int64_t* LengthSlot(char* addr) {
+    return reinterpret_cast<int64_t*>(addr + kLengthOffset);
+  }
+  static inline int64_t Length(char* addr) { return *LengthSlot(addr); }
+  static inline int64_t* TransitionCountSlot(char* addr) {
+    return reinterpret_cast<int64_t*>(addr + kTransitionCountOffset);
+  }
+  static inline int64_t TransitionCount(char* addr) {
+    return *TransitionCountSlot(addr);
+  }
+  static inline char** EnumCacheSlot(char* addr) {
+    return reinterpret_cast<char**>(addr + kEnumCacheOffset);
+  }
+  static inline char* EnumCache(char* addr) { return *EnumCacheSlot(addr); }
+
+  // Objects with more properties are kept in dictionary mode
+  static const int64_t kMaxLength = 64;
+
+  // Shapes with many children are likely to belong to objects used as
+  // hashmaps
+  static const int64_t kMaxTransitions = 32;
+
+  // Limit of shapes per heap
+  static const uint32_t kMaxShapes = 16 * 1024;
+
+  static const int kKeysOffset = HINTERIOR_OFFSET(1);
+  static const int kTransitionsOffset = HINTERIOR_OFFSET(2);
+  static const int kLengthOffset = HINTERIOR_OFFSET(3);
+  static const int kTransitionCountOffset = HINTERIOR_OFFSET(4);
+  static const int kEnumCacheOffset = HINTERIOR_OFFSET(5);
+
+  static const Heap::HeapTag class_tag = Heap::kTagShape;
+};
+
+
 class HFunction : public HValue {
  public:
   static char* New(Heap* heap, char* parent, char* addr, char* root);
@@ -157,6 +157,11 @@ inline ScopeSlot* HIRLiteral::root_slot() {
 }
 
 
+inline bool HIRLiteral::IsString() {
+  return ast()->is(AstNode::kString) || ast()->is(AstNode::kProperty);
+}
+
+
 inline int HIREntry::context_slots() {
   return context_slots_;
 }
@@ -176,6 +181,16 @@ inline ScopeSlot* HIRStoreContext::context_slot() {
   return context_slot_;
 }
 
+
+inline int HIRAllocateObject::size() {
+  return size_;
+}
+
+
+inline int HIRAllocateArray::size() {
+  return size_;
+}
+
 } // namespace internal
 } // namespace candor
 
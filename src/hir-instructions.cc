@@ -156,5 +156,17 @@ HIRStoreContext::HIRStoreContext(HIRGen* g, HIRBlock* block, ScopeSlot* slot) :
     context_slot_(slot) {
 }
 
+
+HIRAllocateObject::HIRAllocateObject(HIRGen* g, HIRBlock* block, int size) :
+    HIRInstruction(g, block, kAllocateObject),
+    size_(PowerOfTwo(size < kMinSize ? kMinSize : size)) {
+}
+
+
+HIRAllocateArray::HIRAllocateArray(HIRGen* g, HIRBlock* block, int size) :
+    HIRInstruction(g, block, kAllocateArray),
+    size_(PowerOfTwo(size < kMinSize ? kMinSize : size)) {
+}
+
 } // namespace internal
 } // namespace candor
@@ -141,6 +141,9 @@ class HIRLiteral : public HIRInstruction {
 
   inline ScopeSlot* root_slot();
 
+  // True for string literals and property names
+  inline bool IsString();
+
   HIR_DEFAULT_METHODS(Literal)
 
  private:
@@ -208,6 +211,38 @@ class HIRStoreContext : public HIRInstruction {
   ScopeSlot* context_slot_;
 };
 
+// Object and array literals know number of their properties at compile time,
+// map is allocated big enough to hold all of them without growing.
+// Literal objects are shaped and literal arrays are dense, so their maps hold
+// only values and need no free slots (see HObject::kMinShapedSize).
+class HIRAllocateObject : public HIRInstruction {
+ public:
+  HIRAllocateObject(HIRGen* g, HIRBlock* block, int size);
+
+  inline int size();
+
+  HIR_DEFAULT_METHODS(AllocateObject)
+
+  static const int kMinSize = 2;
+
+ private:
+  int size_;
+};
+
+class HIRAllocateArray : public HIRInstruction {
+ public:
+  HIRAllocateArray(HIRGen* g, HIRBlock* block, int size);
+
+  inline int size();
+
+  HIR_DEFAULT_METHODS(AllocateArray)
+
+  static const int kMinSize = 2;
+
+ private:
+  int size_;
+};
+
 #undef HIR_DEFAULT_METHODS
 
 } // namespace internal
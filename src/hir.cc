@@ -109,7 +109,7 @@ HIRInstruction* HIRGen::VisitFunction(AstNode* stmt) {
       HIRInstruction* varg_arr = NULL;
       if (varg) {
         // Result vararg array
-        varg_arr = Add(HIRInstruction::kAllocateArray);
+        varg_arr = Add(new HIRAllocateArray(this, current_block(), 0));
 
         // Add number of arguments that are following varg
         varg_rest = GetNumber(fn->args()->length() - i - 1);
@@ -419,8 +419,10 @@ HIRInstruction* HIRGen::VisitBinOp(AstNode* stmt) {
 
 
 HIRInstruction* HIRGen::VisitObjectLiteral(AstNode* stmt) {
-  HIRInstruction* res = Add(HIRInstruction::kAllocateObject);
   ObjectLiteral* obj = ObjectLiteral::Cast(stmt);
+  HIRInstruction* res = Add(new HIRAllocateObject(this,
+                                                  current_block(),
+                                                  obj->keys()->length()));
 
   AstList::Item* khead = obj->keys()->head();
   AstList::Item* vhead = obj->values()->head();
@@ -439,7 +441,9 @@ HIRInstruction* HIRGen::VisitObjectLiteral(AstNode* stmt) {
 
 
 HIRInstruction* HIRGen::VisitArrayLiteral(AstNode* stmt) {
-  HIRInstruction* res = Add(HIRInstruction::kAllocateArray);
+  HIRInstruction* res = Add(new HIRAllocateArray(this,
+                                                 current_block(),
+                                                 stmt->children()->length()));
 
   AstList::Item* head = stmt->children()->head();
   for (uint64_t i = 0; head != NULL; head = head->next(), i++) {
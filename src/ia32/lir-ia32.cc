@@ -4,6 +4,7 @@
 #include "lir-instructions-inl.h"
 #include "macroassembler.h"
 #include "stubs.h" // Stubs
+#include "ic.h" // PropertyIC, GlobalCell
 #include <unistd.h> // intptr_t
 
 namespace candor {
@@ -104,16 +105,14 @@ void LLiteral::Generate(Masm* masm) {
 
 
 void LAllocateObject::Generate(Masm* masm) {
-  // XXX Use correct size here
-  __ push(Immediate(HNumber::Tag(16)));
+  __ push(Immediate(HNumber::Tag(size_)));
   __ push(Immediate(HNumber::Tag(Heap::kTagObject)));
   __ Call(masm->stubs()->GetAllocateObjectStub());
 }
 
 
 void LAllocateArray::Generate(Masm* masm) {
-  // XXX Use correct size here
-  __ push(Immediate(HNumber::Tag(16)));
+  __ push(Immediate(HNumber::Tag(size_)));
   __ push(Immediate(HNumber::Tag(Heap::kTagArray)));
   __ Call(masm->stubs()->GetAllocateObjectStub());
 }
@@ -135,14 +134,113 @@ void LBranch::Generate(Masm* masm) {
 }
 
 
+// Loads offset of global object's property through the cell, object and
+// its map should be the cached ones
+static void GenerateGlobalCellLookup(Masm* masm) {
+  GlobalCell* cell = GlobalCell::New(masm->heap());
+
+  Label miss, done;
+  Operand qmap(eax, HObject::kMapOffset);
+  Operand cell_object(ebx, GlobalCell::kObjectOffset);
+  Operand cell_map(ebx, GlobalCell::kMapOffset);
+  Operand cell_offset(ebx, GlobalCell::kOffsetOffset);
+
+  __ mov(ebx, Immediate(reinterpret_cast<uint32_t>(cell)));
+
+  __ cmpl(eax, cell_object);
+  __ jmp(kNe, &miss);
+
+  __ mov(ecx, qmap);
+  __ cmpl(ecx, cell_map);
+  __ jmp(kNe, &miss);
+
+  __ mov(eax, cell_offset);
+  __ xorl(ebx, ebx);
+  __ jmp(&done);
+
+  __ bind(&miss);
+  __ Call(masm->stubs()->GetGlobalCellStub());
+
+  __ bind(&done);
+}
+
+
+// Puts offset of property's slot in object's map into eax (or nil).
+// Accesses with a constant string key are going through inline cache (or
+// global property cell), element accesses are never shaped.
+static void GeneratePropertyLookup(Masm* masm,
+                                   HIRInstruction* hir,
+                                   bool is_store) {
+  // eax <- object
+  // edx <- property
+  __ mov(edx, ebx);
+  if (!hir->right()->Is(HIRInstruction::kLiteral) ||
+      !HIRLiteral::Cast(hir->right())->IsString()) {
+    __ mov(ecx, Immediate(is_store ? 1 : 0));
+    __ Call(masm->stubs()->GetLookupPropertyStub());
+    return;
+  }
+
+  // `global.name` loads
+  HIRInstruction* obj = hir->left();
+  if (!is_store &&
+      obj->Is(HIRInstruction::kLoadContext) &&
+      HIRLoadContext::Cast(obj)->context_slot()->depth() == -1) {
+    GenerateGlobalCellLookup(masm);
+    return;
+  }
+
+  PropertyIC* ic = PropertyIC::New(masm->heap(), is_store);
+
+  Label miss, done;
+  Operand qshape(eax, HObject::kShapeOffset);
+  Operand hits(ebx, PropertyIC::kHitsOffset);
+  Operand entry_shape(ebx,
+                      PropertyIC::EntryOffset(0) +
+                          PropertyIC::kEntryShapeOffset);
+  Operand entry_transition(ebx,
+                           PropertyIC::EntryOffset(0) +
+                               PropertyIC::kEntryTransitionOffset);
+  Operand entry_offset(ebx,
+                       PropertyIC::EntryOffset(0) +
+                           PropertyIC::kEntryOffsetOffset);
+
+  __ mov(ebx, Immediate(reinterpret_cast<uint32_t>(ic)));
+
+  // Monomorphic case: check the first entry inline
+  __ IsUnboxed(eax, NULL, &miss);
+  __ IsNil(eax, NULL, &miss);
+  __ IsHeapObject(Heap::kTagObject, eax, &miss, NULL);
+
+  __ mov(ecx, qshape);
+  __ cmpl(ecx, entry_shape);
+  __ jmp(kNe, &miss);
+
+  // Transitions are handled by stub
+  __ cmpl(entry_transition, Immediate(0));
+  __ jmp(kNe, &miss);
+
+  __ mov(scratch, hits);
+  __ inc(scratch);
+  __ mov(hits, scratch);
+
+  __ mov(eax, entry_offset);
+  __ xorl(ebx, ebx);
+  __ jmp(&done);
+
+  // Polymorphic, megamorphic or uninitialized
+  __ bind(&miss);
+  __ Call(masm->stubs()->GetPropertyICStub());
+
+  __ bind(&done);
+}
+
+
 void LLoadProperty::Generate(Masm* masm) {
   __ push(eax);
   __ push(eax);
 
-  // eax <- object
-  // ebx <- property
-  __ mov(ebx, Immediate(0));
-  __ Call(masm->stubs()->GetLookupPropertyStub());
+  GeneratePropertyLookup(masm, hir(), false);
 
   Label done;
 
@@ -163,20 +261,18 @@ void LLoadProperty::Generate(Masm* masm) {
 
 void LStoreProperty::Generate(Masm* masm) {
   __ push(eax);
-  __ push(ebx);
+  __ push(ecx);
 
-  // eax <- object
-  // ebx <- property
-  // ebx <- value
-  __ mov(ebx, Immediate(1));
-  __ Call(masm->stubs()->GetLookupPropertyStub());
+  // ecx <- value
+  GeneratePropertyLookup(masm, hir(), true);
 
-  // Make eax look like unboxed number to GC
-  __ dec(eax);
-  __ CheckGC();
-  __ inc(eax);
+  // eax holds an offset in the map, GC shouldn't visit it
+  {
+    Masm::UntaggedRegister untagged(masm, eax);
+    __ CheckGC();
+  }
 
-  __ pop(ebx);
+  __ pop(ecx);
   __ pop(ebx);
 
   Label done;
@@ -187,7 +283,10 @@ void LStoreProperty::Generate(Masm* masm) {
   __ addl(eax, ebx);
 
   Operand slot(eax, 0);
-  __ mov(slot, ebx);
+  __ mov(slot, ecx);
+
+  // ebx <- map, eax <- slot, ecx <- value
+  __ RecordMapWrite(ebx, eax, ecx);
 
   __ bind(&done);
 }
@@ -385,10 +484,11 @@ void LLoadVarArg::Generate(Masm* masm) {
   arr_s.Unspill();
   ebx_s.Unspill();
 
-  // Make eax look like unboxed number to GC
-  __ dec(eax);
-  __ CheckGC();
-  __ inc(eax);
+  // eax holds an offset in the map, GC shouldn't visit it
+  {
+    Masm::UntaggedRegister untagged(masm, eax);
+    __ CheckGC();
+  }
 
   __ IsNil(eax, NULL, &preloop);
 
@@ -406,6 +506,7 @@ void LLoadVarArg::Generate(Masm* masm) {
 
   // Put argument in array
   __ mov(slot, offset);
+  __ RecordMapWrite(arr, scratch, offset);
 
   arr_s.Unspill();
 
@@ -580,6 +681,10 @@ void LStoreContext::Generate(Masm* masm) {
   Operand res(scratches[0]->ToRegister(),
               HContext::GetIndexDisp(slot()->index()));
   __ mov(res, inputs[0]->ToRegister());
+
+  __ mov(scratch, scratches[0]->ToRegister());
+  __ addl(scratch, Immediate(HContext::GetIndexDisp(slot()->index())));
+  __ RecordWrite(scratches[0]->ToRegister(), scratch, inputs[0]->ToRegister());
 }
 
 
@@ -18,7 +18,12 @@ Masm::Masm(CodeSpace* space) : space_(space),
                                spill_offset_(4),
                                spill_index_(0),
                                spill_reloc_(NULL),
-                               spill_operand_(ebp, 0) {
+                               spill_operand_(ebp, 0),
+                               stack_map_(NULL),
+                               safepoint_slot_count_(0),
+                               safepoint_slots_(NULL),
+                               safepoint_registers_(SafePoint::kAllRegisters),
+                               spill_tags_(0) {
 }
 
 
@@ -48,6 +53,26 @@ void Masm::Popad(Register preserve) {
 }
 
 
+int Masm::SavedRegisterIndex(Register reg) {
+  // Same order as in Pushad() (last two words are alignment)
+  Register saved[] = { eax, ebx, ecx, edx, esi, edi };
+
+  for (int i = 0; i < 6; i++) {
+    if (saved[i].is(reg)) return i;
+  }
+
+  UNEXPECTED
+  return -1;
+}
+
+
+bool Masm::IsTaggedRegister(Register reg) {
+  if (reg.is(scratch) || reg.is(esp) || reg.is(ebp)) return false;
+
+  return (safepoint_registers_ & (1 << SavedRegisterIndex(reg))) != 0;
+}
+
+
 void Masm::AlignCode() {
   offset_ = RoundUp(offset_, 16);
   Grow();
@@ -91,6 +116,12 @@ void Masm::Spill::SpillReg(Register src) {
   masm()->SpillSlot(index(), slot);
   masm()->mov(slot, src);
 
+  if (masm()->IsTaggedRegister(src)) {
+    masm()->spill_tags_ |= 1 << index();
+  } else {
+    masm()->spill_tags_ &= ~(1 << index());
+  }
+
   if (masm()->spill_index_ > masm()->spills_) {
     masm()->spills_ = masm()->spill_index_;
   }
@@ -133,7 +164,9 @@ void Masm::AllocateSpills() {
 void Masm::FinalizeSpills() {
   if (spill_reloc_ == NULL) return;
 
-  spill_reloc_->target(RoundUp((spill_offset_ + spills_ + 1) << 2, 16));
+  uint32_t frame_size = RoundUp((spill_offset_ + spills_ + 1) << 2, 16);
+  spill_reloc_->target(frame_size);
+  FinalizeSafePoints(frame_size / HValue::kPointerSize);
 }
 
 
@@ -217,19 +250,28 @@ void Masm::AllocateObjectLiteral(Heap::HeapTag tag,
   Operand qmask(result, HObject::kMaskOffset);
   Operand qmap(result, HObject::kMapOffset);
 
+  // Object only field
+  Operand qshape(result, HObject::kShapeOffset);
+
   // Array only field
   Operand qlength(result, HArray::kLengthOffset);
 
+  // Empty objects have root shape
+  Immediate root_shape(reinterpret_cast<uint32_t>(heap()->root_shape_slot()));
+  Operand scratch_op(scratch, 0);
+
   if (tag_reg.is(reg_nil)) {
-    // mask + map
-    Allocate(tag,
-             reg_nil,
-             (tag == Heap::kTagArray ? 3 : 2) * HValue::kPointerSize,
-             result);
+    // mask + map + shape (or length)
+    Allocate(tag, reg_nil, 3 * HValue::kPointerSize, result);
 
-    // Set length
     if (tag == Heap::kTagArray) {
+      // Set length
       mov(qlength, Immediate(0));
+    } else {
+      // Set shape
+      mov(scratch, root_shape);
+      mov(scratch, scratch_op);
+      mov(qshape, scratch);
     }
   } else {
     Label array, allocate_map;
@@ -237,7 +279,10 @@ void Masm::AllocateObjectLiteral(Heap::HeapTag tag,
     cmpl(tag_reg, Immediate(HNumber::Tag(Heap::kTagArray)));
     jmp(kEq, &array);
 
-    Allocate(Heap::kTagObject, reg_nil, 2 * HValue::kPointerSize, result);
+    Allocate(Heap::kTagObject, reg_nil, 3 * HValue::kPointerSize, result);
+    mov(scratch, root_shape);
+    mov(scratch, scratch_op);
+    mov(qshape, scratch);
 
     jmp(&allocate_map);
     bind(&array);
@@ -261,17 +306,25 @@ void Masm::AllocateObjectLiteral(Heap::HeapTag tag,
   // Create map
   Spill size_s(this, size);
 
+  // Maps of shaped objects and dense arrays contain only values: `size` of
+  // them fit into `size / 2` slot pairs
+  Untag(size);
+  shr(size, Immediate(1));
+  TagNumber(size);
+
+  Spill map_size_s(this, size);
+
   Untag(size);
   // keys + values
   shl(size, Immediate(4));
-  // + size
-  addl(size, Immediate(HValue::kPointerSize));
+  // + size + available
+  addl(size, Immediate(2 * HValue::kPointerSize));
   TagNumber(size);
 
   Allocate(Heap::kTagMap, size, 0, scratch);
   mov(qmap, scratch);
 
-  size_s.Unspill();
+  map_size_s.Unspill();
   Spill result_s(this, result);
   mov(result, scratch);
 
@@ -280,6 +333,10 @@ void Masm::AllocateObjectLiteral(Heap::HeapTag tag,
   Untag(size);
   mov(qmapsize, size);
 
+  // Map holds no keys, runtime will rehash it before inserting any
+  Operand qavailable(result, HMap::kAvailableOffset);
+  mov(qavailable, Immediate(0));
+
   // Fill map with nil
   shl(size, Immediate(4));
   addl(result, Immediate(HMap::kSpaceOffset));
@@ -403,9 +460,8 @@ void Masm::ExitFrameEpilogue() {
 
 void Masm::StringHash(Register str, Register result) {
   Operand hash_field(str, HString::kHashOffset);
-  Operand repr_field(str, HValue::kRepresentationOffset);
 
-  Label call_runtime, done;
+  Label done;
 
   push(eax);
 
@@ -414,112 +470,111 @@ void Masm::StringHash(Register str, Register result) {
   cmpl(eax, Immediate(0));
   jmp(kNe, &done);
 
-  // Check if string is a cons string
-  movzxb(eax, repr_field);
-  cmpl(eax, Immediate(HString::kNormal));
-  jmp(kNe, &call_runtime);
-
-  // Compute new hash
-  assert(!str.is(ecx));
-  if (!result.is(ecx)) push(ecx);
+  // Compute it in runtime (see ComputeHash), it'll be stored in the string
   push(str);
-  push(esi);
+  Call(stubs()->GetHashValueStub());
+  pop(str);
 
-  // hash = 0
-  xorl(result, result);
+  bind(&done);
 
-  // ecx = length
-  Operand length_field(str, HString::kLengthOffset);
-  mov(ecx, length_field);
+  if (result.is(eax)) {
+    pop(scratch);
+  } else {
+    mov(result, eax);
+    pop(eax);
+  }
+}
 
-  // str += kValueOffset
-  addl(str, Immediate(HString::kValueOffset));
 
-  // while (ecx != 0)
-  Label loop_start, loop_cond, loop_end;
+void Masm::CheckGC() {
+  Immediate gc_flag(reinterpret_cast<uint32_t>(heap()->needs_gc_addr()));
+  Operand scratch_op(scratch, 0);
 
-  jmp(&loop_cond);
-  bind(&loop_start);
+  Label done;
 
-  Operand ch(str, 0);
+  // Check needs_gc flag
+  mov(scratch, gc_flag);
+  cmpb(scratch_op, Immediate(0));
+  jmp(kEq, &done);
 
-  // result += str[0]
-  movzxb(eax, ch);
-  addl(result, eax);
+  Call(stubs()->GetCollectGarbageStub());
 
-  // result += result << 10
-  mov(eax, result);
-  shl(result, Immediate(10));
-  addl(result, eax);
+  bind(&done);
+}
 
-  // result ^= result >> 6
-  mov(eax, result);
-  shr(result, Immediate(6));
-  xorl(result, eax);
 
-  // ecx--; str++
-  dec(ecx);
-  inc(str);
+void Masm::RecordWrite(Register object, Register slot, Register value) {
+  Operand object_gen(object, HValue::kGenerationOffset);
+  Operand value_gen(value, HValue::kGenerationOffset);
 
-  bind(&loop_cond);
+  Immediate marking(reinterpret_cast<uint32_t>(heap()->gc()->marking_addr()));
+  Operand scratch_op(scratch, 0);
 
-  // check condition (ecx != 0)
-  cmpl(ecx, Immediate(0));
-  jmp(kNe, &loop_start);
+  Label record, done;
 
-  bind(&loop_end);
+  // Skip non-pointers
+  IsUnboxed(value, NULL, &done);
+  IsNil(value, NULL, &done);
 
-  // Mixup
-  // result += (result << 3);
-  mov(eax, result);
-  shl(result, Immediate(3));
-  addl(result, eax);
+  // Skip new space objects
+  cmpb(object_gen, Immediate(Heap::kMinOldSpaceGeneration));
+  jmp(kLt, &done);
 
-  // result ^= (result >> 11);
-  mov(eax, result);
-  shr(result, Immediate(11));
-  xorl(result, eax);
+  // Old space values should be recorded only while marking is in progress
+  cmpb(value_gen, Immediate(Heap::kMinOldSpaceGeneration));
+  jmp(kLt, &record);
 
-  // result += (result << 15);
-  mov(eax, result);
-  shl(result, Immediate(15));
-  addl(result, eax);
+  // NOTE: slot may be in scratch, pop doesn't affect flags
+  push(slot);
+  mov(scratch, marking);
+  cmpb(scratch_op, Immediate(0));
+  pop(slot);
+  jmp(kEq, &done);
 
-  pop(esi);
-  pop(str);
-  if (!result.is(ecx)) pop(ecx);
+  bind(&record);
+  push(slot);
+  Call(stubs()->GetRecordWriteStub());
 
-  // Store hash into a string
-  mov(hash_field, result);
+  bind(&done);
+}
 
-  jmp(&done);
-  bind(&call_runtime);
 
-  push(str);
-  Call(stubs()->GetHashValueStub());
-  pop(str);
+void Masm::RecordMapWrite(Register map, Register slot, Register value) {
+  Operand brepr(map, HValue::kRepresentationOffset);
 
-  mov(result, eax);
+  Label unboxed;
+  IsUnboxed(value, NULL, &unboxed);
+  IsNil(value, NULL, &unboxed);
+  movb(brepr, Immediate(HMap::kGeneric));
 
-  bind(&done);
-  pop(eax);
+  bind(&unboxed);
+  RecordWrite(map, slot, value);
 }
 
 
-void Masm::CheckGC() {
-  Immediate gc_flag(reinterpret_cast<uint32_t>(heap()->needs_gc_addr()));
-  Operand scratch_op(scratch, 0);
+void Masm::LoadProperty(Register obj, Register offset, Register result) {
+  Operand qmap(obj, HObject::kMapOffset);
+  Operand slot(result, 0);
 
-  Label done;
+  // No kDouble elements on ia32
+  mov(scratch, qmap);
+  mov(result, offset);
+  addl(result, scratch);
+  mov(result, slot);
+}
 
-  // Check needs_gc flag
-  mov(scratch, gc_flag);
-  cmpb(scratch_op, Immediate(0));
-  jmp(kEq, &done);
 
-  Call(stubs()->GetCollectGarbageStub());
+void Masm::StoreProperty(Register obj, Register offset, Register value) {
+  Operand qmap(obj, HObject::kMapOffset);
+  Operand slot(offset, 0);
 
-  bind(&done);
+  // No kDouble elements on ia32
+  addl(offset, qmap);
+  mov(slot, value);
+
+  // NOTE: RecordWrite() doesn't read the map after clobbering scratch
+  mov(scratch, qmap);
+  RecordMapWrite(scratch, offset, value);
 }
 
 
@@ -559,10 +614,10 @@ void Masm::IsTrue(Register reference, Label* is_false, Label* is_true) {
 
 
 void Masm::IsDenseArray(Register reference, Label* non_dense, Label* dense) {
-  Operand qlength(reference, HArray::kLengthOffset);
-  cmpl(qlength, Immediate(HArray::kDenseLengthMax));
-  if (non_dense != NULL) jmp(kGt, non_dense);
-  if (dense != NULL) jmp(kLe, dense);
+  Operand brepr(reference, HValue::kRepresentationOffset);
+  cmpb(brepr, Immediate(HArray::kDense));
+  if (non_dense != NULL) jmp(kNe, non_dense);
+  if (dense != NULL) jmp(kEq, dense);
 }
 
 
@@ -571,6 +626,7 @@ void Masm::Call(Register addr) {
     nop();
   }
   call(addr);
+  RecordSafePoint();
   nop();
 }
 
@@ -580,6 +636,7 @@ void Masm::Call(Operand& addr) {
     nop();
   }
   call(addr);
+  RecordSafePoint();
   nop();
 }
 
@@ -154,6 +154,10 @@ void AllocateStub::Generate() {
   __ mov(edx, size);
   __ Untag(edx);
 
+  // Large objects are allocated in runtime
+  __ cmpl(edx, Immediate(LargeSpace::kThreshold));
+  __ jmp(kGt, &runtime_allocate);
+
   // Add object size to the top
   __ addl(edx, eax);
   __ jmp(kCarry, &runtime_allocate);
@@ -319,8 +323,8 @@ void CollectGarbageStub::Generate() {
     __ ChangeAlign(2);
     Masm::Align a(masm());
 
-    // RuntimeCollectGarbage(heap, stack_top)
-    __ push(esp);
+    // RuntimeCollectGarbage(heap, frame)
+    __ push(ebp);
     __ push(Immediate(reinterpret_cast<uint32_t>(masm()->heap())));
     __ mov(eax, Immediate(*reinterpret_cast<uint32_t*>(&gc)));
     __ Call(eax);
@@ -335,6 +339,35 @@ void CollectGarbageStub::Generate() {
 }
 
 
+void RecordWriteStub::Generate() {
+  GeneratePrologue();
+
+  // Arguments
+  Operand slot(ebp, 8);
+
+  RuntimeRecordWriteCallback record = &RuntimeRecordWrite;
+  __ Pushad();
+
+  {
+    __ ChangeAlign(2);
+    Masm::Align a(masm());
+
+    // RuntimeRecordWrite(heap, slot)
+    __ push(slot);
+    __ push(Immediate(reinterpret_cast<uint32_t>(masm()->heap())));
+    __ mov(eax, Immediate(*reinterpret_cast<uint32_t*>(&record)));
+    __ Call(eax);
+    __ addl(esp, Immediate(2 * 4));
+
+    __ ChangeAlign(-2);
+  }
+
+  __ Popad(reg_nil);
+
+  GenerateEpilogue(1);
+}
+
+
 void TypeofStub::Generate() {
   GeneratePrologue();
 
@@ -373,6 +406,43 @@ void TypeofStub::Generate() {
 
 void SizeofStub::Generate() {
   GeneratePrologue();
+
+  Label fast_case, restore, runtime, done;
+
+  // Dense array that ends with non-nil element (or is empty) knows its size
+  __ IsUnboxed(eax, NULL, &runtime);
+  __ IsNil(eax, NULL, &runtime);
+  __ IsHeapObject(Heap::kTagArray, eax, &runtime, NULL);
+  __ IsDenseArray(eax, &runtime, NULL);
+
+  Operand qlength(eax, HArray::kLengthOffset);
+  Operand qmap(eax, HObject::kMapOffset);
+  Operand last(scratch, HMap::kSpaceOffset - HValue::kPointerSize);
+
+  __ push(ebx);
+  __ mov(ebx, qlength);
+  __ cmpl(ebx, Immediate(0));
+  __ jmp(kEq, &fast_case);
+
+  __ shl(ebx, Immediate(2));
+  __ mov(scratch, qmap);
+  __ addl(scratch, ebx);
+  __ cmpl(last, Immediate(Heap::kTagNil));
+  __ jmp(kEq, &restore);
+
+  // ebx = length * kPointerSize, tag it
+  __ shr(ebx, Immediate(1));
+
+  __ bind(&fast_case);
+  __ mov(eax, ebx);
+  __ pop(ebx);
+  __ jmp(&done);
+
+  // Trailing nils should be dropped by runtime
+  __ bind(&restore);
+  __ pop(ebx);
+
+  __ bind(&runtime);
   RuntimeSizeofCallback sizeofc = &RuntimeSizeof;
 
   __ Pushad();
@@ -393,6 +463,8 @@ void SizeofStub::Generate() {
 
   __ Popad(eax);
 
+  __ bind(&done);
+
   GenerateEpilogue(0);
 }
 
@@ -462,6 +534,50 @@ void LookupPropertyStub::Generate() {
 
     __ StringHash(edx, ebx);
 
+    Label dictionary;
+
+    // Shaped object: value's index is stored in shape's keys
+    Operand qshape(eax, HObject::kShapeOffset);
+    __ mov(esi, qshape);
+    __ IsNil(esi, NULL, &dictionary);
+    {
+      Operand qkeys(esi, HShape::kKeysOffset);
+      __ mov(esi, qkeys);
+
+      Operand qkeys_mask(esi, HObject::kMaskOffset);
+      __ mov(eax, qkeys_mask);
+
+      // offset = hash & mask + kSpaceOffset
+      __ andl(ebx, eax);
+      __ addl(ebx, Immediate(HMap::kSpaceOffset));
+
+      Operand qkeys_map(esi, HObject::kMapOffset);
+      __ mov(esi, qkeys_map);
+      __ addl(esi, ebx);
+
+      // New properties are added by runtime (object changes it's shape)
+      Operand key_slot(esi, 0);
+      __ cmpl(edx, key_slot);
+      __ jmp(kNe, &cleanup);
+
+      // Get tagged index from key's value slot
+      __ addl(esi, eax);
+      Operand index_slot(esi, HValue::kPointerSize);
+      __ mov(eax, index_slot);
+
+      // eax = index * kPointerSize + kSpaceOffset
+      __ shl(eax, Immediate(1));
+      __ addl(eax, Immediate(HMap::kSpaceOffset));
+
+      // Cleanup
+      __ xorl(ebx, ebx);
+
+      // Return value
+      GenerateEpilogue(0);
+    }
+
+    __ bind(&dictionary);
+
     Operand qmask(eax, HObject::kMaskOffset);
     __ mov(eax, qmask);
 
@@ -486,26 +602,36 @@ void LookupPropertyStub::Generate() {
     __ cmpl(esi, edx);
     __ jmp(kEq, &match);
 
-    // or nil
+    // or nil (tombstones and collisions are handled in runtime)
     __ cmpl(esi, Immediate(Heap::kTagNil));
     __ jmp(kNe, &cleanup);
 
-    __ bind(&match);
-
-    Label fast_case_end;
-
     // Insert key if was asked
     __ cmpl(ecx, Immediate(0));
-    __ jmp(kEq, &fast_case_end);
+    __ jmp(kEq, &match);
 
-    // Restore map's interior pointer
+    // Map should be grown by runtime if load factor limit was reached
     __ mov(esi, qmap);
+    Operand qavailable(esi, HMap::kAvailableOffset);
+    __ cmpl(qavailable, Immediate(0));
+    __ jmp(kEq, &cleanup);
+
+    // eax is spilled, use it for map
+    __ mov(eax, esi);
+    Operand available(eax, HMap::kAvailableOffset);
+    __ mov(esi, available);
+    __ dec(esi);
+    __ mov(available, esi);
+
+    // Restore map's interior pointer
+    __ mov(esi, eax);
     __ addl(esi, ebx);
 
     // Put the key into slot
     __ mov(slot, edx);
+    __ RecordWrite(eax, esi, edx);
 
-    __ bind(&fast_case_end);
+    __ bind(&match);
 
     // Compute value's address
     // eax = key_offset + mask + 4
@@ -535,8 +661,8 @@ void LookupPropertyStub::Generate() {
     __ mov(ebx, qmask);
 
     // Check if index is above the mask
-    // NOTE: edx is tagged so we need to shift it only 2 times
-    __ shl(edx, Immediate(2));
+    // NOTE: edx is tagged so we need to shift it only once
+    __ shl(edx, Immediate(1));
     __ cmpl(edx, ebx);
     __ jmp(kGt, &cleanup);
 
@@ -624,6 +750,187 @@ void LookupPropertyStub::Generate() {
 }
 
 
+void PropertyICStub::Generate() {
+  GeneratePrologue();
+
+  // Save registers
+  __ push(esi);
+  __ push(edi);
+
+  Label hit, miss, generic, done;
+
+  // eax <- object
+  // edx <- property
+  // ebx <- inline cache
+  Operand qshape(eax, HObject::kShapeOffset);
+
+  // Non-objects and objects in dictionary mode aren't cached
+  __ IsUnboxed(eax, NULL, &generic);
+  __ IsNil(eax, NULL, &generic);
+  __ IsHeapObject(Heap::kTagObject, eax, &generic, NULL);
+
+  __ mov(ecx, qshape);
+  __ IsNil(ecx, NULL, &generic);
+
+  // Unused entries have NULL shape and will never match
+  for (int i = 0; i < PropertyIC::kMaxEntries; i++) {
+    Label next;
+    Operand entry_shape(ebx,
+                        PropertyIC::EntryOffset(i) +
+                            PropertyIC::kEntryShapeOffset);
+    __ cmpl(ecx, entry_shape);
+    __ jmp(kNe, &next);
+
+    // ecx <- inline cache, ebx <- entry
+    __ mov(ecx, ebx);
+    __ addl(ebx, Immediate(PropertyIC::EntryOffset(i)));
+    __ jmp(&hit);
+
+    __ bind(&next);
+  }
+  __ jmp(&miss);
+
+  __ bind(&hit);
+  {
+    Label no_transition, fits;
+    Operand transition(ebx, PropertyIC::kEntryTransitionOffset);
+    Operand offset(ebx, PropertyIC::kEntryOffsetOffset);
+    Operand hits(ecx, PropertyIC::kHitsOffset);
+
+    __ cmpl(transition, Immediate(0));
+    __ jmp(kEq, &no_transition);
+
+    // New value's slot should fit into object's map (runtime will grow it)
+    Operand qmask(eax, HObject::kMaskOffset);
+    __ mov(edi, offset);
+    __ subl(edi, Immediate(HMap::kSpaceOffset));
+    __ cmpl(edi, qmask);
+    __ jmp(kLe, &fits);
+
+    __ mov(ebx, ecx);
+    __ jmp(&miss);
+
+    __ bind(&fits);
+
+    // Move object to the new shape
+    __ mov(edi, transition);
+    __ mov(qshape, edi);
+    __ mov(scratch, eax);
+    __ addl(scratch, Immediate(HObject::kShapeOffset));
+    __ RecordWrite(eax, scratch, edi);
+
+    __ bind(&no_transition);
+
+    __ mov(edi, hits);
+    __ inc(edi);
+    __ mov(hits, edi);
+
+    __ mov(eax, offset);
+    __ jmp(&done);
+  }
+
+  __ bind(&miss);
+
+  // Megamorphic site isn't recording new shapes
+  Operand length(ebx, PropertyIC::kLengthOffset);
+  __ cmpl(length, Immediate(PropertyIC::kMegamorphicLength));
+  __ jmp(kEq, &generic);
+
+  __ Pushad();
+
+  RuntimePropertyICMissCallback miss_cb = &RuntimePropertyICMiss;
+
+  {
+    __ ChangeAlign(4);
+    Masm::Align a(masm());
+
+    // RuntimePropertyICMiss(heap, ic, obj, key)
+    __ push(edx);
+    __ push(eax);
+    __ push(ebx);
+    __ push(Immediate(reinterpret_cast<uint32_t>(masm()->heap())));
+    __ mov(eax, Immediate(*reinterpret_cast<uint32_t*>(&miss_cb)));
+    __ call(eax);
+    __ addl(esp, Immediate(4 * 4));
+
+    __ ChangeAlign(-4);
+  }
+
+  __ Popad(eax);
+  __ jmp(&done);
+
+  __ bind(&generic);
+
+  Operand misses(ebx, PropertyIC::kMissesOffset);
+  __ mov(edi, misses);
+  __ inc(edi);
+  __ mov(misses, edi);
+
+  Operand is_store(ebx, PropertyIC::kIsStoreOffset);
+  __ mov(ecx, is_store);
+  __ Call(masm()->stubs()->GetLookupPropertyStub());
+
+  __ bind(&done);
+
+  // Cleanup
+  __ xorl(ebx, ebx);
+  __ xorl(ecx, ecx);
+
+  __ pop(edi);
+  __ pop(esi);
+  GenerateEpilogue(0);
+}
+
+
+void GlobalCellStub::Generate() {
+  GeneratePrologue();
+
+  Label generic, done;
+
+  // eax <- object
+  // edx <- property
+  // ebx <- global cell
+  __ IsUnboxed(eax, NULL, &generic);
+  __ IsNil(eax, NULL, &generic);
+  __ IsHeapObject(Heap::kTagObject, eax, &generic, NULL);
+
+  __ Pushad();
+
+  RuntimeLookupGlobalPropertyCallback lookup = &RuntimeLookupGlobalProperty;
+
+  {
+    __ ChangeAlign(4);
+    Masm::Align a(masm());
+
+    // RuntimeLookupGlobalProperty(heap, cell, obj, key)
+    __ push(edx);
+    __ push(eax);
+    __ push(ebx);
+    __ push(Immediate(reinterpret_cast<uint32_t>(masm()->heap())));
+    __ mov(eax, Immediate(*reinterpret_cast<uint32_t*>(&lookup)));
+    __ call(eax);
+    __ addl(esp, Immediate(4 * 4));
+
+    __ ChangeAlign(-4);
+  }
+
+  __ Popad(eax);
+  __ jmp(&done);
+
+  // Global isn't an object
+  __ bind(&generic);
+  __ mov(ecx, Immediate(0));
+  __ Call(masm()->stubs()->GetLookupPropertyStub());
+
+  __ bind(&done);
+
+  // Cleanup
+  __ xorl(ebx, ebx);
+
+  GenerateEpilogue(0);
+}
+
+
 void CoerceToBooleanStub::Generate() {
   GeneratePrologue();
 
@@ -684,13 +991,6 @@ void CoerceToBooleanStub::Generate() {
 
 void CloneObjectStub::Generate() {
   GeneratePrologue();
-  __ AllocateSpills();
-
-  // Align and save
-  __ push(esi);
-  __ push(edi);
-  __ push(ebx);
-  __ push(ecx);
 
   Label non_object, done;
 
@@ -699,52 +999,26 @@ void CloneObjectStub::Generate() {
   __ IsNil(eax, NULL, &non_object);
   __ IsHeapObject(Heap::kTagObject, eax, &non_object, NULL);
 
-  // Get map
-  Operand qmap(eax, HObject::kMapOffset);
-  __ mov(eax, qmap);
-
-  // Get size
-  Operand qsize(eax, HMap::kSizeOffset);
-  __ mov(ecx, qsize);
-
-  __ TagNumber(ecx);
-
-  // Allocate new object
-  __ AllocateObjectLiteral(Heap::kTagObject, reg_nil, ecx, edx);
+  // Clone shares shape with the source object (or copies dictionary)
+  RuntimeCloneObjectCallback clonec = &RuntimeCloneObject;
 
-  __ mov(ebx, edx);
-
-  // Get new object's map
-  qmap.base(ebx);
-  __ mov(ebx, qmap);
-
-  // Skip headers
-  __ addl(eax, Immediate(HMap::kSpaceOffset));
-  __ addl(ebx, Immediate(HMap::kSpaceOffset));
-
-  // NOTE: ecx is tagged here
-
-  // Copy all fields from it
-  Label loop_start, loop_cond;
-  __ jmp(&loop_cond);
-  __ bind(&loop_start);
-
-  Operand from(eax, 0), to(ebx, 0);
-  __ mov(esi, from);
-  __ mov(to, esi);
+  __ Pushad();
 
-  // Move forward
-  __ addl(eax, Immediate(4));
-  __ addl(ebx, Immediate(4));
+  // RuntimeCloneObject(heap, obj)
+  {
+    __ ChangeAlign(2);
+    Masm::Align a(masm());
 
-  __ dec(ecx);
+    __ push(eax);
+    __ push(Immediate(reinterpret_cast<uint32_t>(masm()->heap())));
+    __ mov(eax, Immediate(*reinterpret_cast<uint32_t*>(&clonec)));
+    __ call(eax);
+    __ addl(esp, Immediate(2 * 4));
 
-  // Loop
-  __ bind(&loop_cond);
-  __ cmpl(ecx, Immediate(0));
-  __ jmp(kNe, &loop_start);
+    __ ChangeAlign(-2);
+  }
 
-  __ mov(eax, edx);
+  __ Popad(eax);
 
   __ jmp(&done);
   __ bind(&non_object);
@@ -754,12 +1028,6 @@ void CloneObjectStub::Generate() {
 
   __ bind(&done);
 
-  __ FinalizeSpills();
-
-  __ pop(ecx);
-  __ pop(ebx);
-  __ pop(esi);
-  __ pop(edi);
   GenerateEpilogue(0);
 }
 
@@ -790,6 +1058,37 @@ void DeletePropertyStub::Generate() {
 }
 
 
+void BoxElementsStub::Generate() {
+  GeneratePrologue();
+
+  // eax <- array with kDouble elements
+  //
+  // NOTE: ia32 doesn't create such elements (see HMap), the stub is kept for
+  // symmetry with x64
+  RuntimeBoxElementsCallback boxc = &RuntimeBoxElements;
+
+  __ Pushad();
+
+  // RuntimeBoxElements(heap, obj)
+  {
+    __ ChangeAlign(2);
+    Masm::Align a(masm());
+
+    __ push(eax);
+    __ push(Immediate(reinterpret_cast<uint32_t>(masm()->heap())));
+    __ mov(eax, Immediate(*reinterpret_cast<uint32_t*>(&boxc)));
+    __ call(eax);
+    __ addl(esp, Immediate(2 * 4));
+
+    __ ChangeAlign(-2);
+  }
+
+  __ Popad(reg_nil);
+
+  GenerateEpilogue(0);
+}
+
+
 void HashValueStub::Generate() {
   GeneratePrologue();
 
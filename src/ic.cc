@@ -0,0 +1,85 @@
+#include "ic.h"
+#include "heap.h" // Heap
+#include "heap-inl.h" // HValue::GetTag
+
+#include <string.h> // memset
+
+namespace candor {
+namespace internal {
+
+PropertyIC::PropertyIC(bool is_store) : length_(0),
+                                        hits_(0),
+                                        misses_(0),
+                                        is_store_(is_store) {
+  memset(entries_, 0, sizeof(entries_));
+}
+
+
+PropertyIC* PropertyIC::New(Heap* heap, bool is_store) {
+  PropertyIC* ic = new PropertyIC(is_store);
+  heap->ics()->Push(ic);
+
+  return ic;
+}
+
+
+void PropertyIC::Update(char* shape, char* transition, intptr_t offset) {
+  if (length_ == kMegamorphicLength) return;
+
+  // Entry might be missed because object's map was too small for transition
+  for (intptr_t i = 0; i < length_; i++) {
+    if (entries_[i].shape == shape) return;
+  }
+
+  if (length_ == kMaxEntries) {
+    // Existing entries are still valid and are checked before fallback
+    length_ = kMegamorphicLength;
+    return;
+  }
+
+  entries_[length_].shape = shape;
+  entries_[length_].transition = transition;
+  entries_[length_].offset = offset;
+  length_++;
+}
+
+
+void PropertyIC::Reset() {
+  length_ = 0;
+  memset(entries_, 0, sizeof(entries_));
+}
+
+
+PropertyIC::State PropertyIC::state() {
+  if (length_ == kMegamorphicLength) return kMegamorphic;
+  if (length_ == 0) return kUninitialized;
+  if (length_ == 1) return kMonomorphic;
+
+  return kPolymorphic;
+}
+
+GlobalCell::GlobalCell() : object_(NULL), map_(NULL), offset_(0) {
+}
+
+
+GlobalCell* GlobalCell::New(Heap* heap) {
+  GlobalCell* cell = new GlobalCell();
+  heap->global_cells()->Push(cell);
+
+  return cell;
+}
+
+
+void GlobalCell::Update(char* object, char* map, intptr_t offset) {
+  object_ = object;
+  map_ = map;
+  offset_ = offset;
+}
+
+
+void GlobalCell::Reset() {
+  Update(NULL, NULL, 0);
+}
+
+} // namespace internal
+} // namespace candor
@@ -0,0 +1,139 @@
+#ifndef _SRC_IC_H_
+#define _SRC_IC_H_
+
+#include "utils.h" // List
+
+#include <stdint.h> // uint32_t
+#include <unistd.h> // intptr_t
+
+namespace candor {
+namespace internal {
+
+// Forward declarations
+class Heap;
+class PropertyIC;
+class GlobalCell;
+
+typedef List<PropertyIC*, EmptyClass> PropertyICList;
+typedef List<GlobalCell*, EmptyClass> GlobalCellList;
+
+// Inline cache of property access site with a constant key (`a.b`, `a.b = 1`).
+//
+// Cache is a heap-owned cell that generated code is referencing directly,
+// entries are (shape, transition, offset) triples:
+//
+//  * shape - shape of the object before access
+//  * transition - shape of the object after store (NULL if it is unchanged)
+//  * offset - offset of value's slot in object's map
+//
+// Site checks first entry inline, others are checked by PropertyICStub.
+// Misses are recorded by RuntimePropertyICMiss, after kMaxEntries different
+// shapes site becomes megamorphic and falls back to LookupPropertyStub.
+//
+// Shapes live in old space and are reachable from the root shape, so they're
+// only moving on compacting old space GC, which relocates cached ones.
+class PropertyIC {
+ public:
+  enum State {
+    kUninitialized,
+    kMonomorphic,
+    kPolymorphic,
+    kMegamorphic
+  };
+
+  PropertyIC(bool is_store);
+
+  // Allocates new cache and registers it in heap
+  static PropertyIC* New(Heap* heap, bool is_store);
+
+  // Records result of the runtime lookup
+  void Update(char* shape, char* transition, intptr_t offset);
+
+  // Forgets all entries (keeps counters)
+  void Reset();
+
+  State state();
+
+  // Number of filled entries (megamorphic site keeps all of them)
+  inline int entry_count() {
+    return length_ == kMegamorphicLength ? kMaxEntries : length_;
+  }
+  inline char** shape_slot(int i) { return &entries_[i].shape; }
+  inline char** transition_slot(int i) { return &entries_[i].transition; }
+
+  inline bool is_store() { return is_store_ != 0; }
+  inline intptr_t hits() { return hits_; }
+  inline intptr_t misses() { return misses_; }
+  inline void Miss() { misses_++; }
+
+  static const int kMaxEntries = 4;
+  static const intptr_t kMegamorphicLength = -1;
+
+  static const int kLengthOffset = 0;
+  static const int kHitsOffset = sizeof(intptr_t);
+  static const int kMissesOffset = 2 * sizeof(intptr_t);
+  static const int kIsStoreOffset = 3 * sizeof(intptr_t);
+  static const int kEntriesOffset = 4 * sizeof(intptr_t);
+
+  static const int kEntrySize = 3 * sizeof(intptr_t);
+  static const int kEntryShapeOffset = 0;
+  static const int kEntryTransitionOffset = sizeof(intptr_t);
+  static const int kEntryOffsetOffset = 2 * sizeof(intptr_t);
+
+  static inline int EntryOffset(int index) {
+    return kEntriesOffset + index * kEntrySize;
+  }
+
+ private:
+  struct Entry {
+    char* shape;
+    char* transition;
+    intptr_t offset;
+  };
+
+  // NOTE: layout is used by generated code (see offsets above)
+  intptr_t length_;
+  intptr_t hits_;
+  intptr_t misses_;
+  intptr_t is_store_;
+  Entry entries_[kMaxEntries];
+};
+
+// Cell of global object's property loaded with a constant key
+// (`global.print`). Generated code embeds cell's address and reads value's
+// slot directly while both global object and its map are the cached ones
+// (replacing the global or growing its map makes the check fail).
+//
+// Cells are filled by RuntimeLookupGlobalProperty and cleared on property
+// deletion (value's slot might be reused by another key). GC treats them as
+// weak: moved object and map are relocated, cell is cleared only if any of
+// them was collected.
+class GlobalCell {
+ public:
+  GlobalCell();
+
+  // Allocates new cell and registers it in heap
+  static GlobalCell* New(Heap* heap);
+
+  void Update(char* object, char* map, intptr_t offset);
+  void Reset();
+
+  inline char* object() { return object_; }
+  inline char* map() { return map_; }
+  inline intptr_t offset() { return offset_; }
+
+  static const int kObjectOffset = 0;
+  static const int kMapOffset = sizeof(intptr_t);
+  static const int kOffsetOffset = 2 * sizeof(intptr_t);
+
+ private:
+  // NOTE: layout is used by generated code (see offsets above)
+  char* object_;
+  char* map_;
+  intptr_t offset_;
+};
+
+} // namespace internal
+} // namespace candor
+
+#endif // _SRC_IC_H_
@@ -42,8 +42,6 @@ typedef ZoneList<LInstruction*> LInstructionList;
     V(Call) \
     V(CollectGarbage) \
     V(GetStackTrace) \
-    V(AllocateObject) \
-    V(AllocateArray) \
     V(Phi)
 
 #define LIR_INSTRUCTION_TYPES(V) \
@@ -52,6 +50,8 @@ typedef ZoneList<LInstruction*> LInstructionList;
     V(Gap) \
     V(Function) \
     V(Literal) \
+    V(AllocateObject) \
+    V(AllocateArray) \
     V(Branch) \
     V(Goto) \
     LIR_INSTRUCTION_SIMPLE_TYPES(V)
@@ -270,6 +270,28 @@ class LLiteral : public LInstruction {
   ScopeSlot* root_slot_;
 };
 
+class LAllocateObject : public LInstruction {
+ public:
+  LAllocateObject(int size) : LInstruction(kAllocateObject), size_(size) {
+  }
+
+  INSTRUCTION_METHODS(AllocateObject)
+
+ private:
+  int size_;
+};
+
+class LAllocateArray : public LInstruction {
+ public:
+  LAllocateArray(int size) : LInstruction(kAllocateArray), size_(size) {
+  }
+
+  INSTRUCTION_METHODS(AllocateArray)
+
+ private:
+  int size_;
+};
+
 #define DEFAULT_INSTR_IMPLEMENTATION(V) \
   class L##V : public LInstruction { \
    public: \
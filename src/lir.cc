@@ -5,6 +5,7 @@
 #include "lir-instructions.h"
 #include "lir-instructions-inl.h"
 #include "source-map.h" // SourceMap
+#include "stack-map.h" // SafePoint
 #include <limits.h> // INT_MAX
 #include <string.h> // memset
 
@@ -712,10 +713,45 @@ void LGen::AllocateSpills() {
 }
 
 
+bool LGen::HoldsValueAt(LInstruction* instr, LInterval* interval) {
+  if (instr->result == NULL || instr->result->interval() != interval) {
+    return true;
+  }
+
+  // Result is written after the calls made by instruction, until then its
+  // slot holds whatever was spilled there before (unless it's an input too)
+  for (int i = 0; i < instr->input_count(); i++) {
+    if (instr->inputs[i]->interval() == interval) return true;
+  }
+
+  return false;
+}
+
+
+void LGen::ComputeSafePointSlots(LInstruction* instr, uint8_t* slots) {
+  memset(slots, 0, SafePoint::BitmapSize(spill_index_));
+
+  // Spilled values that are alive at instruction
+  LIntervalList::Item* head = intervals_.head();
+  for (; head != NULL; head = head->next()) {
+    LInterval* interval = head->value();
+    if (!interval->is_stackslot()) continue;
+    if (interval->index() < 0 || interval->index() >= spill_index_) continue;
+    if (!interval->Covers(instr->id)) continue;
+    if (!HoldsValueAt(instr, interval)) continue;
+
+    slots[interval->index() >> 3] |= 1 << (interval->index() & 7);
+  }
+}
+
+
 void LGen::Generate(Masm* masm, SourceMap* map) {
   // +1 for argc
   masm->stack_slots(spill_index_ + 1);
 
+  uint8_t* slots = reinterpret_cast<uint8_t*>(Zone::current()->Allocate(
+      SafePoint::BitmapSize(spill_index_) + 1));
+
   // Generate all instructions
   LInstructionList::Item* ihead = instructions_.head();
   for (; ihead != NULL; ihead = ihead->next()) {
@@ -725,6 +761,11 @@ void LGen::Generate(Masm* masm, SourceMap* map) {
         instr->hir()->ast()->offset() >= 0) {
       map->Push(masm->offset(), instr->hir()->ast()->offset());
     }
+
+    // Describe frame for calls made by instruction
+    ComputeSafePointSlots(instr, slots);
+    masm->SafePointSlots(spill_index_, slots);
+
     instr->Generate(masm);
   }
 
@@ -206,6 +206,12 @@ class LGen : public ZoneObject {
   void AllocateBlockedReg(LInterval* current);
   void AllocateSpills();
 
+  // Set bits of spill slots holding live values at instruction
+  void ComputeSafePointSlots(LInstruction* instr, uint8_t* slots);
+
+  // False if `interval` is a result of `instr`, defined after it
+  bool HoldsValueAt(LInstruction* instr, LInterval* interval);
+
   void VisitInstruction(HIRInstruction* instr);
   HIR_INSTRUCTION_TYPES(LGEN_VISITOR)
 
@@ -1,6 +1,7 @@
 #include "macroassembler.h"
 #include "lir.h"
 #include "lir-inl.h"
+#include "stack-map.h" // StackMap
 
 namespace candor {
 namespace internal {
@@ -45,5 +46,52 @@ void Masm::Move(LUse* dst, Immediate src) {
   }
 }
 
+
+Masm::UntaggedRegister::UntaggedRegister(Masm* masm, Register reg)
+    : masm_(masm),
+      registers_(masm->safepoint_registers_) {
+  masm->safepoint_registers_ &= ~(1 << SavedRegisterIndex(reg));
+}
+
+
+Masm::UntaggedRegister::~UntaggedRegister() {
+  masm_->safepoint_registers_ = registers_;
+}
+
+
+void Masm::SafePointSlots(uint32_t slot_count, uint8_t* slots) {
+  safepoint_slot_count_ = slot_count;
+  safepoint_slots_ = slots;
+}
+
+
+void Masm::RecordSafePoint() {
+  if (stack_map_ == NULL) return;
+
+  assert(static_cast<uint32_t>(spill_index_) <= SafePoint::kMaxMasmSlots);
+  uint32_t spill_tags = spill_index_ == SafePoint::kMaxMasmSlots ?
+      spill_tags_ :
+      spill_tags_ & ((1 << spill_index_) - 1);
+
+  stack_map_->Push(new SafePoint(offset(),
+                                 safepoint_slot_count_,
+                                 safepoint_slots_,
+                                 spill_index_,
+                                 spill_tags,
+                                 safepoint_registers_));
+}
+
+
+void Masm::FinalizeSafePoints(uint32_t frame_size) {
+  if (stack_map_ == NULL) return;
+
+  // Safepoints of previous functions are already finalized
+  StackMap::SafePointQueue::Item* item = stack_map_->queue()->tail();
+  for (; item != NULL; item = item->prev()) {
+    if (item->value()->frame_size() != 0) break;
+    item->value()->frame_size(frame_size);
+  }
+}
+
 } // namespace internal
 } // namespace candor
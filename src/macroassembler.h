@@ -14,6 +14,7 @@ namespace internal {
 // Forward declaration
 class BaseStub;
 class LUse;
+class StackMap;
 
 class Masm : public Assembler {
  public:
@@ -102,6 +103,20 @@ class Masm : public Assembler {
   // Perform garbage collection if needed (heap flag is set)
   void CheckGC();
 
+  // Write barrier: put `slot` into store buffer if `object` is in old space
+  // and `value` is in new space (`slot` register may be clobbered)
+  void RecordWrite(Register object, Register slot, Register value);
+
+  // Write barrier for map's slot, storing heap pointer into map also makes
+  // GC visit it again (see HMap::kUnboxed)
+  void RecordMapWrite(Register map, Register slot, Register value);
+
+  // Load/store value at `offset` in object's map, boxing and unboxing raw
+  // doubles of kDouble elements (see HMap). Store clobbers `offset`.
+  // NOTE: ia32 has no kDouble elements, its versions are plain moves
+  void LoadProperty(Register obj, Register offset, Register result);
+  void StoreProperty(Register obj, Register offset, Register value);
+
   void IsNil(Register reference, Label* not_nil, Label* is_nil);
   void IsUnboxed(Register reference, Label* not_unboxed, Label* unboxed);
 
@@ -119,6 +134,35 @@ class Masm : public Assembler {
   void Move(LUse* dst, Operand& src);
   void Move(LUse* dst, Immediate src);
 
+  // Safepoints: LGen describes function's frame before generating each
+  // instruction and every call emitted by it is recorded in the stack map
+  // together with active Masm spills (stubs aren't recording anything,
+  // see StackMap)
+  class UntaggedRegister {
+   public:
+    UntaggedRegister(Masm* masm, Register reg);
+    ~UntaggedRegister();
+   private:
+    Masm* masm_;
+    uint32_t registers_;
+  };
+
+  void SafePointSlots(uint32_t slot_count, uint8_t* slots);
+  void RecordSafePoint();
+
+  // Sets frame size of safepoints recorded since the function's prologue
+  void FinalizeSafePoints(uint32_t frame_size);
+
+  // False for registers that hold raw values (scratch, stack pointers and
+  // registers marked by UntaggedRegister)
+  bool IsTaggedRegister(Register reg);
+
+  // Index of the register in the area saved by Pushad()
+  // (starting from the one that is closest to the frame pointer)
+  static int SavedRegisterIndex(Register reg);
+
+  inline void stack_map(StackMap* map) { stack_map_ = map; }
+
   // Sets correct environment and calls function
   void Call(Register addr);
   void Call(Operand& addr);
@@ -160,7 +204,17 @@ class Masm : public Assembler {
   // Temporary operand
   Operand spill_operand_;
 
+  // Frame description for the following calls
+  StackMap* stack_map_;
+  uint32_t safepoint_slot_count_;
+  uint8_t* safepoint_slots_;
+  uint32_t safepoint_registers_;
+
+  // Bit per Masm spill, set if it holds a tagged value
+  uint32_t spill_tags_;
+
   friend class Align;
+  friend class UntaggedRegister;
 };
 
 } // namespace internal
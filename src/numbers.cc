@@ -0,0 +1,557 @@
+#include "numbers.h"
+#include "utils.h" // StringGetNumSign, is_num
+
+#include <stdlib.h> // strtod
+#include <string.h> // memcpy, memset
+
+namespace candor {
+namespace internal {
+
+static const char kDigitPairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const uint64_t kPow10[] = {
+  1ULL,
+  10ULL,
+  100ULL,
+  1000ULL,
+  10000ULL,
+  100000ULL,
+  1000000ULL,
+  10000000ULL,
+  100000000ULL,
+  1000000000ULL,
+  10000000000ULL,
+  100000000000ULL,
+  1000000000000ULL,
+  10000000000000ULL,
+  100000000000000ULL,
+  1000000000000000ULL,
+  10000000000000000ULL,
+  100000000000000000ULL,
+  1000000000000000000ULL,
+  10000000000000000000ULL
+};
+
+
+// Writes digits of `value` right to left, ending at `end`
+static inline char* WriteDigits(uint64_t value, char* end) {
+  while (value >= 100) {
+    uint32_t pair = static_cast<uint32_t>(value % 100) << 1;
+    value /= 100;
+    *--end = kDigitPairs[pair + 1];
+    *--end = kDigitPairs[pair];
+  }
+
+  if (value >= 10) {
+    uint32_t pair = static_cast<uint32_t>(value) << 1;
+    *--end = kDigitPairs[pair + 1];
+    *--end = kDigitPairs[pair];
+  } else {
+    *--end = '0' + static_cast<char>(value);
+  }
+
+  return end;
+}
+
+
+uint32_t IntegralToString(int64_t value, char* buffer) {
+  char digits[24];
+  char* end = digits + sizeof(digits);
+
+  // NOTE: Negation is done in unsigned to handle INT64_MIN
+  uint64_t abs = value < 0 ? 0 - static_cast<uint64_t>(value) :
+                             static_cast<uint64_t>(value);
+  char* start = WriteDigits(abs, end);
+  if (value < 0) *--start = '-';
+
+  uint32_t length = end - start;
+  memcpy(buffer, start, length);
+
+  return length;
+}
+
+
+// Floating point number f * 2^e with 64-bit significand
+// (see "Printing Floating-Point Numbers Quickly and Accurately with
+// Integers" by Florian Loitsch)
+class DiyFp {
+ public:
+  DiyFp() : f(0), e(0) {}
+  DiyFp(uint64_t f, int e) : f(f), e(e) {}
+
+  explicit DiyFp(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    int biased_e = static_cast<int>((bits & kExponentMask) >> 52);
+    uint64_t significand = bits & kSignificandMask;
+    if (biased_e != 0) {
+      f = significand + kHiddenBit;
+      e = biased_e - kExponentBias;
+    } else {
+      // Denormal
+      f = significand;
+      e = 1 - kExponentBias;
+    }
+  }
+
+  inline DiyFp operator-(const DiyFp& rhs) const {
+    return DiyFp(f - rhs.f, e);
+  }
+
+  // Product rounded to upper 64 bits
+  inline DiyFp operator*(const DiyFp& rhs) const {
+    const uint64_t kMask = 0xffffffff;
+    uint64_t a = f >> 32;
+    uint64_t b = f & kMask;
+    uint64_t c = rhs.f >> 32;
+    uint64_t d = rhs.f & kMask;
+    uint64_t ac = a * c;
+    uint64_t bc = b * c;
+    uint64_t ad = a * d;
+    uint64_t bd = b * d;
+    uint64_t tmp = (bd >> 32) + (ad & kMask) + (bc & kMask);
+
+    // Round
+    tmp += 1U << 31;
+
+    return DiyFp(ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), e + rhs.e + 64);
+  }
+
+  inline DiyFp Normalize() const {
+    DiyFp res(f, e);
+    while ((res.f & (1ULL << 63)) == 0) {
+      res.f <<= 1;
+      res.e--;
+    }
+    return res;
+  }
+
+  // Boundaries m- and m+ of the interval that rounds to the value, both
+  // share exponent of the normalized m+
+  inline void NormalizedBoundaries(DiyFp* minus, DiyFp* plus) const {
+    DiyFp pl((f << 1) + 1, e - 1);
+    pl = pl.Normalize();
+
+    // Lower boundary is closer if value is a power of two
+    DiyFp mi = f == kHiddenBit ? DiyFp((f << 2) - 1, e - 2) :
+                                 DiyFp((f << 1) - 1, e - 1);
+    mi.f <<= mi.e - pl.e;
+    mi.e = pl.e;
+
+    *plus = pl;
+    *minus = mi;
+  }
+
+  uint64_t f;
+  int e;
+
+  static const uint64_t kExponentMask = 0x7ff0000000000000ULL;
+  static const uint64_t kSignificandMask = 0x000fffffffffffffULL;
+  static const uint64_t kHiddenBit = 0x0010000000000000ULL;
+  static const int kExponentBias = 0x3ff + 52;
+};
+
+
+struct CachedPower {
+  uint64_t f;
+  int16_t e;
+};
+
+// Normalized 10^k for k = -348, -340, ..., 340
+static const CachedPower kCachedPowers[] = {
+  { 0xfa8fd5a0081c0288ULL, -1220 }, // 1e-348
+  { 0xbaaee17fa23ebf76ULL, -1193 }, // 1e-340
+  { 0x8b16fb203055ac76ULL, -1166 }, // 1e-332
+  { 0xcf42894a5dce35eaULL, -1140 }, // 1e-324
+  { 0x9a6bb0aa55653b2dULL, -1113 }, // 1e-316
+  { 0xe61acf033d1a45dfULL, -1087 }, // 1e-308
+  { 0xab70fe17c79ac6caULL, -1060 }, // 1e-300
+  { 0xff77b1fcbebcdc4fULL, -1034 }, // 1e-292
+  { 0xbe5691ef416bd60cULL, -1007 }, // 1e-284
+  { 0x8dd01fad907ffc3cULL, -980 }, // 1e-276
+  { 0xd3515c2831559a83ULL, -954 }, // 1e-268
+  { 0x9d71ac8fada6c9b5ULL, -927 }, // 1e-260
+  { 0xea9c227723ee8bcbULL, -901 }, // 1e-252
+  { 0xaecc49914078536dULL, -874 }, // 1e-244
+  { 0x823c12795db6ce57ULL, -847 }, // 1e-236
+  { 0xc21094364dfb5637ULL, -821 }, // 1e-228
+  { 0x9096ea6f3848984fULL, -794 }, // 1e-220
+  { 0xd77485cb25823ac7ULL, -768 }, // 1e-212
+  { 0xa086cfcd97bf97f4ULL, -741 }, // 1e-204
+  { 0xef340a98172aace5ULL, -715 }, // 1e-196
+  { 0xb23867fb2a35b28eULL, -688 }, // 1e-188
+  { 0x84c8d4dfd2c63f3bULL, -661 }, // 1e-180
+  { 0xc5dd44271ad3cdbaULL, -635 }, // 1e-172
+  { 0x936b9fcebb25c996ULL, -608 }, // 1e-164
+  { 0xdbac6c247d62a584ULL, -582 }, // 1e-156
+  { 0xa3ab66580d5fdaf6ULL, -555 }, // 1e-148
+  { 0xf3e2f893dec3f126ULL, -529 }, // 1e-140
+  { 0xb5b5ada8aaff80b8ULL, -502 }, // 1e-132
+  { 0x87625f056c7c4a8bULL, -475 }, // 1e-124
+  { 0xc9bcff6034c13053ULL, -449 }, // 1e-116
+  { 0x964e858c91ba2655ULL, -422 }, // 1e-108
+  { 0xdff9772470297ebdULL, -396 }, // 1e-100
+  { 0xa6dfbd9fb8e5b88fULL, -369 }, // 1e-92
+  { 0xf8a95fcf88747d94ULL, -343 }, // 1e-84
+  { 0xb94470938fa89bcfULL, -316 }, // 1e-76
+  { 0x8a08f0f8bf0f156bULL, -289 }, // 1e-68
+  { 0xcdb02555653131b6ULL, -263 }, // 1e-60
+  { 0x993fe2c6d07b7facULL, -236 }, // 1e-52
+  { 0xe45c10c42a2b3b06ULL, -210 }, // 1e-44
+  { 0xaa242499697392d3ULL, -183 }, // 1e-36
+  { 0xfd87b5f28300ca0eULL, -157 }, // 1e-28
+  { 0xbce5086492111aebULL, -130 }, // 1e-20
+  { 0x8cbccc096f5088ccULL, -103 }, // 1e-12
+  { 0xd1b71758e219652cULL, -77 }, // 1e-4
+  { 0x9c40000000000000ULL, -50 }, // 1e4
+  { 0xe8d4a51000000000ULL, -24 }, // 1e12
+  { 0xad78ebc5ac620000ULL, 3 }, // 1e20
+  { 0x813f3978f8940984ULL, 30 }, // 1e28
+  { 0xc097ce7bc90715b3ULL, 56 }, // 1e36
+  { 0x8f7e32ce7bea5c70ULL, 83 }, // 1e44
+  { 0xd5d238a4abe98068ULL, 109 }, // 1e52
+  { 0x9f4f2726179a2245ULL, 136 }, // 1e60
+  { 0xed63a231d4c4fb27ULL, 162 }, // 1e68
+  { 0xb0de65388cc8ada8ULL, 189 }, // 1e76
+  { 0x83c7088e1aab65dbULL, 216 }, // 1e84
+  { 0xc45d1df942711d9aULL, 242 }, // 1e92
+  { 0x924d692ca61be758ULL, 269 }, // 1e100
+  { 0xda01ee641a708deaULL, 295 }, // 1e108
+  { 0xa26da3999aef774aULL, 322 }, // 1e116
+  { 0xf209787bb47d6b85ULL, 348 }, // 1e124
+  { 0xb454e4a179dd1877ULL, 375 }, // 1e132
+  { 0x865b86925b9bc5c2ULL, 402 }, // 1e140
+  { 0xc83553c5c8965d3dULL, 428 }, // 1e148
+  { 0x952ab45cfa97a0b3ULL, 455 }, // 1e156
+  { 0xde469fbd99a05fe3ULL, 481 }, // 1e164
+  { 0xa59bc234db398c25ULL, 508 }, // 1e172
+  { 0xf6c69a72a3989f5cULL, 534 }, // 1e180
+  { 0xb7dcbf5354e9beceULL, 561 }, // 1e188
+  { 0x88fcf317f22241e2ULL, 588 }, // 1e196
+  { 0xcc20ce9bd35c78a5ULL, 614 }, // 1e204
+  { 0x98165af37b2153dfULL, 641 }, // 1e212
+  { 0xe2a0b5dc971f303aULL, 667 }, // 1e220
+  { 0xa8d9d1535ce3b396ULL, 694 }, // 1e228
+  { 0xfb9b7cd9a4a7443cULL, 720 }, // 1e236
+  { 0xbb764c4ca7a44410ULL, 747 }, // 1e244
+  { 0x8bab8eefb6409c1aULL, 774 }, // 1e252
+  { 0xd01fef10a657842cULL, 800 }, // 1e260
+  { 0x9b10a4e5e9913129ULL, 827 }, // 1e268
+  { 0xe7109bfba19c0c9dULL, 853 }, // 1e276
+  { 0xac2820d9623bf429ULL, 880 }, // 1e284
+  { 0x80444b5e7aa7cf85ULL, 907 }, // 1e292
+  { 0xbf21e44003acdd2dULL, 933 }, // 1e300
+  { 0x8e679c2f5e44ff8fULL, 960 }, // 1e308
+  { 0xd433179d9c8cb841ULL, 986 }, // 1e316
+  { 0x9e19db92b4e31ba9ULL, 1013 }, // 1e324
+  { 0xeb96bf6ebadf77d9ULL, 1039 }, // 1e332
+  { 0xaf87023b9bf0ee6bULL, 1066 }, // 1e340
+};
+
+
+// Returns cached power c = 10^-k, such that binary exponent of w * c
+// (for w with exponent `e`) lies in [-60, -32]
+static inline DiyFp GetCachedPower(int e, int* k) {
+  // log10(2)
+  double dk = (-61 - e) * 0.30102999566398114 + 347;
+  int ik = static_cast<int>(dk);
+  if (dk - ik > 0.0) ik++;
+
+  uint32_t index = static_cast<uint32_t>((ik >> 3) + 1);
+  *k = -(-348 + static_cast<int>(index << 3));
+
+  return DiyFp(kCachedPowers[index].f, kCachedPowers[index].e);
+}
+
+
+// Moves last digit closer to the exact value, while staying in the interval
+static inline void GrisuRound(char* buffer,
+                              int length,
+                              uint64_t delta,
+                              uint64_t rest,
+                              uint64_t ten_kappa,
+                              uint64_t wp_w) {
+  while (rest < wp_w && delta - rest >= ten_kappa &&
+         (rest + ten_kappa < wp_w ||
+          wp_w - rest > rest + ten_kappa - wp_w)) {
+    buffer[length - 1]--;
+    rest += ten_kappa;
+  }
+}
+
+
+static inline int CountDigits(uint32_t n) {
+  int count = 1;
+  while (count < 10 && n >= kPow10[count]) count++;
+  return count;
+}
+
+
+// Generates shortest digits of a number in the interval (w_p - delta, w_p),
+// value = digits * 10^k
+static void DigitGen(const DiyFp& w,
+                     const DiyFp& w_p,
+                     uint64_t delta,
+                     char* buffer,
+                     int* length,
+                     int* k) {
+  DiyFp one(1ULL << -w_p.e, w_p.e);
+  DiyFp wp_w = w_p - w;
+  uint32_t p1 = static_cast<uint32_t>(w_p.f >> -one.e);
+  uint64_t p2 = w_p.f & (one.f - 1);
+  int kappa = CountDigits(p1);
+
+  *length = 0;
+
+  // Integral part
+  while (kappa > 0) {
+    uint32_t pow = static_cast<uint32_t>(kPow10[kappa - 1]);
+    uint32_t d = p1 / pow;
+    p1 %= pow;
+    if (d != 0 || *length != 0) buffer[(*length)++] = '0' + d;
+    kappa--;
+
+    uint64_t rest = (static_cast<uint64_t>(p1) << -one.e) + p2;
+    if (rest <= delta) {
+      *k += kappa;
+      GrisuRound(buffer, *length, delta, rest, kPow10[kappa] << -one.e, wp_w.f);
+      return;
+    }
+  }
+
+  // Fractional part
+  while (true) {
+    p2 *= 10;
+    delta *= 10;
+    char d = static_cast<char>(p2 >> -one.e);
+    if (d != 0 || *length != 0) buffer[(*length)++] = '0' + d;
+    p2 &= one.f - 1;
+    kappa--;
+
+    if (p2 < delta) {
+      *k += kappa;
+      int index = -kappa;
+      GrisuRound(buffer,
+                 *length,
+                 delta,
+                 p2,
+                 one.f,
+                 wp_w.f * (index < 20 ? kPow10[index] : 0));
+      return;
+    }
+  }
+}
+
+
+// Writes shortest digits of positive finite `value`, value = digits * 10^k
+static void Grisu2(double value, char* buffer, int* length, int* k) {
+  DiyFp v(value);
+  DiyFp w_m;
+  DiyFp w_p;
+  v.NormalizedBoundaries(&w_m, &w_p);
+
+  DiyFp c_mk = GetCachedPower(w_p.e, k);
+  DiyFp w = v.Normalize() * c_mk;
+  DiyFp wp = w_p * c_mk;
+  DiyFp wm = w_m * c_mk;
+
+  // Stay inside the interval despite multiplication errors
+  wm.f++;
+  wp.f--;
+
+  DigitGen(w, wp, wp.f - wm.f, buffer, length, k);
+}
+
+
+static inline char* WriteExponent(int exponent, char* buffer) {
+  *buffer++ = 'e';
+  if (exponent < 0) {
+    *buffer++ = '-';
+    exponent = -exponent;
+  } else {
+    *buffer++ = '+';
+  }
+
+  char digits[4];
+  char* end = digits + sizeof(digits);
+  char* start = WriteDigits(exponent, end);
+  memcpy(buffer, start, end - start);
+
+  return buffer + (end - start);
+}
+
+
+uint32_t DoubleToString(double value, char* buffer) {
+  char* start = buffer;
+
+  if (value != value) {
+    memcpy(buffer, "nan", 3);
+    return 3;
+  }
+
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  if ((bits >> 63) != 0) {
+    *buffer++ = '-';
+    value = -value;
+  }
+
+  if (value == 0) {
+    *buffer++ = '0';
+    return buffer - start;
+  }
+
+  if ((bits & DiyFp::kExponentMask) == DiyFp::kExponentMask) {
+    memcpy(buffer, "inf", 3);
+    return buffer - start + 3;
+  }
+
+  char digits[20];
+  int length;
+  int k;
+  Grisu2(value, digits, &length, &k);
+
+  // Position of decimal point relative to the first digit
+  int point = length + k;
+
+  if (length <= point && point <= 21) {
+    // 1234e7 -> 12340000000
+    memcpy(buffer, digits, length);
+    memset(buffer + length, '0', point - length);
+    buffer += point;
+  } else if (0 < point && point <= 21) {
+    // 1234e-2 -> 12.34
+    memcpy(buffer, digits, point);
+    buffer[point] = '.';
+    memcpy(buffer + point + 1, digits + point, length - point);
+    buffer += length + 1;
+  } else if (-6 < point && point <= 0) {
+    // 1234e-6 -> 0.001234
+    buffer[0] = '0';
+    buffer[1] = '.';
+    memset(buffer + 2, '0', -point);
+    memcpy(buffer + 2 - point, digits, length);
+    buffer += 2 - point + length;
+  } else {
+    // 1234e30 -> 1.234e+33
+    *buffer++ = digits[0];
+    if (length > 1) {
+      *buffer++ = '.';
+      memcpy(buffer, digits + 1, length - 1);
+      buffer += length - 1;
+    }
+    buffer = WriteExponent(point - 1, buffer);
+  }
+
+  return buffer - start;
+}
+
+
+bool StringToIntegral(const char* value, uint32_t length, int64_t* result) {
+  // Longer numbers might not fit into unboxed value
+  static const uint32_t kMaxDigits = 18;
+
+  bool negative = length > 0 && value[0] == '-';
+  uint32_t index = negative ? 1 : 0;
+  if (length == index || length - index > kMaxDigits) return false;
+
+  int64_t number = 0;
+  for (; index < length; index++) {
+    uint32_t digit = static_cast<unsigned char>(value[index]) - '0';
+    if (digit > 9) return false;
+
+    number = number * 10 + digit;
+  }
+
+  // -0 is a double
+  if (negative && number == 0) return false;
+
+  *result = negative ? -number : number;
+
+  return true;
+}
+
+
+double StringToDouble(const char* value, uint32_t length) {
+  // Powers of ten that are exactly representable as doubles
+  static const double kExactPow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+  static const int kMaxExactPow10 = 22;
+  static const uint64_t kMaxExactInteger = 1ULL << 53;
+
+  bool sign = false;
+  uint32_t start = StringGetNumSign(value, length, &sign);
+
+  // Value is `digits * 10 ^ exponent`, digits that don't fit into uint64_t
+  // are dropped
+  uint64_t digits = 0;
+  uint32_t count = 0;
+  int exponent = 0;
+  bool dot = false;
+  bool truncated = false;
+
+  uint32_t index = start;
+  for (; index < length; index++) {
+    if (value[index] == '.' && !dot) {
+      dot = true;
+      continue;
+    }
+    if (!is_num(value[index])) break;
+
+    // Leading zeroes
+    if (count == 0 && value[index] == '0') {
+      if (dot) exponent--;
+      continue;
+    }
+
+    if (count < 19) {
+      digits = digits * 10 + (value[index] - '0');
+      count++;
+      if (dot) exponent--;
+    } else {
+      truncated = true;
+      if (!dot) exponent++;
+    }
+  }
+
+  double result;
+  if (!truncated &&
+      digits <= kMaxExactInteger &&
+      -kMaxExactPow10 <= exponent && exponent <= kMaxExactPow10) {
+    // Both operands are exact, so the only rounding is correct one
+    result = static_cast<double>(digits);
+    if (exponent < 0) {
+      result /= kExactPow10[-exponent];
+    } else {
+      result *= kExactPow10[exponent];
+    }
+  } else {
+    // Slow case: strtod() is correctly rounded
+    // NOTE: It depends on locale's decimal point, which isn't changed by
+    // candor
+    uint32_t size = index - start;
+    char* str = new char[size + 1];
+    memcpy(str, value + start, size);
+    str[size] = 0;
+    result = strtod(str, NULL);
+    delete[] str;
+  }
+
+  return sign ? -result : result;
+}
+
+} // namespace internal
+} // namespace candor
@@ -0,0 +1,34 @@
+#ifndef _SRC_NUMBERS_H_
+#define _SRC_NUMBERS_H_
+
+#include <stdint.h> // uint32_t, int64_t
+
+namespace candor {
+namespace internal {
+
+// Number <-> string conversions used by runtime coercions.
+//
+// Functions below write at most kMaxNumberLength bytes into `buffer` (no
+// trailing zero) and return number of bytes written.
+static const uint32_t kMaxNumberLength = 32;
+
+// Decimal representation, digits are produced two at a time
+uint32_t IntegralToString(int64_t value, char* buffer);
+
+// Shortest representation that is parsed back into the same double (Grisu2),
+// formatted like ECMAScript's Number.prototype.toString:
+// `1.5`, `0.001`, `1e+21`, `1.5e-7`
+uint32_t DoubleToString(double value, char* buffer);
+
+// Parses strings that consist only of decimal digits (with optional minus)
+// and fit into unboxed number, returns false for everything else
+bool StringToIntegral(const char* value, uint32_t length, int64_t* result);
+
+// Correctly rounded value of decimal number (with optional minus and
+// fraction), parsing stops at the first unexpected character
+double StringToDouble(const char* value, uint32_t length);
+
+} // namespace internal
+} // namespace candor
+
+#endif // _SRC_NUMBERS_H_
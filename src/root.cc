@@ -3,6 +3,7 @@
 #include "ast.h" // AstNode
 #include "heap.h" // HContext
 #include "heap-inl.h"
+#include "numbers.h" // StringToDouble
 #include "utils.h" // List
 
 namespace candor {
@@ -17,14 +18,14 @@ Root::Root(Heap* heap) : heap_(heap) {
   values()->Push(HBoolean::New(heap, Heap::kTenureOld, false));
 
   // Place types
-  values()->Push(HString::New(heap, Heap::kTenureOld, "nil", 3));
-  values()->Push(HString::New(heap, Heap::kTenureOld, "boolean", 7));
-  values()->Push(HString::New(heap, Heap::kTenureOld, "number", 6));
-  values()->Push(HString::New(heap, Heap::kTenureOld, "string", 6));
-  values()->Push(HString::New(heap, Heap::kTenureOld, "object", 6));
-  values()->Push(HString::New(heap, Heap::kTenureOld, "array", 5));
-  values()->Push(HString::New(heap, Heap::kTenureOld, "function", 8));
-  values()->Push(HString::New(heap, Heap::kTenureOld, "cdata", 5));
+  values()->Push(HString::NewInterned(heap, "nil", 3));
+  values()->Push(HString::NewInterned(heap, "boolean", 7));
+  values()->Push(HString::NewInterned(heap, "number", 6));
+  values()->Push(HString::NewInterned(heap, "string", 6));
+  values()->Push(HString::NewInterned(heap, "object", 6));
+  values()->Push(HString::NewInterned(heap, "array", 5));
+  values()->Push(HString::NewInterned(heap, "function", 8));
+  values()->Push(HString::NewInterned(heap, "cdata", 5));
 }
 
 
@@ -85,7 +86,7 @@ char* Root::StringToValue(AstNode* node) {
   uint32_t length;
   const char* unescaped = Unescape(node->value(), node->length(), &length);
 
-  char* result = HString::New(heap(), Heap::kTenureOld, unescaped, length);
+  char* result = HString::NewInterned(heap(), unescaped, length);
 
   delete unescaped;
 
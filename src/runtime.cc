@@ -2,13 +2,11 @@
 #include "heap.h" // Heap
 #include "heap-inl.h"
 #include "utils.h" // ComputeHash, etc
+#include "numbers.h" // IntegralToString, DoubleToString, StringTo*
 
-#define __STDC_FORMAT_MACROS
-#include <inttypes.h> // printf formats for big integers
 #include <stdint.h> // uint32_t
 #include <assert.h> // assert
 #include <string.h> // strncmp
-#include <stdio.h> // snprintf
 #include <sys/types.h> // size_t
 
 namespace candor {
@@ -50,12 +48,29 @@ BINARY_SUB_TYPES(BINARY_OP_TEMPLATE)
 
 char* RuntimeAllocate(Heap* heap,
                       uint32_t bytes) {
+  // Slow path, do a piece of incremental marking
+  heap->gc()->IncrementalMarkingStep();
+
+  // AllocateStub passes tagged size
+  uint32_t size = HNumber::Untag(bytes);
+  if (LargeSpace::IsLarge(size)) return heap->large_space()->Allocate(size);
+
   return heap->new_space()->Allocate(bytes);
 }
 
 
+void RuntimeRecordWrite(Heap* heap, char** slot) {
+  HValue* value = HValue::Cast(*slot);
+
+  if (heap->new_space()->Contains(value)) {
+    heap->store_buffer()->Record(slot);
+  } else {
+    heap->gc()->MarkingBarrier(value);
+  }
+}
+
+
 void RuntimeCollectGarbage(Heap* heap, char* stack_top) {
-  Zone gc_zone;
   heap->gc()->CollectGarbage(stack_top);
 }
 
@@ -100,6 +115,50 @@ intptr_t RuntimeGetHash(Heap* heap, char* value) {
 }
 
 
+// Lookup in shaped object: value's index comes from the shape, inserting
+// new property moves object to the child shape (or to dictionary mode)
+static intptr_t RuntimeLookupShapedProperty(Heap* heap,
+                                            char* obj,
+                                            char* key,
+                                            intptr_t insert) {
+  char* shape = HObject::Shape(obj);
+  int64_t index = HShape::IndexOf(heap, shape, key);
+
+  if (index == -1) {
+    if (!insert) return Heap::kTagNil;
+
+    char* child = HShape::Transition(heap, shape, key);
+    if (child == NULL) {
+      HObject::Normalize(heap, obj);
+      return RuntimeLookupProperty(heap, obj, key, insert);
+    }
+    index = HShape::Length(child) - 1;
+
+    // Map holds `size * 2` values
+    HMap* map = HValue::As<HMap>(HObject::Map(obj));
+    uint32_t capacity = map->size() << 1;
+    if (index >= capacity) {
+      uint32_t size = map->size() == 0 ? 1 : map->size() << 1;
+      char* new_map = HMap::NewEmpty(heap, size);
+      memcpy(new_map + HMap::kSpaceOffset,
+             map->space(),
+             capacity * HValue::kPointerSize);
+
+      char** map_slot = HObject::MapSlot(obj);
+      *map_slot = new_map;
+      heap->RecordWrite(obj, map_slot);
+      *HObject::MaskSlot(obj) = ((size << 1) - 1) * HValue::kPointerSize;
+    }
+
+    char** shape_slot = HObject::ShapeSlot(obj);
+    *shape_slot = child;
+    heap->RecordWrite(obj, shape_slot);
+  }
+
+  return HMap::kSpaceOffset + index * HValue::kPointerSize;
+}
+
+
 intptr_t RuntimeLookupProperty(Heap* heap,
                             char* obj,
                             char* key,
@@ -107,6 +166,10 @@ intptr_t RuntimeLookupProperty(Heap* heap,
   assert(!HValue::Cast(obj)->IsGCMarked());
   assert(!HValue::Cast(obj)->IsSoftGCMarked());
 
+  if (HObject::IsShaped(obj)) {
+    return RuntimeLookupShapedProperty(heap, obj, key, insert);
+  }
+
   char* map = HObject::Map(obj);
   char* space = HValue::As<HMap>(map)->space();
   uint32_t mask = HObject::Mask(obj);
@@ -125,6 +188,21 @@ intptr_t RuntimeLookupProperty(Heap* heap,
     // Negative lookups are prohibited
     if (numkey < 0) return Heap::kTagNil;
 
+    // Grow dense array's store, unless index is too far from the elements
+    if (insert &&
+        HArray::IsDense(obj) &&
+        numkey >= static_cast<int64_t>(HArray::Capacity(obj))) {
+      if (HArray::IsDenseIndex(obj, numkey)) {
+        RuntimeGrowElements(heap, obj, numkey + 1);
+      } else {
+        HArray::MakeSparse(heap, obj);
+      }
+
+      map = HObject::Map(obj);
+      space = HValue::As<HMap>(map)->space();
+      mask = HObject::Mask(obj);
+    }
+
     // Update array's length on insertion (if increased)
     if (insert && HArray::Length(obj, false) <= numkey) {
       HArray::SetLength(obj, numkey + 1);
@@ -136,50 +214,59 @@ intptr_t RuntimeLookupProperty(Heap* heap,
   }
 
   if (is_array && HArray::IsDense(obj)) {
-    // Dense arrays use another lookup mechanism
-    uint32_t index = numkey * HValue::kPointerSize;
-
-    if (index > mask) {
-      if (insert) {
-        RuntimeGrowObject(heap, obj, numkey);
-
-        return RuntimeLookupProperty(heap, obj, keyptr, insert);
-      } else {
-        // get a[length + x] == nil
-        return Heap::kTagNil;
-      }
-    }
+    // Element's slot is its index, get a[capacity + x] == nil
+    if (numkey > mask / HValue::kPointerSize) return Heap::kTagNil;
 
-    return HMap::kSpaceOffset + (index & mask);
+    return HMap::kSpaceOffset + numkey * HValue::kPointerSize;
   } else {
-    // Dive into space and walk it in circular manner
-    uint32_t start = hash & mask;
-
-    uint32_t index = start;
-    char* key_slot = NULL;
-    bool needs_grow = true;
+    // Probe key slots at triangular offsets from `hash & mask` (visits
+    // every slot of power of two sized map), stop at nil key
+    uint32_t index = hash & mask;
+    uint32_t step = 0;
+    uint32_t tombstone = 0;
+    bool has_tombstone = false;
+    bool found = false;
+    bool has_nil = false;
     do {
-      key_slot = *reinterpret_cast<char**>(space + index);
-      if (key_slot == HNil::New() ||
-          (is_array && key_slot == keyptr) ||
-          RuntimeStrictCompare(heap, key_slot, key) == 0) {
-        needs_grow = false;
+      char* key_slot = *reinterpret_cast<char**>(space + index);
+      if (key_slot == HNil::New()) {
+        has_nil = true;
+        break;
+      }
+
+      if (key_slot == HMap::Tombstone()) {
+        // Insertion reuses first deleted slot on the path
+        if (!has_tombstone) {
+          tombstone = index;
+          has_tombstone = true;
+        }
+      } else if (key_slot == keyptr ||
+                 (!is_array && RuntimeStrictCompare(heap, key_slot, key) == 0)) {
+        found = true;
         break;
       }
 
-      index += HValue::kPointerSize;
-      index = index & mask;
-    } while (index != start);
+      step += HValue::kPointerSize;
+      index = (index + step) & mask;
+    } while (step <= mask);
+
+    if (!found) {
+      if (!insert) return Heap::kTagNil;
 
-    if (insert) {
-      // All key slots are filled - rehash and lookup again
-      if (needs_grow) {
+      intptr_t* available = HMap::AvailableSlot(map);
+      if (has_tombstone) {
+        index = tombstone;
+      } else if (has_nil && *available > 0) {
+        *available -= 1;
+      } else {
+        // Load factor limit was reached - rehash and lookup again
         RuntimeGrowObject(heap, obj, 0);
 
         return RuntimeLookupProperty(heap, obj, keyptr, insert);
       }
 
       *reinterpret_cast<char**>(space + index) = keyptr;
+      heap->RecordWrite(map, reinterpret_cast<char**>(space + index));
     }
 
     return HMap::kSpaceOffset + index + (mask + HValue::kPointerSize);
@@ -187,10 +274,62 @@ intptr_t RuntimeLookupProperty(Heap* heap,
 }
 
 
+intptr_t RuntimePropertyICMiss(Heap* heap,
+                               PropertyIC* ic,
+                               char* obj,
+                               char* key) {
+  assert(HValue::GetTag(obj) == Heap::kTagObject);
+  ic->Miss();
+
+  // Only shaped objects are cached
+  char* shape = HObject::Shape(obj);
+  intptr_t offset = RuntimeLookupProperty(heap, obj, key, ic->is_store());
+
+  if (shape == HNil::New() || offset == Heap::kTagNil) return offset;
+
+  // Object might have been normalized
+  if (!HObject::IsShaped(obj)) return offset;
+
+  char* transition = HObject::Shape(obj);
+  ic->Update(shape, transition == shape ? NULL : transition, offset);
+
+  return offset;
+}
+
+
+intptr_t RuntimeLookupGlobalProperty(Heap* heap,
+                                     GlobalCell* cell,
+                                     char* obj,
+                                     char* key) {
+  assert(HValue::GetTag(obj) == Heap::kTagObject);
+
+  intptr_t offset = RuntimeLookupProperty(heap, obj, key, 0);
+
+  // Missing property could be added later without changing the map
+  if (offset == Heap::kTagNil) return offset;
+
+  cell->Update(obj, HObject::Map(obj), offset);
+
+  return offset;
+}
+
+
 char* RuntimeGrowObject(Heap* heap, char* obj, uint32_t min_size) {
   char** map_addr = HObject::MapSlot(obj);
   HMap* map = HValue::As<HMap>(*map_addr);
-  uint32_t size = map->size() << 1;
+
+  if (HValue::GetTag(obj) == Heap::kTagArray && HArray::IsDense(obj)) {
+    return RuntimeGrowElements(heap, obj, min_size);
+  }
+
+  uint32_t size = map->size();
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < size; i++) {
+    if (!map->IsEmptySlot(i)) count++;
+  }
+
+  // Map that is full of tombstones is just rehashed
+  if (count + 1 > HMap::MaxLoad(size) >> 1) size <<= 1;
 
   if (min_size > size) {
     size = PowerOfTwo(min_size);
@@ -201,6 +340,7 @@ char* RuntimeGrowObject(Heap* heap, char* obj, uint32_t min_size) {
 
   // Replace old map with a new
   *map_addr = new_map;
+  heap->RecordWrite(obj, map_addr);
 
   // Update mask
   uint32_t mask = (size - 1) * HValue::kPointerSize;
@@ -208,31 +348,79 @@ char* RuntimeGrowObject(Heap* heap, char* obj, uint32_t min_size) {
 
   // And rehash properties to new map
   uint32_t original_size = map->size();
-  if (HValue::GetTag(obj) == Heap::kTagArray && HArray::IsDense(obj)) {
-    // Dense array's map doesn't contain key pointers, iterate values
-    original_size = original_size << 1;
-    for (uint32_t i = 0; i < original_size; i++) {
-      char* value = *map->GetSlotAddress(i);
-      if (value == HNil::New()) continue;
+  for (uint32_t i = 0; i < original_size; i++) {
+    if (map->IsEmptySlot(i)) continue;
+    char* key = *map->GetSlotAddress(i);
 
-      *HObject::LookupProperty(heap, obj, HNumber::ToPointer(i), 1) = value;
-    }
-  } else {
-    // Object and non-dense arrays contains both keys and pointers
-    for (uint32_t i = 0; i < original_size; i++) {
-      char* key = *map->GetSlotAddress(i);
-      if (key == HNil::New()) continue;
+    char* value = *map->GetSlotAddress(i + original_size);
+
+    *HObject::LookupProperty(heap, obj, key, 1) = value;
+  }
 
-      char* value = *map->GetSlotAddress(i + original_size);
+  return 0;
+}
 
-      *HObject::LookupProperty(heap, obj, key, 1) = value;
+
+char* RuntimeGrowElements(Heap* heap, char* obj, uint32_t min_capacity) {
+  char** map_addr = HObject::MapSlot(obj);
+  HMap* map = HValue::As<HMap>(*map_addr);
+  uint32_t capacity = HArray::Capacity(obj);
+  uint32_t new_capacity = capacity << 1;
+
+  if (min_capacity > new_capacity) {
+    new_capacity = PowerOfTwo(min_capacity);
+  }
+
+  // Both halves of the map are holding elements
+  char* new_map = HMap::NewEmpty(heap, new_capacity >> 1);
+  char** from = reinterpret_cast<char**>(map->space());
+  char** to = reinterpret_cast<char**>(HValue::As<HMap>(new_map)->space());
+
+  // New map isn't in old space, so copied pointers need no write barrier.
+  // Numeric elements are moved to the store that GC won't scan: small
+  // integers as they are, elements with heap numbers - as raw doubles.
+  bool doubles = HMap::HasDoubles(map->addr());
+  HMap::Representation repr = doubles ? HMap::kDouble : HMap::kUnboxed;
+  for (uint32_t i = 0; !doubles && i < capacity; i++) {
+    char* value = from[i];
+    if (value == HNil::New() || HValue::IsUnboxed(value)) continue;
+
+    // Raw double takes a whole slot
+    if (HValue::kPointerSize != sizeof(double) ||
+        HValue::GetTag(value) != Heap::kTagNumber ||
+        !HMap::IsRawDouble(HNumber::DoubleValue(value))) {
+      repr = HMap::kGeneric;
+      break;
+    }
+    repr = HMap::kDouble;
+  }
+
+  // Unbox numbers if elements became kDouble
+  bool unbox = repr == HMap::kDouble && !doubles;
+  for (uint32_t i = 0; i < capacity; i++) {
+    char* value = from[i];
+    if (unbox && value != HNil::New()) {
+      *reinterpret_cast<double*>(&to[i]) = HNumber::DoubleValue(value);
+    } else {
+      to[i] = value;
     }
   }
+  HValue::SetRepresentation<HMap::Representation>(new_map, repr);
+
+  *map_addr = new_map;
+  heap->RecordWrite(obj, map_addr);
+
+  *HObject::MaskSlot(obj) = (new_capacity - 1) * HValue::kPointerSize;
 
   return 0;
 }
 
 
+void RuntimeBoxElements(Heap* heap, char* obj) {
+  HArray::BoxElements(heap, obj);
+}
+
+
 char* RuntimeToString(Heap* heap, char* value) {
   Heap::HeapTag tag = HValue::GetTag(value);
 
@@ -253,19 +441,25 @@ char* RuntimeToString(Heap* heap, char* value) {
     }
    case Heap::kTagNumber:
     {
-      char str[128];
+      char str[kMaxNumberLength];
       uint32_t len;
 
       if (HValue::IsUnboxed(value)) {
         int64_t num = HNumber::IntegralValue(value);
-        // Maximum int64 value may contain only 20 chars, last one for '\0'
-        len = snprintf(str, sizeof(str), "%" PRIi64, num);
-      } else {
-        double num = HNumber::DoubleValue(value);
-        len = snprintf(str, sizeof(str), "%g", num);
+
+        // Loops are converting the same numbers (`'x' + i`) over and over
+        char* result = heap->GetNumberString(num);
+        if (result != NULL) return result;
+
+        len = IntegralToString(num, str);
+        result = HString::New(heap, Heap::kTenureNew, str, len);
+        heap->SetNumberString(num, result);
+
+        return result;
       }
 
-      // And create new string
+      len = DoubleToString(HNumber::DoubleValue(value), str);
+
       return HString::New(heap, Heap::kTenureNew, str, len);
     }
    default:
@@ -282,9 +476,26 @@ char* RuntimeToNumber(Heap* heap, char* value) {
   switch (tag) {
    case Heap::kTagString:
     {
-      char* str = HString::Value(heap, value);
       uint32_t length = HString::Length(value);
 
+      // Short cons strings are copied to the stack instead of flattening
+      char buffer[128];
+      char* str;
+      if (HValue::GetRepresentation<HString::Representation>(value) ==
+              HString::kCons &&
+          length <= sizeof(buffer)) {
+        HString::FlattenCons(value, buffer);
+        str = buffer;
+      } else {
+        str = HString::Value(heap, value);
+      }
+
+      // Integers don't need to be boxed
+      int64_t integral;
+      if (StringToIntegral(str, length, &integral)) {
+        return HNumber::New(heap, integral);
+      }
+
       return HNumber::New(heap, Heap::kTenureNew, StringToDouble(str, length));
     }
    case Heap::kTagBoolean:
@@ -351,6 +562,12 @@ intptr_t RuntimeStrictCompare(Heap* heap, char* lhs, char* rhs) {
 
   switch (tag) {
    case Heap::kTagString:
+    {
+      // Interned strings and used keys have their hashes precomputed
+      uint32_t lhash = HString::CachedHash(lhs);
+      uint32_t rhash = HString::CachedHash(rhs);
+      if (lhash != 0 && rhash != 0 && lhash != rhash) return -1;
+    }
     return RuntimeStringCompare(heap, lhs, rhs);
    case Heap::kTagFunction:
    case Heap::kTagObject:
@@ -376,9 +593,20 @@ intptr_t RuntimeStringCompare(Heap* heap, char* lhs, char* rhs) {
 
   return lhs_length < rhs_length ? -1 :
          lhs_length > rhs_length ? 1 :
-         strncmp(HString::Value(heap, lhs),
-                 HString::Value(heap, rhs),
-                 lhs_length);
+         HString::Compare(lhs, rhs);
+}
+
+
+static char* RuntimeConcatenateFlat(Heap* heap, char* lhs, char* rhs) {
+  uint32_t lhs_length = HString::Length(lhs);
+  char* result = HString::New(heap,
+                              Heap::kTenureNew,
+                              lhs_length + HString::Length(rhs));
+
+  HString::FlattenCons(lhs, HString::Value(heap, result));
+  HString::FlattenCons(rhs, HString::Value(heap, result) + lhs_length);
+
+  return result;
 }
 
 
@@ -390,18 +618,36 @@ char* RuntimeConcatenateStrings(Heap* heap,
 
   char* result;
   if (lhs_length + rhs_length < HString::kMinConsLength) {
-    result = HString::New(heap, Heap::kTenureNew, lhs_length + rhs_length);
-
-    memcpy(HString::Value(heap, result),
-           HString::Value(heap, lhs), lhs_length);
-    memcpy(HString::Value(heap, result) + lhs_length,
-           HString::Value(heap, rhs), rhs_length);
+    result = RuntimeConcatenateFlat(heap, lhs, rhs);
+  } else if (HString::Depth(rhs) != 0 &&
+             HString::RightCons(rhs) != HNil::New() &&
+             HString::Depth(HString::LeftCons(rhs)) == 0 &&
+             lhs_length + HString::Length(HString::LeftCons(rhs)) <=
+                 HString::kMaxLeafLength) {
+    // String is being prepended to - merge it with the leftmost leaf
+    // instead of making the tree deeper
+    char* leaf = RuntimeConcatenateFlat(heap, lhs, HString::LeftCons(rhs));
+    result = HString::NewCons(heap,
+                              Heap::kTenureNew,
+                              lhs_length + rhs_length,
+                              leaf,
+                              HString::RightCons(rhs));
+  } else if (rhs_length <= lhs_length &&
+             (HValue::GetRepresentation<HString::Representation>(lhs) ==
+                  HString::kBuilder ||
+              HString::Depth(lhs) >= HString::kMinBuilderDepth)) {
+    // String is being accumulated (`a = a + b` in a loop)
+    result = HString::Append(heap, lhs, rhs);
   } else {
     result = HString::NewCons(heap,
                               Heap::kTenureNew,
                               lhs_length + rhs_length,
                               lhs,
                               rhs);
+
+    if (HString::Depth(result) > HString::kMaxConsDepth) {
+      result = HString::Rebalance(heap, result);
+    }
   }
 
   return result;
@@ -655,30 +901,110 @@ char* RuntimeSizeof(Heap* heap, char* value) {
 }
 
 
+// Allocates dense array of `length` nil elements
+static char* RuntimeNewElements(Heap* heap, int64_t length) {
+  char* result = HArray::NewEmpty(heap);
+  if (length > HArray::Capacity(result)) {
+    RuntimeGrowElements(heap, result, length);
+  }
+  HArray::SetLength(result, length);
+
+  return result;
+}
+
+
+static inline char** RuntimeElements(char* arr) {
+  return reinterpret_cast<char**>(HObject::Map(arr) + HMap::kSpaceOffset);
+}
+
+
+// Shape's keys in the order of their values, shared by all objects with
+// this shape
+static char* RuntimeEnumCache(Heap* heap, char* shape) {
+  char* cache = HShape::EnumCache(shape);
+  if (cache != HNil::New()) return cache;
+
+  HMap* keys = HValue::As<HMap>(HObject::Map(HShape::Keys(shape)));
+  cache = RuntimeNewElements(heap, HShape::Length(shape));
+  char** elements = RuntimeElements(cache);
+
+  uint32_t size = keys->size();
+  for (uint32_t i = 0; i < size; i++) {
+    int64_t index = HShape::KeyIndex(shape, keys, i);
+    if (index == -1) continue;
+
+    elements[index] = keys->GetSlot(i)->addr();
+  }
+  HValue::SetRepresentation<HMap::Representation>(HObject::Map(cache),
+                                                  HMap::kGeneric);
+
+  *HShape::EnumCacheSlot(shape) = cache;
+  heap->RecordWrite(shape, HShape::EnumCacheSlot(shape));
+
+  return cache;
+}
+
+
 char* RuntimeKeysof(Heap* heap, char* value) {
   Heap::HeapTag tag = HValue::GetTag(value);
 
-  char* result = HArray::NewEmpty(heap);
-
   // Fast-case - return empty array
-  if (tag != Heap::kTagArray && tag != Heap::kTagObject) return result;
+  if (tag != Heap::kTagArray && tag != Heap::kTagObject) {
+    return HArray::NewEmpty(heap);
+  }
+
+  // Shaped object - copy cached keys (in the order of their values)
+  if (HObject::IsShaped(value)) {
+    char* cache = RuntimeEnumCache(heap, HObject::Shape(value));
+    int64_t length = HArray::Length(cache, false);
+    char* result = RuntimeNewElements(heap, length);
+
+    memcpy(RuntimeElements(result),
+           RuntimeElements(cache),
+           length * HValue::kPointerSize);
+    HValue::SetRepresentation<HMap::Representation>(HObject::Map(result),
+                                                    HMap::kGeneric);
+
+    return result;
+  }
+
+  // Dense array - indexes of non-nil elements
+  if (tag == Heap::kTagArray && HArray::IsDense(value)) {
+    int64_t length = HArray::Length(value, false);
+    char** elements = RuntimeElements(value);
+
+    int64_t count = 0;
+    for (int64_t i = 0; i < length; i++) {
+      if (elements[i] != HNil::New()) count++;
+    }
+
+    char* result = RuntimeNewElements(heap, count);
+    char** keys = RuntimeElements(result);
+    for (int64_t i = 0, index = 0; i < length; i++) {
+      if (elements[i] != HNil::New()) keys[index++] = HNumber::ToPointer(i);
+    }
+
+    return result;
+  }
 
   // Slow-case visit all map's slots and put them into array
   HMap* map = HValue::As<HMap>(HObject::Map(value));
 
   uint32_t size = map->size();
-  uint32_t index = 0;
+  int64_t count = 0;
   for (uint32_t i = 0; i < size; i++) {
-    if (map->GetSlot(i) != HValue::Cast(HNil::New())) {
-      char** slot = HObject::LookupProperty(heap,
-                                            result,
-                                            HNumber::ToPointer(index),
-                                            1);
-      *slot = map->GetSlot(i)->addr();
-      index++;
-    }
+    if (!map->IsEmptySlot(i)) count++;
   }
 
+  char* result = RuntimeNewElements(heap, count);
+  char** keys = RuntimeElements(result);
+  int64_t index = 0;
+  for (uint32_t i = 0; i < size; i++) {
+    if (!map->IsEmptySlot(i)) keys[index++] = map->GetSlot(i)->addr();
+  }
+  HValue::SetRepresentation<HMap::Representation>(HObject::Map(result),
+                                                  HMap::kGeneric);
+
   return result;
 }
 
@@ -689,24 +1015,29 @@ char* RuntimeCloneObject(Heap* heap, char* obj) {
 
   char* result = heap->AllocateTagged(Heap::kTagObject,
                                       Heap::kTenureNew,
-                                      2 * HValue::kPointerSize);
+                                      3 * HValue::kPointerSize);
 
   char* map = heap->AllocateTagged(
       Heap::kTagMap,
       Heap::kTenureNew,
-      ((source_map->size() << 1) + 1) * HValue::kPointerSize);
+      ((source_map->size() << 1) + 2) * HValue::kPointerSize);
 
   // Set mask
   *reinterpret_cast<intptr_t*>(result + HObject::kMaskOffset) =
-      (source_map->size() - 1) * HValue::kPointerSize;
+      source_obj->mask();
 
   // Set map
   *reinterpret_cast<char**>(result + HObject::kMapOffset) = map;
 
+  // Clone shares shape with the source object
+  *reinterpret_cast<char**>(result + HObject::kShapeOffset) =
+      source_obj->shape();
+
   // Set map's size
   *reinterpret_cast<intptr_t*>(map + HMap::kSizeOffset) = source_map->size();
+  *HMap::AvailableSlot(map) = *source_map->available_slot();
 
-  // Nullify all map's slots (both keys and values)
+  // Copy all map's slots (keys and values, or only values if shaped)
   uint32_t size = (source_map->size() << 1) * HValue::kPointerSize;
   memcpy(map + HMap::kSpaceOffset, source_map->space(), size);
 
@@ -715,13 +1046,27 @@ char* RuntimeCloneObject(Heap* heap, char* obj) {
 
 
 void RuntimeDeleteProperty(Heap* heap, char* obj, char* property) {
+  // Value's slot might be reused by another property
+  heap->InvalidateGlobalCells(obj);
+
+  // Shapes could only grow - move object to dictionary mode
+  if (HObject::IsShaped(obj)) {
+    if (HShape::IndexOf(heap, HObject::Shape(obj), property) == -1) return;
+
+    HObject::Normalize(heap, obj);
+  }
+
   intptr_t offset = RuntimeLookupProperty(heap, obj, property, 0);
 
+  // Nothing to delete
+  if (offset == Heap::kTagNil) return;
+
   // Dense arrays doesn't have keys
   if (HValue::GetTag(obj) != Heap::kTagArray || !HArray::IsDense(obj)) {
-    // Nil property
+    // Replace key with tombstone, so probing won't stop at it
     intptr_t keyoffset = offset - HObject::Mask(obj) - HValue::kPointerSize;
-    *reinterpret_cast<intptr_t*>(HObject::Map(obj) + keyoffset) = Heap::kTagNil;
+    *reinterpret_cast<intptr_t*>(HObject::Map(obj) + keyoffset) =
+        HMap::kTombstone;
   }
 
   // Nil value
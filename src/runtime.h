@@ -3,6 +3,7 @@
 
 #include "heap.h" // Heap, Heap::HeapTag
 #include "heap-inl.h"
+#include "ic.h" // PropertyIC, GlobalCell
 #include "ast.h" // BinOp
 
 #include <stdint.h> // uint32_t
@@ -12,19 +13,24 @@
 namespace candor {
 namespace internal {
 
-// Wrapper for heap()->new_space()->Allocate()
+// Wrapper for heap()->new_space()->Allocate() (large objects are allocated
+// in heap()->large_space())
 typedef char* (*RuntimeAllocateCallback)(Heap* heap,
                                          uint32_t bytes);
 char* RuntimeAllocate(Heap* heap, uint32_t bytes);
 
+typedef void (*RuntimeRecordWriteCallback)(Heap* heap, char** slot);
+void RuntimeRecordWrite(Heap* heap, char** slot);
+
 typedef void (*RuntimeCollectGarbageCallback)(Heap* heap, char* stack_top);
 void RuntimeCollectGarbage(Heap* heap, char* stack_top);
 
 typedef intptr_t (*RuntimeGetHashCallback)(Heap* heap, char* value);
 intptr_t RuntimeGetHash(Heap* heap, char* value);
 
-// Performs lookup into a hashmap
-// if insert=1 - inserts key into map space
+// Performs lookup into object's map (or shape), returns offset of value's
+// slot in map (nil if object doesn't have property and insert=0)
+// if insert=1 - inserts key into map space (or moves object to a new shape)
 typedef intptr_t (*RuntimeLookupPropertyCallback)(Heap* heap,
                                                   char* obj,
                                                   char* key,
@@ -34,10 +40,35 @@ intptr_t RuntimeLookupProperty(Heap* heap,
                                char* key,
                                intptr_t insert);
 
+// Lookup from inline cache's site, records object's shape and offset in
+// cache if the result could be reused (see PropertyIC)
+typedef intptr_t (*RuntimePropertyICMissCallback)(Heap* heap,
+                                                  PropertyIC* ic,
+                                                  char* obj,
+                                                  char* key);
+intptr_t RuntimePropertyICMiss(Heap* heap,
+                               PropertyIC* ic,
+                               char* obj,
+                               char* key);
+
+// Lookup of global object's property, fills the cell (see GlobalCell)
+typedef intptr_t (*RuntimeLookupGlobalPropertyCallback)(Heap* heap,
+                                                        GlobalCell* cell,
+                                                        char* obj,
+                                                        char* key);
+intptr_t RuntimeLookupGlobalProperty(Heap* heap,
+                                     GlobalCell* cell,
+                                     char* obj,
+                                     char* key);
+
 typedef char* (*RuntimeGrowObjectCallback)(Heap* heap,
                                            char* obj,
                                            uint32_t min_size);
 char* RuntimeGrowObject(Heap* heap, char* obj, uint32_t min_size);
+char* RuntimeGrowElements(Heap* heap, char* obj, uint32_t min_capacity);
+
+typedef void (*RuntimeBoxElementsCallback)(Heap* heap, char* obj);
+void RuntimeBoxElements(Heap* heap, char* obj);
 
 typedef char* (*RuntimeCoerceCallback)(Heap* heap, char* value);
 char* RuntimeToString(Heap* heap, char* value);
@@ -65,6 +96,7 @@ char* RuntimeSizeof(Heap* heap, char* value);
 typedef char* (*RuntimeKeysofCallback)(Heap* heap, char* value);
 char* RuntimeKeysof(Heap* heap, char* value);
 
+typedef char* (*RuntimeCloneObjectCallback)(Heap* heap, char* obj);
 char* RuntimeCloneObject(Heap* heap, char* obj);
 
 typedef void (*RuntimeDeletePropertyCallback)(Heap* heap,
@@ -0,0 +1,66 @@
+#include "stack-map.h"
+#include "utils.h" // AVLTree
+
+#include <stdlib.h> // NULL
+#include <unistd.h> // intptr_t
+#include <stdint.h> // uint32_t
+#include <string.h> // memcpy
+
+namespace candor {
+namespace internal {
+
+SafePoint::SafePoint(uint32_t jit_offset,
+                     uint32_t slot_count,
+                     uint8_t* slots,
+                     uint32_t masm_slot_count,
+                     uint32_t masm_slots,
+                     uint32_t registers) : jit_offset_(jit_offset),
+                                           slot_count_(slot_count),
+                                           slots_(NULL),
+                                           masm_slot_count_(masm_slot_count),
+                                           masm_slots_(masm_slots),
+                                           registers_(registers),
+                                           frame_size_(0) {
+  uint32_t size = BitmapSize(slot_count);
+  if (size == 0) return;
+
+  slots_ = new uint8_t[size];
+  memcpy(slots_, slots, size);
+}
+
+
+SafePoint::~SafePoint() {
+  delete[] slots_;
+}
+
+
+void StackMap::Push(SafePoint* point) {
+  queue()->Push(point);
+}
+
+
+void StackMap::Commit(char* addr) {
+  intptr_t addr_o = reinterpret_cast<intptr_t>(addr);
+
+  SafePoint* point;
+  while ((point = queue()->Shift()) != NULL) {
+    StackMapBase::Insert(NumberKey::New(addr_o + point->jit_offset()),
+                         point);
+  }
+}
+
+
+SafePoint* StackMap::Get(char* addr) {
+  intptr_t addr_o = reinterpret_cast<intptr_t>(addr);
+  if (head() == NULL) return NULL;
+
+  // Search returns closest item with a lower key if there is no exact match,
+  // but safepoint should be found only for return address of call
+  Item* item = Search(NumberKey::New(addr_o), false);
+  if (item->key()->value() != addr_o) return NULL;
+
+  return item->value();
+}
+
+} // namespace internal
+} // namespace candor
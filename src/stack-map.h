@@ -0,0 +1,116 @@
+#ifndef _SRC_STACK_MAP_H_
+#define _SRC_STACK_MAP_H_
+
+#include "utils.h" // AVLTree
+
+#include <stdint.h> // uint32_t
+
+namespace candor {
+namespace internal {
+
+// Forward declaration
+class SafePoint;
+
+typedef AVLTree<NumberKey, SafePoint, EmptyClass> StackMapBase;
+
+// Safepoints of generated code, keyed by return address of every call made
+// from function's body. GC uses them to walk frames of generated code
+// precisely (see GC::ColourFrames).
+//
+// Frame layout of generated function is:
+//   [return address] [saved frame pointer] <- frame pointer
+//   [nil] [argc]
+//   [spill 0] ... [spill N - 1] (described by safepoint)
+//   [masm spill 0] ... [masm spill M - 1] (described by safepoint)
+//   [unused masm spills and padding] (skipped)
+//   [pushed temporaries and arguments] (scanned conservatively, their number
+//                                       isn't known statically)
+class StackMap : StackMapBase {
+ public:
+  typedef List<SafePoint*, EmptyClass> SafePointQueue;
+
+  StackMap() {
+    // SafePoint should be 'delete'ed on destruction
+    allocated = true;
+  }
+
+  void Push(SafePoint* point);
+  void Commit(char* addr);
+  SafePoint* Get(char* addr);
+
+  inline SafePointQueue* queue() { return &queue_; }
+
+  // Words between frame pointer and the first spill slot
+  static const int kSpillStart = 3;
+
+  // Number of words saved by Masm::Pushad()
+#if CANDOR_ARCH_x64
+  static const int kSavedRegisters = 12;
+#elif CANDOR_ARCH_ia32
+  static const int kSavedRegisters = 8;
+#endif
+
+ private:
+  SafePointQueue queue_;
+};
+
+class SafePoint {
+ public:
+  // Slots' bitmap is copied
+  SafePoint(uint32_t jit_offset,
+            uint32_t slot_count,
+            uint8_t* slots,
+            uint32_t masm_slot_count,
+            uint32_t masm_slots,
+            uint32_t registers);
+  ~SafePoint();
+
+  // True if spill slot at `index` holds a live tagged value
+  inline bool IsTaggedSlot(uint32_t index) {
+    return (slots_[index >> 3] & (1 << (index & 7))) != 0;
+  }
+
+  // True if Masm::Spill at `index` holds a tagged value
+  inline bool IsTaggedMasmSlot(uint32_t index) {
+    return (masm_slots_ & (1 << index)) != 0;
+  }
+
+  // Registers are numbered in order of Masm::Pushad(), starting from
+  // the one that is closest to the frame pointer
+  inline bool IsTaggedRegister(uint32_t index) {
+    return (registers_ & (1 << index)) != 0;
+  }
+
+  inline uint32_t jit_offset() { return jit_offset_; }
+  inline uint32_t slot_count() { return slot_count_; }
+  inline uint32_t masm_slot_count() { return masm_slot_count_; }
+  inline uint32_t registers() { return registers_; }
+
+  // Words between frame pointer and stack pointer after function's prologue
+  // (known only when function's code is finished, see Masm::FinalizeSpills)
+  inline uint32_t frame_size() { return frame_size_; }
+  inline void frame_size(uint32_t frame_size) { frame_size_ = frame_size; }
+
+  static inline uint32_t BitmapSize(uint32_t slot_count) {
+    return (slot_count + 7) >> 3;
+  }
+
+  static const uint32_t kAllRegisters = 0xffffffff;
+
+  // Masm spills are described by 32-bit mask
+  static const uint32_t kMaxMasmSlots = 32;
+
+ private:
+  const uint32_t jit_offset_;
+  const uint32_t slot_count_;
+  uint8_t* slots_;
+  const uint32_t masm_slot_count_;
+  const uint32_t masm_slots_;
+  const uint32_t registers_;
+  uint32_t frame_size_;
+};
+
+} // namespace internal
+} // namespace candor
+
+#endif // _SRC_STACK_MAP_H_
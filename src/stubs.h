@@ -21,14 +21,18 @@ namespace internal {
     V(AllocateFunction)\
     V(CallBinding)\
     V(CollectGarbage)\
+    V(RecordWrite)\
     V(Throw)\
     V(Typeof)\
     V(Sizeof)\
     V(Keysof)\
     V(LookupProperty)\
+    V(PropertyIC)\
+    V(GlobalCell)\
     V(CoerceToBoolean)\
     V(CloneObject)\
     V(DeleteProperty)\
+    V(BoxElements)\
     V(HashValue)\
     V(StackTrace)
 
@@ -5,9 +5,10 @@
 #include <stdarg.h> // va_list
 #include <stdint.h> // uint32_t
 #include <stdio.h> // vsnprintf
-#include <string.h> // strncmp, memset
+#include <string.h> // strncmp, memset, memcpy
 #include <unistd.h> // sysconf or getpagesize, intptr_t
 #include <assert.h> // assert
+#include <sys/time.h> // gettimeofday
 
 namespace candor {
 namespace internal {
@@ -35,18 +36,81 @@ inline uint32_t ComputeHash(int64_t key) {
   return hash;
 }
 
-inline uint32_t ComputeHash(const char* key, uint32_t length) {
-  uint32_t hash = 0;
-  for (uint32_t i = 0; i < length; i++) {
-    hash += key[i];
-    hash += (hash << 10);
-    hash ^= (hash >> 6);
+// Hashes string a word at a time: each 8-byte chunk is mixed in with a
+// multiplication, tail is zero-padded, the result is finalized with
+// murmur3's avalanche. Zero is never returned (HString uses it as "not
+// computed yet" marker).
+//
+// String might be fed in chunks of any length (i.e. leaves of cons string),
+// the result is the same as for contiguous one.
+class StringHasher {
+ public:
+  StringHasher(uint32_t length) : hash_(length * kMul), word_(0), filled_(0) {
   }
-  hash += (hash << 3);
-  hash ^= (hash >> 11);
-  hash += (hash << 15);
 
-  return hash;
+  inline void Update(const char* chunk, uint32_t length) {
+    // Complete word started by previous chunk
+    if (filled_ != 0) {
+      uint32_t n = sizeof(word_) - filled_;
+      if (n > length) n = length;
+
+      memcpy(reinterpret_cast<char*>(&word_) + filled_, chunk, n);
+      filled_ += n;
+      chunk += n;
+      length -= n;
+      if (filled_ < sizeof(word_)) return;
+
+      Mix(word_);
+      word_ = 0;
+      filled_ = 0;
+    }
+
+    uint64_t word;
+    uint32_t i = 0;
+    for (; i + sizeof(word) <= length; i += sizeof(word)) {
+      memcpy(&word, chunk + i, sizeof(word));
+      Mix(word);
+    }
+
+    // Keep tail until the next chunk
+    if (i < length) {
+      memcpy(&word_, chunk + i, length - i);
+      filled_ = length - i;
+    }
+  }
+
+  inline uint32_t Finish() {
+    if (filled_ != 0) Mix(word_);
+
+    uint64_t hash = hash_;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+
+    uint32_t result = static_cast<uint32_t>(hash);
+    return result == 0 ? 1 : result;
+  }
+
+ private:
+  inline void Mix(uint64_t word) {
+    hash_ = (hash_ ^ word) * kMul;
+    hash_ ^= hash_ >> 32;
+  }
+
+  static const uint64_t kMul = 0x9e3779b97f4a7c15ULL;
+
+  uint64_t hash_;
+  uint64_t word_;
+  uint32_t filled_;
+};
+
+
+inline uint32_t ComputeHash(const char* key, uint32_t length) {
+  StringHasher hasher(length);
+  hasher.Update(key, length);
+  return hasher.Finish();
 }
 
 
@@ -824,6 +888,15 @@ inline uint32_t PowerOfTwo(uint32_t value) {
 }
 
 
+// Current time in microseconds (for GC and benchmark timings)
+inline uint64_t GetTimeUs() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+
+  return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+
 // Naive only for lexer generated number strings
 inline bool StringIsDouble(const char* value, uint32_t length) {
   for (uint32_t index = 0; index < length; index++) {
@@ -907,31 +980,6 @@ inline int64_t StringToInt(const char* value, uint32_t length) {
 }
 
 
-inline double StringToDouble(const char* value, uint32_t length) {
-  double integral = 0;
-  double floating = 0;
-  bool sign = false;
-
-  uint32_t index = StringGetNumSign(value, length, &sign);
-  for (; index < length; index++) {
-    if (value[index] == '.') break;
-    if (!is_num(value[index])) break;
-    integral *= 10;
-    integral += value[index] - '0';
-  }
-
-  if (index < length && value[index] == '.') {
-    for (uint32_t i = length - 1; i > index; i--) {
-      if (!is_num(value[i])) break;
-      floating += value[i] - '0';
-      floating /= 10;
-    }
-  }
-
-  return sign ? -(integral + floating) : integral + floating;
-}
-
-
 inline int GetSourceLineByOffset(const char* source,
                                  uint32_t offset,
                                  int* pos) {
@@ -16,12 +16,13 @@ inline void Assembler::emit_rex_if_high(Register src) {
 
 
 inline void Assembler::emit_rexw(Register dst) {
-  emitb(0x48 | dst.high() << 2);
+  // Single operand is encoded in modrm's r/m field (REX.B)
+  emitb(0x48 | dst.high());
 }
 
 
 inline void Assembler::emit_rexw(Operand& dst) {
-  emitb(0x48 | dst.base().high() << 2);
+  emitb(0x48 | dst.base().high());
 }
 
 
@@ -35,14 +35,18 @@ void LGen::VisitLiteral(HIRInstruction* instr) {
 
 
 void LGen::VisitAllocateObject(HIRInstruction* instr) {
-  LInstruction* op = Bind(new LAllocateObject())->MarkHasCall();
+  LInstruction* op =
+      Bind(new LAllocateObject(HIRAllocateObject::Cast(instr)->size()))
+          ->MarkHasCall();
 
   ResultFromFixed(op, rax);
 }
 
 
 void LGen::VisitAllocateArray(HIRInstruction* instr) {
-  LInstruction* op = Bind(new LAllocateArray())->MarkHasCall();
+  LInstruction* op =
+      Bind(new LAllocateArray(HIRAllocateArray::Cast(instr)->size()))
+          ->MarkHasCall();
 
   ResultFromFixed(op, rax);
 }
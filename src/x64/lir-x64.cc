@@ -4,6 +4,7 @@
 #include "lir-instructions-inl.h"
 #include "macroassembler.h"
 #include "stubs.h" // Stubs
+#include "ic.h" // PropertyIC, GlobalCell
 #include <unistd.h> // intptr_t
 
 namespace candor {
@@ -103,16 +104,14 @@ void LLiteral::Generate(Masm* masm) {
 
 
 void LAllocateObject::Generate(Masm* masm) {
-  // XXX Use correct size here
-  __ push(Immediate(HNumber::Tag(16)));
+  __ push(Immediate(HNumber::Tag(size_)));
   __ push(Immediate(HNumber::Tag(Heap::kTagObject)));
   __ Call(masm->stubs()->GetAllocateObjectStub());
 }
 
 
 void LAllocateArray::Generate(Masm* masm) {
-  // XXX Use correct size here
-  __ push(Immediate(HNumber::Tag(16)));
+  __ push(Immediate(HNumber::Tag(size_)));
   __ push(Immediate(HNumber::Tag(Heap::kTagArray)));
   __ Call(masm->stubs()->GetAllocateObjectStub());
 }
@@ -134,14 +133,112 @@ void LBranch::Generate(Masm* masm) {
 }
 
 
+// Loads offset of global object's property through the cell, object and
+// its map should be the cached ones
+static void GenerateGlobalCellLookup(Masm* masm) {
+  GlobalCell* cell = GlobalCell::New(masm->heap());
+
+  Label miss, done;
+  Operand qmap(rax, HObject::kMapOffset);
+  Operand cell_object(rdx, GlobalCell::kObjectOffset);
+  Operand cell_map(rdx, GlobalCell::kMapOffset);
+  Operand cell_offset(rdx, GlobalCell::kOffsetOffset);
+
+  __ mov(rdx, Immediate(reinterpret_cast<uint64_t>(cell)));
+
+  __ cmpq(rax, cell_object);
+  __ jmp(kNe, &miss);
+
+  __ mov(rcx, qmap);
+  __ cmpq(rcx, cell_map);
+  __ jmp(kNe, &miss);
+
+  __ mov(rax, cell_offset);
+  __ xorq(rdx, rdx);
+  __ jmp(&done);
+
+  __ bind(&miss);
+  __ Call(masm->stubs()->GetGlobalCellStub());
+
+  __ bind(&done);
+}
+
+
+// Puts offset of property's slot in object's map into rax (or nil).
+// Accesses with a constant string key are going through inline cache (or
+// global property cell), element accesses are never shaped.
+static void GeneratePropertyLookup(Masm* masm,
+                                   HIRInstruction* hir,
+                                   bool is_store) {
+  // rax <- object
+  // rbx <- property
+  if (!hir->right()->Is(HIRInstruction::kLiteral) ||
+      !HIRLiteral::Cast(hir->right())->IsString()) {
+    __ mov(rcx, Immediate(is_store ? 1 : 0));
+    __ Call(masm->stubs()->GetLookupPropertyStub());
+    return;
+  }
+
+  // `global.name` loads
+  HIRInstruction* obj = hir->left();
+  if (!is_store &&
+      obj->Is(HIRInstruction::kLoadContext) &&
+      HIRLoadContext::Cast(obj)->context_slot()->depth() == -1) {
+    GenerateGlobalCellLookup(masm);
+    return;
+  }
+
+  PropertyIC* ic = PropertyIC::New(masm->heap(), is_store);
+
+  Label miss, done;
+  Operand qshape(rax, HObject::kShapeOffset);
+  Operand hits(rdx, PropertyIC::kHitsOffset);
+  Operand entry_shape(rdx,
+                      PropertyIC::EntryOffset(0) +
+                          PropertyIC::kEntryShapeOffset);
+  Operand entry_transition(rdx,
+                           PropertyIC::EntryOffset(0) +
+                               PropertyIC::kEntryTransitionOffset);
+  Operand entry_offset(rdx,
+                       PropertyIC::EntryOffset(0) +
+                           PropertyIC::kEntryOffsetOffset);
+
+  __ mov(rdx, Immediate(reinterpret_cast<uint64_t>(ic)));
+
+  // Monomorphic case: check the first entry inline
+  __ IsUnboxed(rax, NULL, &miss);
+  __ IsNil(rax, NULL, &miss);
+  __ IsHeapObject(Heap::kTagObject, rax, &miss, NULL);
+
+  __ mov(rcx, qshape);
+  __ cmpq(rcx, entry_shape);
+  __ jmp(kNe, &miss);
+
+  // Transitions are handled by stub
+  __ cmpq(entry_transition, Immediate(0));
+  __ jmp(kNe, &miss);
+
+  __ mov(scratch, hits);
+  __ inc(scratch);
+  __ mov(hits, scratch);
+
+  __ mov(rax, entry_offset);
+  __ xorq(rdx, rdx);
+  __ jmp(&done);
+
+  // Polymorphic, megamorphic or uninitialized
+  __ bind(&miss);
+  __ Call(masm->stubs()->GetPropertyICStub());
+
+  __ bind(&done);
+}
+
+
 void LLoadProperty::Generate(Masm* masm) {
   __ push(rax);
   __ push(rax);
 
-  // rax <- object
-  // rbx <- property
-  __ mov(rcx, Immediate(0));
-  __ Call(masm->stubs()->GetLookupPropertyStub());
+  GeneratePropertyLookup(masm, hir(), false);
 
   Label done;
 
@@ -149,12 +246,9 @@ void LLoadProperty::Generate(Masm* masm) {
   __ pop(rbx);
 
   __ IsNil(rax, NULL, &done);
-  Operand qmap(rbx, HObject::kMapOffset);
-  __ mov(rbx, qmap);
-  __ addq(rax, rbx);
 
-  Operand slot(rax, 0);
-  __ mov(rax, slot);
+  // rbx <- object, rax <- offset
+  __ LoadProperty(rbx, rax, rax);
 
   __ bind(&done);
 }
@@ -164,16 +258,14 @@ void LStoreProperty::Generate(Masm* masm) {
   __ push(rax);
   __ push(rcx);
 
-  // rax <- object
-  // rbx <- property
   // rcx <- value
-  __ mov(rcx, Immediate(1));
-  __ Call(masm->stubs()->GetLookupPropertyStub());
+  GeneratePropertyLookup(masm, hir(), true);
 
-  // Make rax look like unboxed number to GC
-  __ dec(rax);
-  __ CheckGC();
-  __ inc(rax);
+  // rax holds an offset in the map, GC shouldn't visit it
+  {
+    Masm::UntaggedRegister untagged(masm, rax);
+    __ CheckGC();
+  }
 
   __ pop(rcx);
   __ pop(rbx);
@@ -181,12 +273,8 @@ void LStoreProperty::Generate(Masm* masm) {
   Label done;
   __ IsNil(rax, NULL, &done);
 
-  Operand qmap(rbx, HObject::kMapOffset);
-  __ mov(rbx, qmap);
-  __ addq(rax, rbx);
-
-  Operand slot(rax, 0);
-  __ mov(slot, rcx);
+  // rbx <- object, rax <- offset, rcx <- value
+  __ StoreProperty(rbx, rax, rcx);
 
   __ bind(&done);
 }
@@ -348,8 +436,6 @@ void LLoadVarArg::Generate(Masm* masm) {
   Register rest = rbx;
   Register arr = rcx;
   Operand argc(rbp, -HValue::kPointerSize * 2);
-  Operand qmap(arr, HObject::kMapOffset);
-  Operand slot(scratch, 0);
   Operand stack_slot(offset, 0);
 
   Label loop, preloop, end;
@@ -391,16 +477,16 @@ void LLoadVarArg::Generate(Masm* masm) {
   arr_s.Unspill();
   rbx_s.Unspill();
 
-  // Make rax look like unboxed number to GC
-  __ dec(rax);
-  __ CheckGC();
-  __ inc(rax);
+  // rax holds an offset in the map, GC shouldn't visit it
+  {
+    Masm::UntaggedRegister untagged(masm, rax);
+    __ CheckGC();
+  }
 
   __ IsNil(rax, NULL, &preloop);
 
-  __ mov(arr, qmap);
-  __ addq(rax, arr);
-  __ mov(scratch, rax);
+  // rdx <- offset in the map
+  __ mov(rdx, rax);
 
   // Get stack offset
   offset_s.Unspill();
@@ -411,7 +497,7 @@ void LLoadVarArg::Generate(Masm* masm) {
   __ mov(offset, stack_slot);
 
   // Put argument in array
-  __ mov(slot, offset);
+  __ StoreProperty(arr, rdx, offset);
 
   arr_s.Unspill();
 
@@ -443,21 +529,16 @@ void LStoreArg::Generate(Masm* masm) {
 void LStoreVarArg::Generate(Masm* masm) {
   Register varg = rax;
   Register index = rbx;
-  Register map = rcx;
+  Register obj = rcx;
 
   // rax <- varg
   Label loop, not_array, odd_end, r1_nil, r2_nil;
-  Masm::Spill index_s(masm), map_s(masm), array_s(masm), r1(masm);
-  Operand slot(rax, 0);
+  Masm::Spill index_s(masm), array_s(masm), r1(masm);
 
   __ IsUnboxed(varg, NULL, &not_array);
   __ IsNil(varg, NULL, &not_array);
   __ IsHeapObject(Heap::kTagArray, varg, &not_array, NULL);
 
-  Operand qmap(varg, HObject::kMapOffset);
-  __ mov(map, qmap);
-  map_s.SpillReg(map);
-
   // index = sizeof(array)
   Operand qlength(varg, HArray::kLengthOffset);
   __ mov(index, qlength);
@@ -483,9 +564,8 @@ void LStoreVarArg::Generate(Masm* masm) {
   __ Call(masm->stubs()->GetLookupPropertyStub());
 
   __ IsNil(rax, NULL, &r1_nil);
-  map_s.Unspill();
-  __ addq(rax, map);
-  __ mov(rax, slot);
+  array_s.Unspill(obj);
+  __ LoadProperty(obj, rax, rax);
 
   __ bind(&r1_nil);
   r1.SpillReg(rax);
@@ -508,9 +588,8 @@ void LStoreVarArg::Generate(Masm* masm) {
   __ Call(masm->stubs()->GetLookupPropertyStub());
 
   __ IsNil(rax, NULL, &r2_nil);
-  map_s.Unspill();
-  __ addq(rax, map);
-  __ mov(rax, slot);
+  array_s.Unspill(obj);
+  __ LoadProperty(obj, rax, rax);
 
   __ bind(&r2_nil);
 
@@ -531,7 +610,7 @@ void LStoreVarArg::Generate(Masm* masm) {
 
   __ bind(&not_array);
 
-  __ xorq(map, map);
+  __ xorq(obj, obj);
 }
 
 
@@ -585,6 +664,10 @@ void LStoreContext::Generate(Masm* masm) {
   Operand res(scratches[0]->ToRegister(),
               HContext::GetIndexDisp(slot()->index()));
   __ mov(res, inputs[0]->ToRegister());
+
+  __ mov(scratch, scratches[0]->ToRegister());
+  __ addq(scratch, Immediate(HContext::GetIndexDisp(slot()->index())));
+  __ RecordWrite(scratches[0]->ToRegister(), scratch, inputs[0]->ToRegister());
 }
 
 
@@ -18,7 +18,12 @@ Masm::Masm(CodeSpace* space) : space_(space),
                                spill_offset_(8),
                                spill_index_(0),
                                spill_reloc_(NULL),
-                               spill_operand_(rbp, 0) {
+                               spill_operand_(rbp, 0),
+                               stack_map_(NULL),
+                               safepoint_slot_count_(0),
+                               safepoint_slots_(NULL),
+                               safepoint_registers_(SafePoint::kAllRegisters),
+                               spill_tags_(0) {
 }
 
 
@@ -59,6 +64,28 @@ void Masm::Popad(Register preserve) {
 }
 
 
+int Masm::SavedRegisterIndex(Register reg) {
+  // Same order as in Pushad()
+  Register saved[] = {
+    rax, rbx, rcx, rdx, r8, r9, r10, r11, r12, r13, root_reg, context_reg
+  };
+
+  for (int i = 0; i < StackMap::kSavedRegisters; i++) {
+    if (saved[i].is(reg)) return i;
+  }
+
+  UNEXPECTED
+  return -1;
+}
+
+
+bool Masm::IsTaggedRegister(Register reg) {
+  if (reg.is(scratch) || reg.is(rsp) || reg.is(rbp)) return false;
+
+  return (safepoint_registers_ & (1 << SavedRegisterIndex(reg))) != 0;
+}
+
+
 void Masm::AlignCode() {
   offset_ = RoundUp(offset_, 16);
   Grow();
@@ -103,6 +130,12 @@ void Masm::Spill::SpillReg(Register src) {
   masm()->SpillSlot(index(), slot);
   masm()->mov(slot, src);
 
+  if (masm()->IsTaggedRegister(src)) {
+    masm()->spill_tags_ |= 1 << index();
+  } else {
+    masm()->spill_tags_ &= ~(1 << index());
+  }
+
   if (masm()->spill_index_ > masm()->spills_) {
     masm()->spills_ = masm()->spill_index_;
   }
@@ -145,7 +178,9 @@ void Masm::AllocateSpills() {
 void Masm::FinalizeSpills() {
   if (spill_reloc_ == NULL) return;
 
-  spill_reloc_->target(RoundUp((spill_offset_ + spills_ + 1) << 3, 16));
+  uint32_t frame_size = RoundUp((spill_offset_ + spills_ + 1) << 3, 16);
+  spill_reloc_->target(frame_size);
+  FinalizeSafePoints(frame_size / HValue::kPointerSize);
 }
 
 
@@ -212,8 +247,17 @@ void Masm::AllocateContext(uint32_t slots) {
 
 
 void Masm::AllocateNumber(DoubleRegister value, Register result) {
+  // Allocation may fall back to runtime, which won't preserve xmm registers
+  movd(scratch, value);
+  push(scratch);
+  push(scratch);
+
   Allocate(Heap::kTagNumber, reg_nil, HValue::kPointerSize, result);
 
+  pop(scratch);
+  pop(scratch);
+  movd(value, scratch);
+
   Operand qvalue(result, HNumber::kValueOffset);
   movd(qvalue, value);
 
@@ -228,19 +272,28 @@ void Masm::AllocateObjectLiteral(Heap::HeapTag tag,
   Operand qmask(result, HObject::kMaskOffset);
   Operand qmap(result, HObject::kMapOffset);
 
+  // Object only field
+  Operand qshape(result, HObject::kShapeOffset);
+
   // Array only field
   Operand qlength(result, HArray::kLengthOffset);
 
+  // Empty objects have root shape
+  Immediate root_shape(reinterpret_cast<uint64_t>(heap()->root_shape_slot()));
+  Operand scratch_op(scratch, 0);
+
   if (tag_reg.is(reg_nil)) {
-    // mask + map
-    Allocate(tag,
-             reg_nil,
-             (tag == Heap::kTagArray ? 3 : 2) * HValue::kPointerSize,
-             result);
+    // mask + map + shape (or length)
+    Allocate(tag, reg_nil, 3 * HValue::kPointerSize, result);
 
-    // Set length
     if (tag == Heap::kTagArray) {
+      // Set length
       mov(qlength, Immediate(0));
+    } else {
+      // Set shape
+      mov(scratch, root_shape);
+      mov(scratch, scratch_op);
+      mov(qshape, scratch);
     }
   } else {
     Label array, allocate_map;
@@ -248,7 +301,10 @@ void Masm::AllocateObjectLiteral(Heap::HeapTag tag,
     cmpq(tag_reg, Immediate(HNumber::Tag(Heap::kTagArray)));
     jmp(kEq, &array);
 
-    Allocate(Heap::kTagObject, reg_nil, 2 * HValue::kPointerSize, result);
+    Allocate(Heap::kTagObject, reg_nil, 3 * HValue::kPointerSize, result);
+    mov(scratch, root_shape);
+    mov(scratch, scratch_op);
+    mov(qshape, scratch);
 
     jmp(&allocate_map);
     bind(&array);
@@ -272,17 +328,25 @@ void Masm::AllocateObjectLiteral(Heap::HeapTag tag,
   // Create map
   Spill size_s(this, size);
 
+  // Maps of shaped objects and dense arrays contain only values: `size` of
+  // them fit into `size / 2` slot pairs
+  Untag(size);
+  shr(size, Immediate(1));
+  TagNumber(size);
+
+  Spill map_size_s(this, size);
+
   Untag(size);
   // keys + values
   shl(size, Immediate(4));
-  // + size
-  addq(size, Immediate(HValue::kPointerSize));
+  // + size + available
+  addq(size, Immediate(2 * HValue::kPointerSize));
   TagNumber(size);
 
   Allocate(Heap::kTagMap, size, 0, scratch);
   mov(qmap, scratch);
 
-  size_s.Unspill();
+  map_size_s.Unspill();
   Spill result_s(this, result);
   mov(result, scratch);
 
@@ -291,6 +355,10 @@ void Masm::AllocateObjectLiteral(Heap::HeapTag tag,
   Untag(size);
   mov(qmapsize, size);
 
+  // Map holds no keys, runtime will rehash it before inserting any
+  Operand qavailable(result, HMap::kAvailableOffset);
+  mov(qavailable, Immediate(0));
+
   // Fill map with nil
   shl(size, Immediate(4));
   addq(result, Immediate(HMap::kSpaceOffset));
@@ -407,126 +475,174 @@ void Masm::ExitFrameEpilogue() {
 
 void Masm::StringHash(Register str, Register result) {
   Operand hash_field(str, HString::kHashOffset);
-  Operand repr_field(str, HValue::kRepresentationOffset);
 
-  Label call_runtime, done;
+  Label done;
 
   // Check if hash was already calculated
   mov(result, hash_field);
   cmpq(result, Immediate(0));
   jmp(kNe, &done);
 
-  // Check if string is a cons string
-  movzxb(scratch, repr_field);
-  cmpb(scratch, Immediate(HString::kNormal));
-  jmp(kNe, &call_runtime);
-
-  // Compute new hash
-  assert(!str.is(rcx));
-  if (!result.is(rcx)) push(rcx);
+  // Compute it in runtime (see ComputeHash), it'll be stored in the string
+  push(rax);
   push(str);
-  push(rsi);
+  Call(stubs()->GetHashValueStub());
+  pop(str);
 
-  Register scratch = rsi;
+  if (result.is(rax)) {
+    pop(scratch);
+  } else {
+    mov(result, rax);
+    pop(rax);
+  }
 
-  // hash = 0
-  xorq(result, result);
+  bind(&done);
+}
 
-  // rcx = length
-  Operand length_field(str, HString::kLengthOffset);
-  mov(rcx, length_field);
 
-  // str += kValueOffset
-  addq(str, Immediate(HString::kValueOffset));
+void Masm::CheckGC() {
+  Immediate gc_flag(reinterpret_cast<uint64_t>(heap()->needs_gc_addr()));
+  Operand scratch_op(scratch, 0);
 
-  // while (rcx != 0)
-  Label loop_start, loop_cond, loop_end;
+  Label done;
 
-  jmp(&loop_cond);
-  bind(&loop_start);
+  // Check needs_gc flag
+  mov(scratch, gc_flag);
+  cmpb(scratch_op, Immediate(0));
+  jmp(kEq, &done);
 
-  Operand ch(str, 0);
+  Call(stubs()->GetCollectGarbageStub());
 
-  // result += str[0]
-  movzxb(scratch, ch);
-  addl(result, scratch);
+  bind(&done);
+}
 
-  // result += result << 10
-  mov(scratch, result);
-  shll(result, Immediate(10));
-  addl(result, scratch);
 
-  // result ^= result >> 6
-  mov(scratch, result);
-  shrl(result, Immediate(6));
-  xorl(result, scratch);
+void Masm::RecordWrite(Register object, Register slot, Register value) {
+  Operand object_gen(object, HValue::kGenerationOffset);
+  Operand value_gen(value, HValue::kGenerationOffset);
 
-  // rcx--; str++
-  dec(rcx);
-  inc(str);
+  Immediate marking(reinterpret_cast<uint64_t>(heap()->gc()->marking_addr()));
+  Operand scratch_op(scratch, 0);
 
-  bind(&loop_cond);
+  Label record, done;
 
-  // check condition (rcx != 0)
-  cmpq(rcx, Immediate(0));
-  jmp(kNe, &loop_start);
+  // Skip non-pointers
+  IsUnboxed(value, NULL, &done);
+  IsNil(value, NULL, &done);
 
-  bind(&loop_end);
+  // Skip new space objects
+  cmpb(object_gen, Immediate(Heap::kMinOldSpaceGeneration));
+  jmp(kLt, &done);
 
-  // Mixup
-  // result += (result << 3);
-  mov(scratch, result);
-  shll(result, Immediate(3));
-  addl(result, scratch);
+  // Old space values should be recorded only while marking is in progress
+  cmpb(value_gen, Immediate(Heap::kMinOldSpaceGeneration));
+  jmp(kLt, &record);
 
-  // result ^= (result >> 11);
-  mov(scratch, result);
-  shrl(result, Immediate(11));
-  xorl(result, scratch);
+  // NOTE: slot may be in scratch, pop doesn't affect flags
+  push(slot);
+  mov(scratch, marking);
+  cmpb(scratch_op, Immediate(0));
+  pop(slot);
+  jmp(kEq, &done);
 
-  // result += (result << 15);
-  mov(scratch, result);
-  shll(result, Immediate(15));
-  addl(result, scratch);
+  bind(&record);
+  push(slot);
+  Call(stubs()->GetRecordWriteStub());
 
-  pop(rsi);
-  pop(str);
-  if (!result.is(rcx)) pop(rcx);
+  bind(&done);
+}
 
-  // Store hash into a string
-  mov(hash_field, result);
 
-  jmp(&done);
-  bind(&call_runtime);
+void Masm::RecordMapWrite(Register map, Register slot, Register value) {
+  Operand brepr(map, HValue::kRepresentationOffset);
 
-  push(rax);
-  push(str);
-  Call(stubs()->GetHashValueStub());
-  pop(str);
+  Label unboxed;
+  IsUnboxed(value, NULL, &unboxed);
+  IsNil(value, NULL, &unboxed);
+  movb(brepr, Immediate(HMap::kGeneric));
 
-  if (result.is(rax)) {
-    pop(scratch);
-  } else {
-    mov(result, rax);
-    pop(rax);
-  }
+  bind(&unboxed);
+  RecordWrite(map, slot, value);
+}
+
+
+void Masm::LoadProperty(Register obj, Register offset, Register result) {
+  Operand qmap(obj, HObject::kMapOffset);
+  Operand brepr(scratch, HValue::kRepresentationOffset);
+  Operand slot(result, 0);
+
+  Label done;
+
+  mov(scratch, qmap);
+  mov(result, offset);
+  addq(result, scratch);
+  cmpb(brepr, Immediate(HMap::kDouble));
+  mov(result, slot);
+  jmp(kNe, &done);
+
+  // Box raw double (holes are nil)
+  IsNil(result, NULL, &done);
+  movd(fscratch, result);
+  AllocateNumber(fscratch, result);
 
   bind(&done);
 }
 
 
-void Masm::CheckGC() {
-  Immediate gc_flag(reinterpret_cast<uint64_t>(heap()->needs_gc_addr()));
-  Operand scratch_op(scratch, 0);
+void Masm::StoreProperty(Register obj, Register offset, Register value) {
+  Operand qmap(obj, HObject::kMapOffset);
+  Operand brepr(scratch, HValue::kRepresentationOffset);
+  Operand qvalue(value, HNumber::kValueOffset);
+  Operand slot(offset, 0);
 
-  Label done;
+  Label generic, boxed, store_raw, box_elements, done;
 
-  // Check needs_gc flag
-  mov(scratch, gc_flag);
-  cmpb(scratch_op, Immediate(0));
-  jmp(kEq, &done);
+  mov(scratch, qmap);
+  cmpb(brepr, Immediate(HMap::kDouble));
+  jmp(kNe, &generic);
 
-  Call(stubs()->GetCollectGarbageStub());
+  // Holes are nil, numbers are unboxed into raw doubles
+  IsNil(value, NULL, &generic);
+  IsUnboxed(value, &boxed, NULL);
+  mov(scratch, value);
+  Untag(scratch);
+  cvtsi2sd(fscratch, scratch);
+  movd(scratch, fscratch);
+  jmp(&store_raw);
+
+  bind(&boxed);
+  IsHeapObject(Heap::kTagNumber, value, &box_elements, NULL);
+  mov(scratch, qvalue);
+
+  bind(&store_raw);
+
+  // Double with the bits of nil would become a hole
+  cmpq(scratch, Immediate(Heap::kTagNil));
+  jmp(kEq, &box_elements);
+  addq(offset, qmap);
+  mov(slot, scratch);
+  jmp(&done);
+
+  // Any other value makes elements generic
+  bind(&box_elements);
+  if (!obj.is(rax)) {
+    push(rax);
+    push(rax);
+    mov(rax, obj);
+  }
+  Call(stubs()->GetBoxElementsStub());
+  if (!obj.is(rax)) {
+    pop(rax);
+    pop(rax);
+  }
+
+  bind(&generic);
+  addq(offset, qmap);
+  mov(slot, value);
+
+  // NOTE: RecordWrite() doesn't read the map after clobbering scratch
+  mov(scratch, qmap);
+  RecordMapWrite(scratch, offset, value);
 
   bind(&done);
 }
@@ -568,10 +684,10 @@ void Masm::IsTrue(Register reference, Label* is_false, Label* is_true) {
 
 
 void Masm::IsDenseArray(Register reference, Label* non_dense, Label* dense) {
-  Operand qlength(reference, HArray::kLengthOffset);
-  cmpq(qlength, Immediate(HArray::kDenseLengthMax));
-  if (non_dense != NULL) jmp(kGt, non_dense);
-  if (dense != NULL) jmp(kLe, dense);
+  Operand brepr(reference, HValue::kRepresentationOffset);
+  cmpb(brepr, Immediate(HArray::kDense));
+  if (non_dense != NULL) jmp(kNe, non_dense);
+  if (dense != NULL) jmp(kEq, dense);
 }
 
 
@@ -580,6 +696,7 @@ void Masm::Call(Register addr) {
     nop();
   }
   callq(addr);
+  RecordSafePoint();
   nop();
 }
 
@@ -589,6 +706,7 @@ void Masm::Call(Operand& addr) {
     nop();
   }
   callq(addr);
+  RecordSafePoint();
   nop();
 }
 
@@ -160,6 +160,8 @@ void AllocateStub::Generate() {
   Immediate heapref(reinterpret_cast<uint64_t>(heap));
   Immediate top(reinterpret_cast<uint64_t>(heap->new_space()->top()));
   Immediate limit(reinterpret_cast<uint64_t>(heap->new_space()->limit()));
+  Immediate allocated(reinterpret_cast<uint64_t>(
+        heap->new_space()->allocated_addr()));
 
   Operand scratch_op(scratch, 0);
 
@@ -173,6 +175,10 @@ void AllocateStub::Generate() {
   __ mov(rbx, size);
   __ Untag(rbx);
 
+  // Large objects are allocated in runtime
+  __ cmpq(rbx, Immediate(LargeSpace::kThreshold));
+  __ jmp(kGt, &runtime_allocate);
+
   // Add object size to the top
   __ addq(rbx, rax);
   __ jmp(kCarry, &runtime_allocate);
@@ -191,6 +197,12 @@ void AllocateStub::Generate() {
   __ mov(scratch, scratch_op);
   __ mov(scratch_op, rbx);
 
+  // Account allocated bytes
+  __ subq(rbx, rax);
+  __ mov(scratch, allocated);
+  __ addq(rbx, scratch_op);
+  __ mov(scratch_op, rbx);
+
   __ jmp(&done);
 
   // Invoke runtime allocation stub
@@ -330,9 +342,9 @@ void CollectGarbageStub::Generate() {
   {
     Masm::Align a(masm());
 
-    // RuntimeCollectGarbage(heap, stack_top)
+    // RuntimeCollectGarbage(heap, frame)
     __ mov(rdi, Immediate(reinterpret_cast<uint64_t>(masm()->heap())));
-    __ mov(rsi, rsp);
+    __ mov(rsi, rbp);
     __ mov(rax, Immediate(*reinterpret_cast<uint64_t*>(&gc)));
     __ Call(rax);
   }
@@ -343,6 +355,81 @@ void CollectGarbageStub::Generate() {
 }
 
 
+void RecordWriteStub::Generate() {
+  GeneratePrologue();
+
+  // Arguments
+  Operand slot(rbp, 16);
+
+  Heap* heap = masm()->heap();
+  Immediate heapref(reinterpret_cast<uint64_t>(heap));
+  Immediate top(reinterpret_cast<uint64_t>(heap->store_buffer()->top()));
+  Immediate limit(reinterpret_cast<uint64_t>(heap->store_buffer()->limit()));
+
+  Operand scratch_op(scratch, 0);
+  Operand entry(rax, 0);
+  Operand value_gen(rax, HValue::kGenerationOffset);
+
+  Label runtime, done;
+
+  __ push(rax);
+  __ push(rbx);
+
+  // Old space value is stored while incremental marking is in progress,
+  // it'll be greyed in runtime
+  __ mov(rax, slot);
+  __ mov(rax, entry);
+  __ cmpb(value_gen, Immediate(Heap::kMinOldSpaceGeneration));
+  __ jmp(kGe, &runtime);
+
+  // rax <- store buffer's top
+  __ mov(scratch, top);
+  __ mov(rax, scratch_op);
+
+  // Check if buffer is full
+  __ mov(scratch, limit);
+  __ cmpq(rax, scratch_op);
+  __ jmp(kAe, &runtime);
+
+  // Put slot into buffer and update top
+  __ mov(rbx, slot);
+  __ mov(entry, rbx);
+  __ addq(rax, Immediate(HValue::kPointerSize));
+  __ mov(scratch, top);
+  __ mov(scratch_op, rax);
+
+  __ jmp(&done);
+
+  // Buffer is full - compact or grow it in runtime
+  __ bind(&runtime);
+
+  RuntimeRecordWriteCallback record = &RuntimeRecordWrite;
+
+  __ Pushad();
+
+  // Align stack (rbx is callee-saved)
+  __ mov(rbx, rsp);
+  __ mov(rax, Immediate(~static_cast<uint64_t>(15)));
+  __ andq(rsp, rax);
+
+  // RuntimeRecordWrite(heap, slot)
+  __ mov(rdi, heapref);
+  __ mov(rsi, slot);
+  __ mov(rax, Immediate(*reinterpret_cast<uint64_t*>(&record)));
+  __ callq(rax);
+
+  __ mov(rsp, rbx);
+  __ Popad(reg_nil);
+
+  __ bind(&done);
+
+  __ pop(rbx);
+  __ pop(rax);
+
+  GenerateEpilogue(1);
+}
+
+
 void TypeofStub::Generate() {
   GeneratePrologue();
 
@@ -380,6 +467,43 @@ void TypeofStub::Generate() {
 
 void SizeofStub::Generate() {
   GeneratePrologue();
+
+  Label fast_case, restore, runtime, done;
+
+  // Dense array that ends with non-nil element (or is empty) knows its size
+  __ IsUnboxed(rax, NULL, &runtime);
+  __ IsNil(rax, NULL, &runtime);
+  __ IsHeapObject(Heap::kTagArray, rax, &runtime, NULL);
+  __ IsDenseArray(rax, &runtime, NULL);
+
+  Operand qlength(rax, HArray::kLengthOffset);
+  Operand qmap(rax, HObject::kMapOffset);
+  Operand last(scratch, HMap::kSpaceOffset - HValue::kPointerSize);
+
+  __ push(rbx);
+  __ mov(rbx, qlength);
+  __ cmpq(rbx, Immediate(0));
+  __ jmp(kEq, &fast_case);
+
+  __ shl(rbx, Immediate(3));
+  __ mov(scratch, qmap);
+  __ addq(scratch, rbx);
+  __ cmpq(last, Immediate(Heap::kTagNil));
+  __ jmp(kEq, &restore);
+
+  // rbx = length * kPointerSize, tag it
+  __ shr(rbx, Immediate(2));
+
+  __ bind(&fast_case);
+  __ mov(rax, rbx);
+  __ pop(rbx);
+  __ jmp(&done);
+
+  // Trailing nils should be dropped by runtime
+  __ bind(&restore);
+  __ pop(rbx);
+
+  __ bind(&runtime);
   RuntimeSizeofCallback sizeofc = &RuntimeSizeof;
 
   __ Pushad();
@@ -392,6 +516,8 @@ void SizeofStub::Generate() {
 
   __ Popad(rax);
 
+  __ bind(&done);
+
   GenerateEpilogue(0);
 }
 
@@ -446,6 +572,51 @@ void LookupPropertyStub::Generate() {
 
     __ StringHash(rbx, rdx);
 
+    Label dictionary;
+
+    // Shaped object: value's index is stored in shape's keys
+    Operand qshape(rax, HObject::kShapeOffset);
+    __ mov(scratch, qshape);
+    __ IsNil(scratch, NULL, &dictionary);
+    {
+      Operand qkeys(scratch, HShape::kKeysOffset);
+      __ mov(scratch, qkeys);
+
+      Operand qkeys_mask(scratch, HObject::kMaskOffset);
+      __ mov(rsi, qkeys_mask);
+
+      // offset = hash & mask + kSpaceOffset
+      __ andq(rdx, rsi);
+      __ addq(rdx, Immediate(HMap::kSpaceOffset));
+
+      Operand qkeys_map(scratch, HObject::kMapOffset);
+      __ mov(scratch, qkeys_map);
+      __ addq(scratch, rdx);
+
+      // New properties are added by runtime (object changes it's shape)
+      Operand key_slot(scratch, 0);
+      __ cmpq(rbx, key_slot);
+      __ jmp(kNe, &cleanup);
+
+      // Get tagged index from key's value slot
+      __ addq(scratch, rsi);
+      Operand index_slot(scratch, HValue::kPointerSize);
+      __ mov(rax, index_slot);
+
+      // rax = index * kPointerSize + kSpaceOffset
+      __ shl(rax, Immediate(2));
+      __ addq(rax, Immediate(HMap::kSpaceOffset));
+
+      // Cleanup
+      __ xorq(rdx, rdx);
+      rsi_s.Unspill();
+
+      // Return value
+      GenerateEpilogue(0);
+    }
+
+    __ bind(&dictionary);
+
     Operand qmask(rax, HObject::kMaskOffset);
     __ mov(rsi, qmask);
 
@@ -468,26 +639,36 @@ void LookupPropertyStub::Generate() {
     __ cmpq(scratch, rbx);
     __ jmp(kEq, &match);
 
-    // or nil
+    // or nil (tombstones and collisions are handled in runtime)
     __ cmpq(scratch, Immediate(Heap::kTagNil));
     __ jmp(kNe, &cleanup);
 
-    __ bind(&match);
-
-    Label fast_case_end;
-
     // Insert key if was asked
     __ cmpq(rcx, Immediate(0));
-    __ jmp(kEq, &fast_case_end);
+    __ jmp(kEq, &match);
 
-    // Restore map's interior pointer
+    // Map should be grown by runtime if load factor limit was reached
     __ mov(scratch, qmap);
+    Operand qavailable(scratch, HMap::kAvailableOffset);
+    __ cmpq(qavailable, Immediate(0));
+    __ jmp(kEq, &cleanup);
+
+    // rcx isn't needed anymore, use it for map
+    __ mov(rcx, scratch);
+    Operand available(rcx, HMap::kAvailableOffset);
+    __ mov(scratch, available);
+    __ dec(scratch);
+    __ mov(available, scratch);
+
+    // Restore map's interior pointer
+    __ mov(scratch, rcx);
     __ addq(scratch, rdx);
 
     // Put the key into slot
     __ mov(slot, rbx);
+    __ RecordWrite(rcx, scratch, rbx);
 
-    __ bind(&fast_case_end);
+    __ bind(&match);
 
     // Compute value's address
     // rax = key_offset + mask + 8
@@ -591,6 +772,165 @@ void LookupPropertyStub::Generate() {
 }
 
 
+void PropertyICStub::Generate() {
+  GeneratePrologue();
+
+  Label hit, miss, generic, done;
+
+  // rax <- object
+  // rbx <- property
+  // rdx <- inline cache
+  Operand qshape(rax, HObject::kShapeOffset);
+
+  // Non-objects and objects in dictionary mode aren't cached
+  __ IsUnboxed(rax, NULL, &generic);
+  __ IsNil(rax, NULL, &generic);
+  __ IsHeapObject(Heap::kTagObject, rax, &generic, NULL);
+
+  __ mov(rcx, qshape);
+  __ IsNil(rcx, NULL, &generic);
+
+  // Unused entries have NULL shape and will never match
+  for (int i = 0; i < PropertyIC::kMaxEntries; i++) {
+    Label next;
+    Operand entry_shape(rdx,
+                        PropertyIC::EntryOffset(i) +
+                            PropertyIC::kEntryShapeOffset);
+    __ cmpq(rcx, entry_shape);
+    __ jmp(kNe, &next);
+
+    // rcx <- inline cache, rdx <- entry
+    __ mov(rcx, rdx);
+    __ addq(rdx, Immediate(PropertyIC::EntryOffset(i)));
+    __ jmp(&hit);
+
+    __ bind(&next);
+  }
+  __ jmp(&miss);
+
+  __ bind(&hit);
+  {
+    Label no_transition, fits;
+    Operand transition(rdx, PropertyIC::kEntryTransitionOffset);
+    Operand offset(rdx, PropertyIC::kEntryOffsetOffset);
+    Operand hits(rcx, PropertyIC::kHitsOffset);
+
+    __ cmpq(transition, Immediate(0));
+    __ jmp(kEq, &no_transition);
+
+    // New value's slot should fit into object's map (runtime will grow it)
+    Operand qmask(rax, HObject::kMaskOffset);
+    __ mov(scratch, offset);
+    __ subq(scratch, Immediate(HMap::kSpaceOffset));
+    __ cmpq(scratch, qmask);
+    __ jmp(kLe, &fits);
+
+    __ mov(rdx, rcx);
+    __ jmp(&miss);
+
+    __ bind(&fits);
+
+    // Move object to the new shape
+    __ mov(rbx, transition);
+    __ mov(qshape, rbx);
+    __ mov(scratch, rax);
+    __ addq(scratch, Immediate(HObject::kShapeOffset));
+    __ RecordWrite(rax, scratch, rbx);
+
+    __ bind(&no_transition);
+
+    __ mov(scratch, hits);
+    __ inc(scratch);
+    __ mov(hits, scratch);
+
+    __ mov(rax, offset);
+    __ jmp(&done);
+  }
+
+  __ bind(&miss);
+
+  // Megamorphic site isn't recording new shapes
+  Operand length(rdx, PropertyIC::kLengthOffset);
+  __ cmpq(length, Immediate(PropertyIC::kMegamorphicLength));
+  __ jmp(kEq, &generic);
+
+  __ Pushad();
+
+  RuntimePropertyICMissCallback miss_cb = &RuntimePropertyICMiss;
+
+  // RuntimePropertyICMiss(heap, ic, obj, key)
+  __ mov(rdi, Immediate(reinterpret_cast<uint64_t>(masm()->heap())));
+  __ mov(rsi, rdx);
+  __ mov(rdx, rax);
+  __ mov(rcx, rbx);
+  __ mov(rax, Immediate(*reinterpret_cast<uint64_t*>(&miss_cb)));
+  __ callq(rax);
+
+  __ Popad(rax);
+  __ jmp(&done);
+
+  __ bind(&generic);
+
+  Operand misses(rdx, PropertyIC::kMissesOffset);
+  __ mov(scratch, misses);
+  __ inc(scratch);
+  __ mov(misses, scratch);
+
+  Operand is_store(rdx, PropertyIC::kIsStoreOffset);
+  __ mov(rcx, is_store);
+  __ Call(masm()->stubs()->GetLookupPropertyStub());
+
+  __ bind(&done);
+
+  // Cleanup
+  __ xorq(rcx, rcx);
+  __ xorq(rdx, rdx);
+
+  GenerateEpilogue(0);
+}
+
+
+void GlobalCellStub::Generate() {
+  GeneratePrologue();
+
+  Label generic, done;
+
+  // rax <- object
+  // rbx <- property
+  // rdx <- global cell
+  __ IsUnboxed(rax, NULL, &generic);
+  __ IsNil(rax, NULL, &generic);
+  __ IsHeapObject(Heap::kTagObject, rax, &generic, NULL);
+
+  __ Pushad();
+
+  RuntimeLookupGlobalPropertyCallback lookup = &RuntimeLookupGlobalProperty;
+
+  // RuntimeLookupGlobalProperty(heap, cell, obj, key)
+  __ mov(rdi, Immediate(reinterpret_cast<uint64_t>(masm()->heap())));
+  __ mov(rsi, rdx);
+  __ mov(rdx, rax);
+  __ mov(rcx, rbx);
+  __ mov(rax, Immediate(*reinterpret_cast<uint64_t*>(&lookup)));
+  __ callq(rax);
+
+  __ Popad(rax);
+  __ jmp(&done);
+
+  // Global isn't an object
+  __ bind(&generic);
+  __ mov(rcx, Immediate(0));
+  __ Call(masm()->stubs()->GetLookupPropertyStub());
+
+  __ bind(&done);
+
+  // Cleanup
+  __ xorq(rdx, rdx);
+
+  GenerateEpilogue(0);
+}
+
+
 void CoerceToBooleanStub::Generate() {
   GeneratePrologue();
 
@@ -643,8 +983,6 @@ void CoerceToBooleanStub::Generate() {
 void CloneObjectStub::Generate() {
   GeneratePrologue();
 
-  __ AllocateSpills();
-
   Label non_object, done;
 
   // rax <- object
@@ -652,52 +990,18 @@ void CloneObjectStub::Generate() {
   __ IsNil(rax, NULL, &non_object);
   __ IsHeapObject(Heap::kTagObject, rax, &non_object, NULL);
 
-  // Get map
-  Operand qmap(rax, HObject::kMapOffset);
-  __ mov(rax, qmap);
-
-  // Get size
-  Operand qsize(rax, HMap::kSizeOffset);
-  __ mov(rcx, qsize);
-
-  __ TagNumber(rcx);
-
-  // Allocate new object
-  __ AllocateObjectLiteral(Heap::kTagObject, reg_nil, rcx, rdx);
-
-  __ mov(rbx, rdx);
-
-  // Get new object's map
-  qmap.base(rbx);
-  __ mov(rbx, qmap);
-
-  // Skip headers
-  __ addq(rax, Immediate(HMap::kSpaceOffset));
-  __ addq(rbx, Immediate(HMap::kSpaceOffset));
-
-  // NOTE: rcx is tagged here
-
-  // Copy all fields from it
-  Label loop_start, loop_cond;
-  __ jmp(&loop_cond);
-  __ bind(&loop_start);
-
-  Operand from(rax, 0), to(rbx, 0);
-  __ mov(scratch, from);
-  __ mov(to, scratch);
-
-  // Move forward
-  __ addq(rax, Immediate(8));
-  __ addq(rbx, Immediate(8));
+  // Clone shares shape with the source object (or copies dictionary)
+  RuntimeCloneObjectCallback clonec = &RuntimeCloneObject;
 
-  __ dec(rcx);
+  __ Pushad();
 
-  // Loop
-  __ bind(&loop_cond);
-  __ cmpq(rcx, Immediate(0));
-  __ jmp(kNe, &loop_start);
+  // RuntimeCloneObject(heap, obj)
+  __ mov(rdi, Immediate(reinterpret_cast<uint64_t>(masm()->heap())));
+  __ mov(rsi, rax);
+  __ mov(rax, Immediate(*reinterpret_cast<uint64_t*>(&clonec)));
+  __ callq(rax);
 
-  __ mov(rax, rdx);
+  __ Popad(rax);
 
   __ jmp(&done);
   __ bind(&non_object);
@@ -707,8 +1011,6 @@ void CloneObjectStub::Generate() {
 
   __ bind(&done);
 
-  __ FinalizeSpills();
-
   GenerateEpilogue(0);
 }
 
@@ -739,6 +1041,27 @@ void DeletePropertyStub::Generate() {
 }
 
 
+void BoxElementsStub::Generate() {
+  GeneratePrologue();
+
+  // rax <- array with kDouble elements
+  //
+  RuntimeBoxElementsCallback boxc = &RuntimeBoxElements;
+
+  __ Pushad();
+
+  // RuntimeBoxElements(heap, obj)
+  __ mov(rdi, Immediate(reinterpret_cast<uint64_t>(masm()->heap())));
+  __ mov(rsi, rax);
+  __ mov(rax, Immediate(*reinterpret_cast<uint64_t*>(&boxc)));
+  __ callq(rax);
+
+  __ Popad(reg_nil);
+
+  GenerateEpilogue(0);
+}
+
+
 void HashValueStub::Generate() {
   GeneratePrologue();
 
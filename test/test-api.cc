@@ -160,6 +160,26 @@ static Value* Unwrap(uint32_t argc, Value* argv[]) {
   return w->Wrap();
 }
 
+static HString::Representation StringRepr(Value* str) {
+  return HValue::GetRepresentation<HString::Representation>(str->addr());
+}
+
+
+static bool StringEquals(String* str, const char* expected) {
+  return str->Length() == strlen(expected) &&
+         strncmp(str->Value(), expected, str->Length()) == 0;
+}
+
+static const char kExternalBytes[] =
+    "external-0123456789-external-0123456789-external-0123456789-ext";
+
+static int external_released = 0;
+
+static void ExternalRelease(const char* value, uint32_t length) {
+  assert(value == kExternalBytes);
+  external_released++;
+}
+
 TEST_START(api)
   FUN_TEST("return (a, b, c) {\n"
            "return a + b + c(1, 2, () { __$gc()\nreturn 3 }) + 2\n"
@@ -354,6 +374,240 @@ TEST_START(api)
     assert(wrapper_destroyed == 1);
   }
 
+  // String slices
+  {
+    Isolate i;
+    const char* code = "a = '0123456789012345678901234567890123456789'\n"
+                       "b = 'abcdefghijabcdefghijabcdefghijabcdefghij'\n"
+                       "s = a\ni = 0\n"
+                       "while (i < 20) {\n"
+                       "  s = s + 'wxyz'\n"
+                       "  i++\n"
+                       "}\n"
+                       "return { cons: a + b, builder: s }";
+    Function* f = Function::New("api", code, strlen(code));
+
+    Value* argv[1];
+    Handle<Object> strings(f->Call(0, argv)->As<Object>());
+    Handle<String> cons(strings->Get("cons")->As<String>());
+    Handle<String> builder(strings->Get("builder")->As<String>());
+    assert(StringRepr(*cons) == HString::kCons);
+    assert(StringRepr(*builder) == HString::kBuilder);
+
+    // Slices of cons and builder strings
+    String* slice = cons->Slice(30, 60);
+    assert(StringRepr(slice) == HString::kSliced);
+    assert(StringEquals(slice, "0123456789abcdefghijabcdefghij"));
+
+    slice = builder->Slice(38, 70);
+    assert(StringRepr(slice) == HString::kSliced);
+    assert(StringEquals(slice, "89wxyzwxyzwxyzwxyzwxyzwxyzwxyzwx"));
+
+    // Slice of external string shares its bytes
+    String* external = String::NewExternal(kExternalBytes,
+                                           sizeof(kExternalBytes) - 1,
+                                           ExternalRelease);
+    slice = external->Slice(9, 39);
+    assert(StringRepr(slice) == HString::kSliced);
+    assert(HString::Parent(slice->addr()) == external->addr());
+    assert(StringEquals(slice, "0123456789-external-0123456789"));
+
+    // Slice of slice refers to the original string
+    String* str = String::New("0123456789abcdefghij0123456789abcdefghij"
+                              "0123456789abcdefghij0123456789abcdefghij");
+    String* outer = str->Slice(10, 70);
+    slice = outer->Slice(5, 35);
+    assert(HString::Parent(slice->addr()) == str->addr());
+    assert(StringEquals(slice, "fghij0123456789abcdefghij01234"));
+
+    // Bounds are clamped, short slices are copied
+    assert(str->Slice(0, 1000) == str);
+    assert(StringEquals(str->Slice(70, 1000), "abcdefghij"));
+    assert(StringRepr(str->Slice(70, 1000)) == HString::kNormal);
+    assert(str->Slice(50, 20)->Length() == 0);
+    assert(str->Slice(1000, 2000)->Length() == 0);
+  }
+
+  // Tiny slices are detached from their parent by scavenge
+  {
+    Isolate i;
+    const char* code = "__$gc()";
+    Function* f = Function::New("api", code, strlen(code));
+
+    char bytes[400];
+    for (uint32_t j = 0; j < sizeof(bytes); j++) bytes[j] = 'a' + j % 26;
+    String* parent = String::New(bytes, sizeof(bytes));
+
+    // Detached only if parent is kSliceDetachRatio times longer
+    uint32_t small_length = sizeof(bytes) / HString::kSliceDetachRatio;
+    Handle<String> small(parent->Slice(100, 100 + small_length));
+    Handle<String> big(parent->Slice(100, 101 + small_length));
+    assert(StringRepr(*small) == HString::kSliced);
+    assert(StringRepr(*big) == HString::kSliced);
+
+    Value* argv[1];
+    f->Call(0, argv);
+
+    assert(StringRepr(*small) == HString::kNormal);
+    assert(small->Length() == small_length);
+    assert(strncmp(small->Value(), bytes + 100, small_length) == 0);
+
+    assert(StringRepr(*big) == HString::kSliced);
+    assert(big->Length() == small_length + 1);
+    assert(strncmp(big->Value(), bytes + 100, small_length + 1) == 0);
+  }
+
+  // External strings are released by GC or with the isolate
+  {
+    int released = external_released;
+    {
+      Isolate i;
+      const char* code = "__$gc()\n__$gc()";
+      Function* f = Function::New("api", code, strlen(code));
+
+      String::NewExternal(kExternalBytes,
+                          sizeof(kExternalBytes) - 1,
+                          ExternalRelease);
+      Handle<String> alive(String::NewExternal(kExternalBytes,
+                                               sizeof(kExternalBytes) - 1,
+                                               ExternalRelease));
+      String* cleared = String::NewExternal(kExternalBytes,
+                                            sizeof(kExternalBytes) - 1,
+                                            ExternalRelease);
+      cleared->ClearWeak();
+
+      Value* argv[1];
+      f->Call(0, argv);
+
+      // Only unreferenced one was collected
+      assert(external_released == released + 1);
+      assert(StringEquals(*alive, kExternalBytes));
+    }
+
+    // Live one is released at teardown, cleared one is never released
+    assert(external_released == released + 2);
+  }
+
+  // Property ICs: sites seeing one shape stay monomorphic, ones seeing
+  // more than PropertyIC::kMaxEntries shapes become megamorphic. Cached
+  // shapes are relocated by compacting GC.
+  {
+    Isolate i;
+    const char* code = "mono = (o) { return o.x }\n"
+                       "poly = (o) { return o.x }\n"
+                       "mega = (o) { return o.x }\n"
+                       "set = (o, v) { o.x = v }\n"
+                       "objs = [ { x: 1 }, { a: 1, x: 1 }, { b: 1, x: 1 },"
+                       " { c: 1, x: 1 }, { d: 1, x: 1 },"
+                       " { e: 1, x: 1 } ]\n"
+                       "return () {\n"
+                       "  sum = 0\nj = 0\n"
+                       "  while (j < 10) {\n"
+                       "    k = 0\n"
+                       "    while (k < 6) {\n"
+                       "      set(objs[k], j * 10 + k)\n"
+                       "      sum = sum + mono(objs[0]) + mega(objs[k])\n"
+                       "      if (k < 3) sum = sum + poly(objs[k])\n"
+                       "      k++\n"
+                       "    }\n"
+                       "    j++\n"
+                       "  }\n"
+                       "  return sum\n"
+                       "}";
+    Function* f = Function::New("api", code, strlen(code));
+
+    Value* argv[1];
+    Handle<Function> run(f->Call(0, argv)->As<Function>());
+
+    double expected = 0;
+    for (int j = 0; j < 10; j++) {
+      for (int k = 0; k < 6; k++) {
+        expected += 10 * j + (10 * j + k);
+        if (k < 3) expected += 10 * j + k;
+      }
+    }
+    assert(run->Call(0, argv)->As<Number>()->Value() == expected);
+
+    ICStatistics stats;
+    i.GetICStatistics(&stats);
+
+    // Stores of literals' keys are monomorphic too
+    assert(stats.monomorphic >= 1);
+    assert(stats.polymorphic == 1);
+    assert(stats.megamorphic == 2);
+    assert(stats.hits > stats.misses);
+
+    Heap* heap = Heap::Current();
+    heap->gc()->needs_compaction(true);
+    heap->needs_gc(Heap::kGCOldSpace);
+    Function::New("api", "__$gc()", 7)->Call(0, argv);
+
+    ICStatistics compacted;
+    i.GetICStatistics(&compacted);
+    assert(compacted.monomorphic == stats.monomorphic);
+    assert(compacted.polymorphic == 1);
+    assert(compacted.megamorphic == 2);
+
+    // Relocated entries are hit
+    assert(run->Call(0, argv)->As<Number>()->Value() == expected);
+    i.GetICStatistics(&compacted);
+    assert(compacted.hits - stats.hits > compacted.misses - stats.misses);
+  }
+
+  // Global cells: cached loads of global properties see deletes, slot
+  // reuse, growth of global's map and replacement of the global object
+  {
+    Isolate i;
+    const char* code = "get() { return global.a }\n"
+                       "global.a = 1\n"
+                       "sum = get() + get()\n"
+                       "delete global.a\n"
+                       "if (get() !== nil) return -1\n"
+                       "global.c = 100\n"
+                       "if (get() !== nil) return -2\n"
+                       "global.a = 10\n"
+                       "sum = sum + get()\n"
+                       "i = 0\n"
+                       "while (i < 100) {\n"
+                       "  global['k' + i] = i\n"
+                       "  i++\n"
+                       "}\n"
+                       "global.a = 20\n"
+                       "sum = sum + get()\n"
+                       "__$gc()\n"
+                       "sum = sum + get()\n"
+                       "return () { return sum + get() }";
+    Handle<Function> f(Function::New("api", code, strlen(code)));
+
+    Handle<Object> global(Object::New());
+    f->SetContext(*global);
+
+    Value* argv[1];
+    Handle<Function> get(f->Call(0, argv)->As<Function>());
+    assert(get->Call(0, argv)->As<Number>()->Value() == 72);
+
+    Handle<Object> other(Object::New());
+    other->Set("a", Number::NewIntegral(1000));
+    get->SetContext(*other);
+    assert(get->Call(0, argv)->As<Number>()->Value() == 1052);
+
+    other->Set("a", Number::NewIntegral(2000));
+    assert(get->Call(0, argv)->As<Number>()->Value() == 2052);
+
+    // Cells survive GC, moved object and map are relocated
+    Function::New("api", "__$gc()", 7)->Call(0, argv);
+    int cells = 0;
+    GlobalCellList::Item* item = Heap::Current()->global_cells()->head();
+    for (; item != NULL; item = item->next()) {
+      GlobalCell* cell = item->value();
+      if (cell->object() != other->addr()) continue;
+      assert(cell->map() == HObject::Map(other->addr()));
+      cells++;
+    }
+    assert(cells == 1);
+    assert(get->Call(0, argv)->As<Number>()->Value() == 2052);
+  }
+
   // Regressions
   {
     Isolate i;
@@ -260,6 +260,37 @@ TEST_START(functional)
     assert(result->As<Array>()->Get(1)->Is<String>());
   })
 
+  // Shapes: objects with the same properties added in the same order share
+  // a shape, delete and too many properties move them to dictionary mode
+  FUN_TEST("a = { x: 1, y: 2 }\nb = {}\nb.x = 3\nb.y = 4\n"
+           "c = {}\nc.y = 5\nc.x = 6\n"
+           "d = { x: 7, y: 8 }\ndelete d.x\nd.z = 9\n"
+           "e = {}\ni = 0\nwhile (i < 100) {\ne['k' + i] = i\ni++\n}\n"
+           "return [ a, b, c, d, e ]", {
+    Array* objs = result->As<Array>();
+    char* a = objs->Get(0)->addr();
+    char* b = objs->Get(1)->addr();
+    char* c = objs->Get(2)->addr();
+    assert(HObject::IsShaped(a));
+    assert(HObject::IsShaped(b));
+    assert(HObject::IsShaped(c));
+    assert(HObject::Shape(a) == HObject::Shape(b));
+    assert(HObject::Shape(a) != HObject::Shape(c));
+    assert(objs->Get(1)->As<Object>()->Get("y")->As<Number>()->Value() == 4);
+    assert(objs->Get(2)->As<Object>()->Get("y")->As<Number>()->Value() == 5);
+
+    Object* d = objs->Get(3)->As<Object>();
+    assert(!HObject::IsShaped(d->addr()));
+    assert(d->Get("x")->Is<Nil>());
+    assert(d->Get("y")->As<Number>()->Value() == 8);
+    assert(d->Get("z")->As<Number>()->Value() == 9);
+
+    Object* e = objs->Get(4)->As<Object>();
+    assert(!HObject::IsShaped(e->addr()));
+    assert(e->Get("k0")->As<Number>()->Value() == 0);
+    assert(e->Get("k99")->As<Number>()->Value() == 99);
+  })
+
   // Unary ops
   FUN_TEST("a = 1\nreturn ++a", {
     assert(result->As<Number>()->Value() == 2);
@@ -321,6 +352,44 @@ TEST_START(functional)
     assert(result->As<Number>()->Value() == 8);
   })
 
+  // Shaped object's map is doubled when shape outgrows it
+  FUN_TEST("make(i) {\n"
+           "  o = { a: i }\n"
+           "  o.b = o.c = o.d = o.e = i\n"
+           "  return o\n"
+           "}\n"
+           "x = make(1)\ny = make(2)\n__$gc()\n"
+           "return x.e + y.e + y.a + x.b", {
+    assert(result->As<Number>()->Value() == 6);
+  })
+
+  // Sibling shapes share keys, but don't see each other's properties
+  FUN_TEST("a = { x: 1, y: 2 }\nb = { x: 3, z: 4 }\nc = { x: 5 }\n"
+           "c.w = 6\nr = 0\n"
+           "if (a.z === nil) { r = r + 1 }\n"
+           "if (b.y === nil) { r = r + 1 }\n"
+           "if (c.y === nil && c.z === nil) { r = r + 1 }\n"
+           "k = keysof b\n"
+           "if (sizeof k == 2 && k[0] == 'x' && k[1] == 'z') { r = r + 1 }\n"
+           "return r * 100 + a.y + b.z + c.w", {
+    assert(result->As<Number>()->Value() == 412);
+  })
+
+  // Objects that would need too many shapes are kept in dictionary mode
+  FUN_TEST("i = 0\nlast = nil\n"
+           "while (i < 40000) {\n"
+           "  o = {}\n  j = 0\n"
+           "  while (j < 16) {\n"
+           "    o['b' + j + '_' + ((i >> j) & 1)] = j\n"
+           "    j++\n"
+           "  }\n"
+           "  last = o\n  i++\n"
+           "}\n"
+           "return last['b15_1'] + last['b0_1'] + sizeof keysof last", {
+    assert(result->As<Number>()->Value() == 31);
+    assert(Heap::Current()->shape_count() <= HShape::kMaxShapes);
+  })
+
   FUN_TEST("a = { a: 1, b: 2 }\nreturn a.c", {
     assert(result->Is<Nil>());
   })
@@ -363,6 +432,50 @@ TEST_START(functional)
     assert(strncmp(str->Value(), "array", str->Length()) == 0);
   })
 
+  // Small literals grow past their initial capacity
+  FUN_TEST("a = []\nb = [ 1 ]\nc = [ 1, 2, 3 ]\n"
+           "a[0] = 1\na[1] = 2\na[2] = 3\nb[5] = 6\nc[3] = 4\nc[4] = 5\n"
+           "return (sizeof a) + (sizeof b) * 10 + (sizeof c) * 100 +\n"
+           "       b[5] + c[4]", {
+    assert(result->As<Number>()->Value() == 574);
+  })
+
+  // Arrays stay dense past 128 elements and become sparse on far stores
+  FUN_TEST("a = []\ni = 0\nwhile (i < 300) {\na[i] = i\ni = i + 1\n}\n"
+           "b = [ 1, 2 ]\nb[268435456] = 3\n"
+           "c = [ 1, 2 ]\nc[100000] = 3\n"
+           "return [ a, b, c ]", {
+    Array* arrs = result->As<Array>();
+    assert(HArray::IsDense(arrs->Get(0)->addr()));
+    assert(arrs->Get(0)->As<Array>()->Length() == 300);
+    assert(arrs->Get(0)->As<Array>()->Get(299)->As<Number>()->Value() == 299);
+    assert(!HArray::IsDense(arrs->Get(1)->addr()));
+    assert(arrs->Get(1)->As<Array>()->Get(1)->As<Number>()->Value() == 2);
+    assert(!HArray::IsDense(arrs->Get(2)->addr()));
+    assert(arrs->Get(2)->As<Array>()->Get(100000)->As<Number>()->Value() == 3);
+  })
+
+  // Arrays of numbers keep raw doubles, other values box them back
+  FUN_TEST("a = [ 0.5 ]\ni = 1\n"
+           "while (i < 100) {\na[i] = i + 0.5\ni = i + 1\n}\n"
+           "a[3] = 7\na[200] = 1\n"
+           "sum = 0\ni = 0\n"
+           "while (i < 100) {\nsum = sum + a[i]\ni = i + 1\n}\n"
+           "a[5] = { x: 10 }\n"
+           "if (a[150] !== nil) return 0\n"
+           "return sum + a[5].x * 1000 + a[6] * 100000 + (sizeof a) * 10000000", {
+    assert(result->As<Number>()->Value() ==
+        201 * 10000000 + 6.5 * 100000 + 10 * 1000 + 5000 + 7 - 3.5);
+  })
+
+  // Varargs and spreads of double elements
+  FUN_TEST("v(b...) { return b }\ns(b...) { return b[18] }\n"
+           "b = v(0.5, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16,"
+           "      17, 18.5)\n"
+           "return b[0] + b[17] + s(b...)", {
+    assert(result->As<Number>()->Value() == 36);
+  })
+
   // Global lookup
   FUN_TEST("global.a = 1\nreturn global.a", {
     assert(result->As<Number>()->Value() == 1);
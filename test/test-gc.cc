@@ -48,4 +48,406 @@ TEST_START(gc)
            "return a.x.y", {
     assert(result->Is<Object>());
   })
+
+  // Raw doubles aren't visited, boxing them in old elements is recorded
+  FUN_TEST("a = [ 0.5, 1.5 ]\na[2] = 2.5\n"
+           "__$gc()\n__$gc()\n__$gc()\n"
+           "__$gc()\n__$gc()\n__$gc()\n"
+           "a[3] = { x: 3 }\n"
+           "__$gc()\n"
+           "return a[0] + a[2] + a[3].x", {
+    assert(result->As<Number>()->Value() == 6);
+  })
+
+  // Write barrier: promoted objects and contexts referencing new objects
+  FUN_TEST("x = { a: 1 }\ny = 1\nfn = () { return y }\n"
+           "__$gc()\n__$gc()\n__$gc()\n"
+           "__$gc()\n__$gc()\n__$gc()\n"
+           "x.a = { b: 2 }\n"
+           "y = { c: 3 }\n"
+           "__$gc()\n__$gc()\n"
+           "return x.a.b + fn().c", {
+    assert(result->As<Number>()->Value() == 5);
+  })
+
+  // Write barrier: stores through property lookup (dynamic keys, dense
+  // arrays) and vararg arrays
+  FUN_TEST("x = { a: 1 }\narr = [ 1, 2 ]\nk = 'b'\n"
+           "f(args...) {\n"
+           "  __$gc()\n__$gc()\n__$gc()\n__$gc()\n__$gc()\n__$gc()\n"
+           "  return args\n"
+           "}\n"
+           "__$gc()\n__$gc()\n__$gc()\n"
+           "__$gc()\n__$gc()\n__$gc()\n"
+           "x[k] = { c: 2 }\n"
+           "arr[1] = { d: 3 }\n"
+           "v = f({ e: 4 }, { e: 5 })\n"
+           "v[2] = { e: 6 }\n"
+           "__$gc()\n__$gc()\n"
+           "return x.b.c + arr[1].d + v[0].e + v[1].e + v[2].e", {
+    assert(result->As<Number>()->Value() == 20);
+  })
+
+  // Old space mark-sweep: long-living objects should survive sweeping
+  // of promoted garbage
+  FUN_TEST("keep = nil\ni = 0\n"
+           "while (i < 100) {\n"
+           "  keep = { next: keep, value: i }\n"
+           "  i++\n"
+           "}\n"
+           "i = 0\n"
+           "while (i < 40) {\n"
+           "  a = nil\n"
+           "  x = 1000\n"
+           "  while (--x) {\n"
+           "    a = { x: { y: a }, keep: keep }\n"
+           "  }\n"
+           "  __$gc()\n__$gc()\n__$gc()\n__$gc()\n__$gc()\n"
+           "  i++\n"
+           "}\n"
+           "sum = 0\n"
+           "while (keep) {\n"
+           "  sum = sum + keep.value\n"
+           "  keep = keep.next\n"
+           "}\n"
+           "return sum", {
+    assert(result->As<Number>()->Value() == 4950);
+  })
+
+  // Large objects: survivors are old, writes into them are recorded by
+  // write barrier
+  FUN_TEST("a = []\ni = 0\n"
+           "while (i < 20000) {\n"
+           "  a[i] = i\n"
+           "  i++\n"
+           "}\n"
+           "__$gc()\n"
+           "a[5] = { x: 1 }\n"
+           "a[19999] = { y: { z: 2 } }\n"
+           "__$gc()\n__$gc()\n__$gc()\n"
+           "return a[5].x + a[19999].y.z + a[7]", {
+    assert(result->As<Number>()->Value() == 10);
+  })
+
+  // Frames: values in spill slots, Masm spills and pushed arguments are
+  // updated by moving GC
+  FUN_TEST("f(a, rest...) {\n"
+           "  __$gc()\n"
+           "  return a.x + rest[1].x\n"
+           "}\n"
+           "g(o) {\n"
+           "  r = f(o, { x: 2 }, { x: 3 })\n"
+           "  __$gc()\n"
+           "  return r + o.x\n"
+           "}\n"
+           "return g({ x: 1 }) + g({ x: 10 })", {
+    assert(result->As<Number>()->Value() == 28);
+  })
+
+  // Incremental marking: old space is marked in bounded steps while
+  // program moves old objects between lists (write barrier greys them).
+  // Zero pause disables it.
+  for (uint32_t max_pause = 0; max_pause <= 100; max_pause += 100) {
+    Isolate i;
+    i.SetMaxGCPause(max_pause);
+
+    const char* code = "l1 = nil\nl2 = nil\ni = 0\n"
+                       "while (i < 1000) {\n"
+                       "  l1 = { next: l1, value: i }\n"
+                       "  i++\n"
+                       "}\n"
+                       "__$gc()\n__$gc()\n__$gc()\n"
+                       "__$gc()\n__$gc()\n__$gc()\n"
+                       "j = 0\n"
+                       "while (j < 100) {\n"
+                       "  g = nil\n"
+                       "  x = 2000\n"
+                       "  while (--x) {\n"
+                       "    g = { x: { y: g } }\n"
+                       "  }\n"
+                       "  if (l1) {\n"
+                       "    n = l1\n"
+                       "    l1 = l1.next\n"
+                       "    n.next = l2\n"
+                       "    l2 = n\n"
+                       "  }\n"
+                       "  __$gc()\n__$gc()\n__$gc()\n__$gc()\n__$gc()\n"
+                       "  j++\n"
+                       "}\n"
+                       "sum = 0\n"
+                       "while (l1) {\n"
+                       "  sum = sum + l1.value\n"
+                       "  l1 = l1.next\n"
+                       "}\n"
+                       "while (l2) {\n"
+                       "  sum = sum + l2.value\n"
+                       "  l2 = l2.next\n"
+                       "}\n"
+                       "return sum";
+    Function* f = Function::New("test", code, strlen(code));
+    Value* argv[1];
+    Value* result = f->Call(0, argv);
+    assert(result->As<Number>()->Value() == 499500);
+
+    HeapStatistics stats;
+    i.GetHeapStatistics(&stats);
+    assert(stats.old_space_gcs > 0);
+    assert((stats.incremental_steps > 0) == (max_pause != 0));
+  }
+
+  // Background sweeping: old space keeps allocating in a fresh page while
+  // sweeper turns dead objects into free chunks, which are reused by
+  // the following promotions
+  {
+    Isolate i;
+    i.SetMaxGCPause(0);
+    Heap* heap = Heap::Current();
+    Space* old_space = heap->old_space();
+
+    const char* code = "if (!global.keep) {\n"
+                       "  keep = nil\ni = 0\n"
+                       "  while (i < 1000) {\n"
+                       "    keep = { next: keep, value: i }\n"
+                       "    i++\n"
+                       "  }\n"
+                       "  global.keep = keep\n"
+                       "}\n"
+                       "j = 0\n"
+                       "while (j < global.rounds) {\n"
+                       "  g = nil\n"
+                       "  x = 2000\n"
+                       "  while (--x) {\n"
+                       "    g = { x: { y: g } }\n"
+                       "  }\n"
+                       "  __$gc()\n__$gc()\n__$gc()\n__$gc()\n__$gc()\n"
+                       "  j++\n"
+                       "}\n"
+                       "keep = global.keep\nsum = 0\n"
+                       "while (keep) {\n"
+                       "  sum = sum + keep.value\n"
+                       "  keep = keep.next\n"
+                       "}\n"
+                       "return sum";
+    Handle<Object> global(Object::New());
+    global->Set("rounds", Number::NewIntegral(50));
+    Handle<Function> f(Function::New("test", code, strlen(code)));
+    f->SetContext(*global);
+    Value* argv[1];
+    assert(f->Call(0, argv)->As<Number>()->Value() == 499500);
+    assert(!old_space->is_sweeping());
+
+    heap->needs_gc(Heap::kGCOldSpace);
+    Function::New("test", "__$gc()", 7)->Call(0, argv);
+    assert(old_space->is_sweeping());
+
+    old_space->FinishSweeping();
+    assert(!old_space->is_sweeping());
+    assert(old_space->live_size() > 0);
+    assert(old_space->free_size() > 4 * old_space->live_size());
+
+    // Promoted objects are put into swept chunks
+    uint32_t size = old_space->size();
+    uint32_t free_size = old_space->free_size();
+    global->Set("rounds", Number::NewIntegral(10));
+    assert(f->Call(0, argv)->As<Number>()->Value() == 499500);
+    assert(old_space->size() == size);
+    assert(old_space->free_size() < free_size);
+  }
+
+  // Sweeper walks pages object by object, sizes of objects allocated from
+  // C++ should match HValue::Size()
+  {
+    Isolate i;
+    i.SetMaxGCPause(0);
+    Heap* heap = Heap::Current();
+    Space* old_space = heap->old_space();
+
+    Handle<Array> keep(Array::New());
+    uint32_t kept_size = 0;
+    char* prev = NULL;
+    for (uint32_t j = 0; j < 3000; j++) {
+      char* value;
+      switch (j % 3) {
+       case 0:
+        value = HNumber::New(heap, Heap::kTenureOld, j + 0.5);
+        break;
+       case 1:
+        value = HBoolean::New(heap, Heap::kTenureOld, true);
+        break;
+       default:
+        value = HString::New(heap, Heap::kTenureOld, "0123456789ab", j % 13);
+        break;
+      }
+
+      // Objects are allocated one after another
+      if (prev != NULL &&
+          Space::Page::FromAddress(prev) == Space::Page::FromAddress(value)) {
+        assert(value - prev == static_cast<intptr_t>(
+            RoundUp(HValue::Cast(prev)->Size(), HValue::kPointerSize)));
+      }
+      prev = value;
+
+      // Every other triple is garbage
+      if ((j / 3) % 2 != 0) continue;
+      keep->Set(keep->Length(), reinterpret_cast<Value*>(value));
+      kept_size += RoundUp(HValue::Cast(value)->Size(), HValue::kPointerSize);
+    }
+
+    heap->needs_gc(Heap::kGCOldSpace);
+    Value* argv[1];
+    Function::New("test", "__$gc()", 7)->Call(0, argv);
+    assert(old_space->is_sweeping());
+
+    old_space->FinishSweeping();
+    assert(old_space->live_size() >= kept_size);
+    assert(old_space->free_size() >= kept_size);
+
+    for (uint32_t j = 0; j < 3000; j += 6) {
+      Value* number = keep->Get(j / 2);
+      Value* boolean = keep->Get(j / 2 + 1);
+      Value* string = keep->Get(j / 2 + 2);
+      assert(number->As<Number>()->Value() == j + 0.5);
+      assert(boolean->As<Boolean>()->IsTrue());
+      assert(string->As<String>()->Length() == (j + 2) % 13);
+      assert(strncmp(string->As<String>()->Value(),
+                     "0123456789ab",
+                     (j + 2) % 13) == 0);
+    }
+  }
+
+  // Parallel scavenge: objects reachable from many roots are copied once,
+  // old objects referencing new ones are remembered by workers
+  {
+    Isolate i;
+    i.SetGCThreads(4);
+
+    const char* code = "shared = { v: 7 }\nkeep = nil\ni = 0\n"
+                       "while (i < 2000) {\n"
+                       "  keep = { next: keep, shared: shared, value: i }\n"
+                       "  i++\n"
+                       "}\n"
+                       "old = { a: nil }\n"
+                       "__$gc()\n__$gc()\n__$gc()\n"
+                       "__$gc()\n__$gc()\n__$gc()\n"
+                       "old.a = { b: 3 }\n"
+                       "j = 0\n"
+                       "while (j < 20) {\n"
+                       "  g = nil\n"
+                       "  x = 5000\n"
+                       "  while (--x) {\n"
+                       "    g = { x: g, s: shared }\n"
+                       "  }\n"
+                       "  __$gc()\n"
+                       "  j++\n"
+                       "}\n"
+                       "sum = 0\n"
+                       "while (keep) {\n"
+                       "  if (keep.shared !== shared) return -1\n"
+                       "  sum = sum + keep.value\n"
+                       "  keep = keep.next\n"
+                       "}\n"
+                       "return sum + old.a.b + shared.v + g.x.s.v";
+    Function* f = Function::New("test", code, strlen(code));
+    Value* argv[1];
+    Value* result = f->Call(0, argv);
+    assert(result->As<Number>()->Value() == 1999000 + 3 + 7 + 7);
+
+    HeapStatistics stats;
+    i.GetHeapStatistics(&stats);
+    assert(stats.new_space_gcs >= 26);
+  }
+
+  // String table: interned strings are found by contents, old space GC
+  // removes the ones that are referenced only by the table
+  {
+    Isolate i;
+    Heap* heap = Heap::Current();
+    StringTable* table = heap->string_table();
+
+    const char* code = "__$gc()\nreturn 'interned-literal'";
+    Function* f = Function::New("gc", code, strlen(code));
+    uint32_t count = table->count();
+
+    char* str = HString::NewInterned(heap, "interned-test", 13);
+    assert(HString::NewInterned(heap, "interned-test", 13) == str);
+    assert(table->Lookup("interned-test", 13, HString::CachedHash(str)) == str);
+    assert(table->count() == count + 1);
+
+    heap->needs_gc(Heap::kGCOldSpace);
+    Value* argv[1];
+    Value* result = f->Call(0, argv);
+
+    char* literal = reinterpret_cast<char*>(result);
+    assert(table->count() == count);
+    assert(table->Lookup("interned-literal",
+                         16,
+                         HString::CachedHash(literal)) == literal);
+    assert(table->Lookup("interned-test",
+                         13,
+                         ComputeHash("interned-test", 13)) == NULL);
+    assert(HString::NewInterned(heap, "interned-literal", 16) == literal);
+  }
+
+  // String hashes: cons strings are hashed leaf by leaf, the result should
+  // be the same as for the flat string with the same contents
+  {
+    Isolate i;
+    Heap* heap = Heap::Current();
+
+    char value[41];
+    for (uint32_t j = 0; j < sizeof(value); j++) {
+      value[j] = 'a' + (j * 7) % 26;
+    }
+
+    for (uint32_t length = 0; length <= sizeof(value); length++) {
+      uint32_t hash = ComputeHash(value, length);
+
+      for (uint32_t split = 0; split <= length; split++) {
+        StringHasher hasher(length);
+        hasher.Update(value, split);
+        hasher.Update(value + split, length - split);
+        assert(hasher.Finish() == hash);
+
+        if (split == 0 || split == length) continue;
+
+        char* left = HString::New(heap, Heap::kTenureOld, value, split);
+        char* right = HString::New(heap,
+                                   Heap::kTenureOld,
+                                   value + split,
+                                   length - split);
+        char* cons = HString::NewCons(heap,
+                                      Heap::kTenureOld,
+                                      length,
+                                      left,
+                                      right);
+        assert(HString::Hash(heap, cons) == hash);
+      }
+
+      // Byte by byte
+      StringHasher hasher(length);
+      for (uint32_t j = 0; j < length; j++) hasher.Update(value + j, 1);
+      assert(hasher.Finish() == hash);
+    }
+
+    // Zero marks hash that isn't computed yet
+    char zeros[64];
+    memset(zeros, 0, sizeof(zeros));
+    for (uint32_t length = 0; length <= sizeof(zeros); length++) {
+      assert(ComputeHash(zeros, length) != 0);
+    }
+
+    // Tail is zero-padded: bytes after it don't matter, but its length does
+    uint32_t hashes[8];
+    for (uint32_t tail = 0; tail < 8; tail++) {
+      char padded[24];
+      memset(padded, 0xff, sizeof(padded));
+      memcpy(padded, value, 16 + tail);
+
+      hashes[tail] = ComputeHash(value, 16 + tail);
+      assert(ComputeHash(padded, 16 + tail) == hashes[tail]);
+      assert(ComputeHash(zeros, 16 + tail) != ComputeHash(zeros, 17 + tail));
+
+      for (uint32_t j = 0; j < tail; j++) assert(hashes[j] != hashes[tail]);
+    }
+  }
 TEST_END(gc)
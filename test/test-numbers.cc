@@ -1,4 +1,50 @@
 #include "test.h"
+#include <numbers.h>
+
+static void TestIntegralToString(int64_t value, const char* expected) {
+  char buffer[kMaxNumberLength];
+  uint32_t length = IntegralToString(value, buffer);
+  assert(length == strlen(expected));
+  assert(strncmp(buffer, expected, length) == 0);
+}
+
+
+static void TestDoubleToString(double value, const char* expected) {
+  char buffer[kMaxNumberLength];
+  uint32_t length = DoubleToString(value, buffer);
+  if (length != strlen(expected) || strncmp(buffer, expected, length) != 0) {
+    fprintf(stderr,
+            "DoubleToString(%.17g) got: %.*s, expected: %s\n",
+            value,
+            length,
+            buffer,
+            expected);
+    abort();
+  }
+}
+
+
+static void TestStringToDouble(const char* value, double expected) {
+  double result = StringToDouble(value, strlen(value));
+  if (memcmp(&result, &expected, sizeof(result)) != 0) {
+    fprintf(stderr,
+            "StringToDouble(%s) got: %.17g, expected: %.17g\n",
+            value,
+            result,
+            expected);
+    abort();
+  }
+}
+
+
+static void TestStringToIntegral(const char* value,
+                                 bool expected,
+                                 int64_t expected_value) {
+  int64_t result = 0;
+  assert(StringToIntegral(value, strlen(value), &result) == expected);
+  if (expected) assert(result == expected_value);
+}
+
 
 TEST_START(numbers)
   // Basics
@@ -109,4 +155,64 @@ TEST_START(numbers)
            " - 2305843009213693952", {
     assert(result->As<Number>()->Value() == -5.0 * 2305843009213693952.0);
   })
+
+  // Conversions
+  TestIntegralToString(0, "0");
+  TestIntegralToString(7, "7");
+  TestIntegralToString(-42, "-42");
+  TestIntegralToString(1234567890123LL, "1234567890123");
+  TestIntegralToString(-1152921504606846976LL, "-1152921504606846976");
+
+  TestDoubleToString(0.0, "0");
+  TestDoubleToString(-0.0, "-0");
+  TestDoubleToString(1.5, "1.5");
+  TestDoubleToString(-2.25, "-2.25");
+  TestDoubleToString(0.1, "0.1");
+  TestDoubleToString(0.001, "0.001");
+  TestDoubleToString(0.000001, "0.000001");
+  TestDoubleToString(1.5e-7, "1.5e-7");
+  TestDoubleToString(123456789012.0, "123456789012");
+  TestDoubleToString(1e21, "1e+21");
+  TestDoubleToString(1.7976931348623157e308, "1.7976931348623157e+308");
+  TestDoubleToString(5e-324, "5e-324");
+
+  TestStringToDouble("0", 0.0);
+  TestStringToDouble("-0", -0.0);
+  TestStringToDouble("1.5", 1.5);
+  TestStringToDouble("-2.25", -2.25);
+  TestStringToDouble("0.1", 0.1);
+  TestStringToDouble("0.000001", 0.000001);
+  TestStringToDouble("  12.5", 12.5);
+  TestStringToDouble("3.25abc", 3.25);
+  TestStringToDouble(".5", 0.5);
+  TestStringToDouble("1.2345678901234567", 1.2345678901234567);
+  TestStringToDouble("9007199254740993", 9007199254740992.0);
+  TestStringToDouble("123456789012345678901234567890",
+                     123456789012345678901234567890.0);
+  TestStringToDouble("0.1000000000000000055511151231257827", 0.1);
+
+  TestStringToIntegral("0", true, 0);
+  TestStringToIntegral("-17", true, -17);
+  TestStringToIntegral("123456789012345678", true, 123456789012345678LL);
+  TestStringToIntegral("1234567890123456789", false, 0);
+  TestStringToIntegral("-0", false, 0);
+  TestStringToIntegral("", false, 0);
+  TestStringToIntegral("-", false, 0);
+  TestStringToIntegral("1.5", false, 0);
+  TestStringToIntegral("12a", false, 0);
+
+  // Literals and coercion are correctly rounded
+  FUN_TEST("return 0.000001", {
+    assert(result->As<Number>()->Value() == 0.000001);
+  })
+
+  FUN_TEST("return '0.3' - 0", {
+    assert(result->As<Number>()->Value() == 0.3);
+  })
+
+  FUN_TEST("return '' + 0.000001", {
+    String* str = result->As<String>();
+    assert(str->Length() == 8);
+    assert(strncmp(str->Value(), "0.000001", str->Length()) == 0);
+  })
 TEST_END(numbers)